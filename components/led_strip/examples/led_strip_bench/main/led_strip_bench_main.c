@@ -0,0 +1,181 @@
+/*
+ * SPDX-FileCopyrightText: 2025 FloraLink contributors
+ *
+ * SPDX-License-Identifier: Unlicense OR CC0-1.0
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_timer.h"
+#include "soc/soc_caps.h"
+#include "led_strip.h"
+#include "esp_log.h"
+#include "esp_err.h"
+
+// GPIO assignment, nothing needs to be connected
+#define LED_STRIP_GPIO_PIN  2
+
+// Number of frames timed per step, the average is printed
+#define BENCH_ROUNDS 20
+
+// Colors of the palette backend
+#define BENCH_PALETTE_SIZE 16
+
+static const char *TAG = "bench";
+
+static const uint32_t s_led_counts[] = {1, 60, 300, 1000};
+
+typedef enum {
+    BENCH_RMT,         // RMT, a color per pixel
+    BENCH_RMT_PALETTE, // RMT, a palette index per pixel
+    BENCH_SPI,         // SPI with DMA
+    BENCH_BACKENDS,
+} bench_backend_t;
+
+static const char *const s_backend_names[BENCH_BACKENDS] = {"RMT", "RMT pal", "SPI"};
+
+// Symbols the RMT ISR refills at a time: half the channel memory
+#define BENCH_RMT_REFILL_SYMBOLS (SOC_RMT_MEM_WORDS_PER_CHANNEL / 2)
+
+typedef struct {
+    int64_t fill_us;    // led_strip_set_pixel() (palette: led_strip_set_pixel_indices()) over the whole strip
+    int64_t start_us;   // led_strip_refresh_async() until it returns: copy (RMT) or encode (SPI) and start
+    int64_t encode_us;  // Encoding the frame: the RMT encoder callback, run apart from the ISR; SPI: as start_us
+    int64_t refresh_us; // led_strip_refresh(): the complete frame on the wire
+} bench_result_t;
+
+static led_strip_handle_t bench_new_strip(bench_backend_t backend, uint32_t led_count)
+{
+    led_strip_config_t strip_config = {
+        .strip_gpio_num = LED_STRIP_GPIO_PIN,
+        .max_leds = led_count,
+        .led_model = LED_MODEL_WS2812,
+        .color_component_format = LED_STRIP_COLOR_COMPONENT_FMT_GRB,
+        // Time the change tracking too; every frame changes all pixels, so the whole strip is still sent
+        .flags.partial_refresh = true,
+    };
+    led_strip_handle_t led_strip = NULL;
+    esp_err_t err;
+    if (backend == BENCH_SPI) {
+        led_strip_spi_config_t spi_config = {
+            .clk_src = SPI_CLK_SRC_DEFAULT,
+            .spi_bus = SPI2_HOST,
+            .flags = {
+                .with_dma = true,
+            }
+        };
+        err = led_strip_new_spi_device(&strip_config, &spi_config, &led_strip);
+    } else {
+        led_strip_rmt_config_t rmt_config = {
+            .clk_src = RMT_CLK_SRC_DEFAULT,
+            .resolution_hz = 10 * 1000 * 1000,
+            .palette_size = backend == BENCH_RMT_PALETTE ? BENCH_PALETTE_SIZE : 0,
+        };
+        err = led_strip_new_rmt_device(&strip_config, &rmt_config, &led_strip);
+    }
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "%s strip of %lu LEDs: %s", s_backend_names[backend], (unsigned long)led_count, esp_err_to_name(err));
+        return NULL;
+    }
+    if (backend == BENCH_RMT_PALETTE) {
+        for (uint32_t i = 1; i < BENCH_PALETTE_SIZE; i++) {
+            ESP_ERROR_CHECK(led_strip_set_palette_color(led_strip, i, i * 16, 0x3F - i, i & 0x1F, 0));
+        }
+    }
+    return led_strip;
+}
+
+// Draw a frame that differs from the previous one in every pixel, so that the whole strip is sent
+static void bench_fill(led_strip_handle_t led_strip, bench_backend_t backend, uint32_t led_count, uint32_t frame)
+{
+    for (uint32_t i = 0; i < led_count; i++) {
+        if (backend == BENCH_RMT_PALETTE) {
+            uint8_t palette_index = (i + frame) % BENCH_PALETTE_SIZE;
+            ESP_ERROR_CHECK(led_strip_set_pixel_indices(led_strip, i, 1, &palette_index));
+        } else {
+            ESP_ERROR_CHECK(led_strip_set_pixel(led_strip, i, (i + frame) & 0xFF, i & 0x3F, frame & 0x1F));
+        }
+    }
+}
+
+/*
+ * The RMT backend produces the symbols from its ISR while the frame is sent, so refresh times do not
+ * show the encoder cost. Have the strip encode its frame in this task, into a buffer as large as a
+ * refill, as that ISR does. Returns the time taken, -1 if the encoder cannot be called (ESP-IDF < v5.3).
+ */
+static int64_t bench_rmt_encode(led_strip_handle_t led_strip)
+{
+    rmt_symbol_word_t symbols[BENCH_RMT_REFILL_SYMBOLS];
+    size_t symbol_count = 0;
+    int64_t start = esp_timer_get_time();
+    esp_err_t err = led_strip_rmt_encode_frame(led_strip, symbols, BENCH_RMT_REFILL_SYMBOLS, &symbol_count);
+    int64_t time_us = esp_timer_get_time() - start;
+    if (err == ESP_ERR_NOT_SUPPORTED) {
+        return -1;
+    }
+    ESP_ERROR_CHECK(err);
+    return time_us;
+}
+
+static void bench_run(led_strip_handle_t led_strip, bench_backend_t backend, uint32_t led_count, bench_result_t *result)
+{
+    int64_t start;
+    *result = (bench_result_t) {};
+    for (uint32_t round = 0; round < BENCH_ROUNDS; round++) {
+        start = esp_timer_get_time();
+        bench_fill(led_strip, backend, led_count, 2 * round);
+        result->fill_us += esp_timer_get_time() - start;
+
+        start = esp_timer_get_time();
+        ESP_ERROR_CHECK(led_strip_refresh_async(led_strip));
+        result->start_us += esp_timer_get_time() - start;
+        ESP_ERROR_CHECK(led_strip_refresh_wait_done(led_strip, -1));
+
+        if (backend != BENCH_SPI) {
+            int64_t encode_us = bench_rmt_encode(led_strip);
+            result->encode_us = encode_us < 0 || result->encode_us < 0 ? -1 : result->encode_us + encode_us;
+        }
+
+        // A new frame: with partial refresh, refreshing an unchanged one sends nothing
+        bench_fill(led_strip, backend, led_count, 2 * round + 1);
+        start = esp_timer_get_time();
+        ESP_ERROR_CHECK(led_strip_refresh(led_strip));
+        result->refresh_us += esp_timer_get_time() - start;
+    }
+    result->fill_us /= BENCH_ROUNDS;
+    result->start_us /= BENCH_ROUNDS;
+    // The SPI backend encodes the frame before starting it
+    result->encode_us = backend == BENCH_SPI ? result->start_us : result->encode_us / BENCH_ROUNDS;
+    result->refresh_us /= BENCH_ROUNDS;
+}
+
+static unsigned long bench_pixels_per_s(uint32_t led_count, int64_t us)
+{
+    return us > 0 ? (unsigned long)(led_count * 1000000ULL / us) : 0;
+}
+
+void app_main(void)
+{
+    ESP_LOGI(TAG, "%d frames per step, times in us", BENCH_ROUNDS);
+    printf("backend   leds    fill   start  encode  refresh  fill px/s  encode px/s  refresh px/s\n");
+    for (bench_backend_t backend = 0; backend < BENCH_BACKENDS; backend++) {
+        for (size_t i = 0; i < sizeof(s_led_counts) / sizeof(s_led_counts[0]); i++) {
+            uint32_t led_count = s_led_counts[i];
+            led_strip_handle_t led_strip = bench_new_strip(backend, led_count);
+            if (!led_strip) {
+                continue;
+            }
+            bench_result_t result;
+            bench_run(led_strip, backend, led_count, &result);
+            printf("%-7s %6lu %7lld %7lld %7lld %8lld %10lu %12lu %13lu\n", s_backend_names[backend], (unsigned long)led_count,
+                   (long long)result.fill_us, (long long)result.start_us, (long long)result.encode_us, (long long)result.refresh_us,
+                   bench_pixels_per_s(led_count, result.fill_us), bench_pixels_per_s(led_count, result.encode_us),
+                   bench_pixels_per_s(led_count, result.refresh_us));
+            ESP_ERROR_CHECK(led_strip_clear(led_strip));
+            ESP_ERROR_CHECK(led_strip_del(led_strip));
+            vTaskDelay(pdMS_TO_TICKS(10));
+        }
+    }
+    ESP_LOGI(TAG, "Done");
+}
@@ -0,0 +1,237 @@
+/*
+ * SPDX-FileCopyrightText: 2022-2024 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#pragma once
+
+#include <stdint.h>
+#include "esp_err.h"
+#include "led_strip_rmt.h"
+#include "led_strip_spi.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Set RGB for a specific pixel
+ *
+ * @param strip: LED strip
+ * @param index: index of pixel to set
+ * @param red: red part of color
+ * @param green: green part of color
+ * @param blue: blue part of color
+ *
+ * @return
+ *      - ESP_OK: Set RGB for a specific pixel successfully
+ *      - ESP_ERR_INVALID_ARG: Set RGB for a specific pixel failed because of invalid parameters
+ *      - ESP_FAIL: Set RGB for a specific pixel failed because other error occurred
+ */
+esp_err_t led_strip_set_pixel(led_strip_handle_t strip, uint32_t index, uint32_t red, uint32_t green, uint32_t blue);
+
+/**
+ * @brief Set RGBW for a specific pixel
+ *
+ * @note Only call this function if your led strip does have the white component (e.g. SK6812-RGBW)
+ * @note Also see `led_strip_set_pixel` if you only want to specify the RGB part of the color and bypass the white component
+ *
+ * @param strip: LED strip
+ * @param index: index of pixel to set
+ * @param red: red part of color
+ * @param green: green part of color
+ * @param blue: blue part of color
+ * @param white: separate white component
+ *
+ * @return
+ *      - ESP_OK: Set RGBW color for a specific pixel successfully
+ *      - ESP_ERR_INVALID_ARG: Set RGBW color for a specific pixel failed because of an invalid argument
+ *      - ESP_FAIL: Set RGBW color for a specific pixel failed because other error occurred
+ */
+esp_err_t led_strip_set_pixel_rgbw(led_strip_handle_t strip, uint32_t index, uint32_t red, uint32_t green, uint32_t blue, uint32_t white);
+
+/**
+ * @brief Set HSV for a specific pixel
+ *
+ * @param strip: LED strip
+ * @param index: index of pixel to set
+ * @param hue: hue part of color (0 - 360)
+ * @param saturation: saturation part of color (0 - 255, rescaled from 0 - 1. e.g. saturation = 0.5, rescaled to 127)
+ * @param value: value part of color (0 - 255, rescaled from 0 - 1. e.g. value = 0.5, rescaled to 127)
+ *
+ * @return
+ *      - ESP_OK: Set HSV color for a specific pixel successfully
+ *      - ESP_ERR_INVALID_ARG: Set HSV color for a specific pixel failed because of an invalid argument
+ *      - ESP_FAIL: Set HSV color for a specific pixel failed because other error occurred
+ */
+esp_err_t led_strip_set_pixel_hsv(led_strip_handle_t strip, uint32_t index, uint16_t hue, uint8_t saturation, uint8_t value);
+
+/**
+ * @brief Set RGB for consecutive pixels from a packed buffer
+ *
+ * Same as `led_strip_blit()` with `LED_STRIP_PIXEL_FMT_RGB888`.
+ *
+ * @param strip: LED strip
+ * @param index: index of the first pixel to set
+ * @param count: number of pixels to set
+ * @param rgb: `count` pixels of 3 bytes: red, green, blue
+ *
+ * @return
+ *      - ESP_OK: Set the pixels successfully
+ *      - ESP_ERR_INVALID_ARG: Set the pixels failed because of invalid parameters
+ */
+esp_err_t led_strip_set_pixels(led_strip_handle_t strip, uint32_t index, uint32_t count, const uint8_t *rgb);
+
+/**
+ * @brief Set consecutive pixels from a packed buffer in the given format
+ *
+ * The colors are reordered into the strip's color component format in one pass,
+ * instead of one `led_strip_set_pixel()` call per pixel.
+ *
+ * @param strip: LED strip
+ * @param index: index of the first pixel to set
+ * @param count: number of pixels to set
+ * @param pixels: `count` pixels in `format`
+ * @param format: layout of `pixels`
+ *
+ * @return
+ *      - ESP_OK: Set the pixels successfully
+ *      - ESP_ERR_INVALID_ARG: Set the pixels failed because of invalid parameters, e.g. pixels past the end of the
+ *        strip, or `LED_STRIP_PIXEL_FMT_RGBW8888` for LEDs without a white component
+ */
+esp_err_t led_strip_blit(led_strip_handle_t strip, uint32_t index, uint32_t count, const void *pixels, led_strip_pixel_format_t format);
+
+/**
+ * @brief Set a color of the palette, for a strip created with a palette (`palette_size` of the RMT backend)
+ *
+ * The pixels showing this entry change at the next refresh.
+ *
+ * @param strip: LED strip
+ * @param palette_index: palette entry, from 1 to `palette_size` - 1; entry 0 is black
+ * @param red: red part of color
+ * @param green: green part of color
+ * @param blue: blue part of color
+ * @param white: separate white component, ignored if the LEDs don't have one
+ *
+ * @return
+ *      - ESP_OK: Set the palette color successfully
+ *      - ESP_ERR_INVALID_ARG: Set the palette color failed because of invalid parameters
+ *      - ESP_ERR_INVALID_STATE: Set the palette color failed because the strip has no palette
+ *      - ESP_ERR_NOT_SUPPORTED: Set the palette color failed because the backend has no palette mode
+ */
+esp_err_t led_strip_set_palette_color(led_strip_handle_t strip, uint32_t palette_index, uint32_t red, uint32_t green, uint32_t blue, uint32_t white);
+
+/**
+ * @brief Set consecutive pixels to palette colors, for a strip created with a palette
+ *
+ * @param strip: LED strip
+ * @param index: index of the first pixel to set
+ * @param count: number of pixels to set
+ * @param palette_indices: `count` palette entries, one byte per pixel
+ *
+ * @return
+ *      - ESP_OK: Set the pixels successfully
+ *      - ESP_ERR_INVALID_ARG: Set the pixels failed because of invalid parameters
+ *      - ESP_ERR_INVALID_STATE: Set the pixels failed because the strip has no palette
+ *      - ESP_ERR_NOT_SUPPORTED: Set the pixels failed because the backend has no palette mode
+ */
+esp_err_t led_strip_set_pixel_indices(led_strip_handle_t strip, uint32_t index, uint32_t count, const uint8_t *palette_indices);
+
+/**
+ * @brief Refresh memory colors to LEDs
+ *
+ * The whole strip is sent. With `flags.partial_refresh` in `led_strip_config_t`, only the pixels
+ * up to the last one changed since the previous refresh are sent, the LEDs after it keeping
+ * their colors, and nothing if no pixel changed.
+ *
+ * @param strip: LED strip
+ *
+ * @return
+ *      - ESP_OK: Refresh successfully
+ *      - ESP_FAIL: Refresh failed because some other error occurred
+ *
+ * @note:
+ *      After updating the LED colors in the memory, a following invocation of this API is needed to flush colors to strip.
+ * @note:
+ *      `led_strip_clear()` always sends the whole strip, e.g. to resynchronize LEDs that were powered off.
+ */
+esp_err_t led_strip_refresh(led_strip_handle_t strip);
+
+/**
+ * @brief Start shifting the memory colors out to the LEDs, without waiting for the end
+ *
+ * The colors are copied to a second buffer that the backend transmits from, so the next
+ * frame can be drawn with the set_pixel functions meanwhile: the RMT backend allocates a
+ * copy of the pixel buffer on the first call, the SPI backend encodes the frame into its
+ * SPI buffer. At most one frame is in flight: if the previous one has not finished yet,
+ * this function waits for it first. As with `led_strip_refresh()`, with `flags.partial_refresh`
+ * only the pixels up to the last changed one are sent; if no pixel changed, the function
+ * returns at once and no `on_refresh_done` callback follows.
+ *
+ * @param strip: LED strip
+ *
+ * @return
+ *      - ESP_OK: Refresh started successfully
+ *      - ESP_ERR_NO_MEM: Refresh failed because the second pixel buffer could not be allocated
+ *      - ESP_FAIL: Refresh failed because some other error occurred
+ *
+ * @note: Completion is signalled by the `on_refresh_done` callback, see `led_strip_register_event_callbacks()`,
+ *        or waited for with `led_strip_refresh_wait_done()`; either is enough. The RMT backend disables
+ *        its channel, releasing its power management lock, from the FreeRTOS timer service task once
+ *        the frame is out, so the timer service task must be enabled (it is by default).
+ */
+esp_err_t led_strip_refresh_async(led_strip_handle_t strip);
+
+/**
+ * @brief Wait for the frame started by `led_strip_refresh_async()` to be shifted out
+ *
+ * @param strip: LED strip
+ * @param timeout_ms: Wait timeout, in ms; -1 waits forever
+ *
+ * @return
+ *      - ESP_OK: No frame is in flight any more
+ *      - ESP_ERR_TIMEOUT: The frame is still being shifted out
+ *      - ESP_FAIL: Wait failed because some other error occurred
+ */
+esp_err_t led_strip_refresh_wait_done(led_strip_handle_t strip, int32_t timeout_ms);
+
+/**
+ * @brief Set the callbacks for LED strip events
+ *
+ * @param strip: LED strip
+ * @param cbs: Group of callback functions; a NULL member disables that callback
+ * @param user_ctx: User context, passed to the callbacks
+ *
+ * @return
+ *      - ESP_OK: Set the callbacks successfully
+ *      - ESP_ERR_INVALID_ARG: Set the callbacks failed because of invalid parameters
+ *
+ * @note The callbacks run for every frame, those of `led_strip_refresh()` and `led_strip_clear()` included.
+ */
+esp_err_t led_strip_register_event_callbacks(led_strip_handle_t strip, const led_strip_event_callbacks_t *cbs, void *user_ctx);
+
+/**
+ * @brief Clear LED strip (turn off all LEDs)
+ *
+ * @param strip: LED strip
+ *
+ * @return
+ *      - ESP_OK: Clear LEDs successfully
+ *      - ESP_FAIL: Clear LEDs failed because some other error occurred
+ */
+esp_err_t led_strip_clear(led_strip_handle_t strip);
+
+/**
+ * @brief Free LED strip resources
+ *
+ * @param strip: LED strip
+ *
+ * @return
+ *      - ESP_OK: Free resources successfully
+ *      - ESP_FAIL: Free resources failed because error occurred
+ */
+esp_err_t led_strip_del(led_strip_handle_t strip);
+
+#ifdef __cplusplus
+}
+#endif
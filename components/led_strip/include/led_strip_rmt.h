@@ -0,0 +1,76 @@
+/*
+ * SPDX-FileCopyrightText: 2022-2024 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#pragma once
+
+#include <stdint.h>
+#include "esp_err.h"
+#include "led_strip_types.h"
+#include "esp_idf_version.h"
+#include "driver/rmt_types.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief LED Strip RMT specific configuration
+ */
+typedef struct {
+    rmt_clock_source_t clk_src; /*!< RMT clock source */
+    uint32_t resolution_hz;     /*!< RMT tick resolution, if set to zero, a default resolution (10MHz) will be applied */
+    size_t mem_block_symbols;   /*!< How many RMT symbols can one RMT channel hold at one time. Set to 0 will fallback to use the default size. */
+    uint32_t palette_size;      /*!< Number of palette colors, 2 - 256, to store each pixel as a 1-byte index into a palette, expanded to
+                                     its color during the transmission (ESP-IDF v5.3 and later). Entry 0 is black. Set to 0 to store the colors */
+    /*!< Extra RMT specific driver flags */
+    struct led_strip_rmt_extra_config {
+        uint32_t with_dma: 1;   /*!< Use DMA to transmit data */
+    } flags;                    /*!< Extra driver flags */
+} led_strip_rmt_config_t;
+
+/**
+ * @brief Create LED strip based on RMT TX channel
+ *
+ * With `palette_size`, the strip takes `max_leds` bytes of pixels plus the palette, instead of
+ * `max_leds` times the number of color components (and as much again for `led_strip_refresh_async()`).
+ * The pixels are then set with `led_strip_set_pixel_indices()`; `led_strip_set_pixel()` and
+ * `led_strip_set_pixel_rgbw()` take colors of the palette only, and `led_strip_blit()` is not supported.
+ * On chips with RMT DMA, `flags.with_dma` lets the symbols be produced ahead in a larger buffer.
+ *
+ * @param led_config LED strip configuration
+ * @param rmt_config RMT specific configuration
+ * @param ret_strip Returned LED strip handle
+ * @return
+ *      - ESP_OK: create LED strip handle successfully
+ *      - ESP_ERR_INVALID_ARG: create LED strip handle failed because of invalid argument
+ *      - ESP_ERR_NO_MEM: create LED strip handle failed because of out of memory
+ *      - ESP_FAIL: create LED strip handle failed because some other error
+ */
+esp_err_t led_strip_new_rmt_device(const led_strip_config_t *led_config, const led_strip_rmt_config_t *rmt_config, led_strip_handle_t *ret_strip);
+
+/**
+ * @brief Encode the pixels of an RMT strip to RMT symbols in the calling task, without transmitting them
+ *
+ * During a refresh the symbols are produced by the RMT ISR, one refill of the channel memory at a time,
+ * so their cost does not show in the refresh time. This function runs the same encoder over the whole
+ * strip, then the reset code, filling `symbols` from its start on each refill: with `symbols_size` set
+ * to half the channel memory it measures the encoder as the ISR runs it; with room for the whole frame,
+ * `symbols` holds the waveform that a refresh sends. A frame in flight is waited for first.
+ *
+ * @param strip LED strip created by `led_strip_new_rmt_device()`
+ * @param symbols Buffer for the symbols of one refill
+ * @param symbols_size Size of `symbols`, in symbols: at least 8, the symbols of one color byte
+ * @param ret_symbols Returned number of symbols of the frame, the reset code included
+ * @return
+ *      - ESP_OK: the frame is encoded
+ *      - ESP_ERR_INVALID_ARG: invalid argument, or not an RMT strip
+ *      - ESP_ERR_NOT_SUPPORTED: the encoder runs only from the ISR (ESP-IDF before v5.3)
+ *      - ESP_FAIL: some other error
+ */
+esp_err_t led_strip_rmt_encode_frame(led_strip_handle_t strip, rmt_symbol_word_t *symbols, size_t symbols_size, size_t *ret_symbols);
+
+#ifdef __cplusplus
+}
+#endif
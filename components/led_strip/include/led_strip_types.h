@@ -5,6 +5,7 @@
  */
 #pragma once
 
+#include <stdbool.h>
 #include <stdint.h>
 
 #ifdef __cplusplus
@@ -62,9 +63,48 @@ typedef struct {
     /*!< LED strip extra driver flags */
     struct led_strip_extra_flags {
         uint32_t invert_out: 1; /*!< Invert output signal */
+        uint32_t partial_refresh: 1; /*!< Refresh only the pixels up to the last changed one, and nothing if no pixel
+                                          changed; by default each refresh sends the whole strip */
     } flags; /*!< Extra driver flags */
 } led_strip_config_t;
 
+/**
+ * @brief Layout of the pixels passed to `led_strip_blit()`
+ */
+typedef enum {
+    LED_STRIP_PIXEL_FMT_RGB888,   /*!< 3 bytes per pixel: red, green, blue. The white component, if any, is set to 0 */
+    LED_STRIP_PIXEL_FMT_RGBW8888, /*!< 4 bytes per pixel: red, green, blue, white. Only for LEDs with a white component */
+    LED_STRIP_PIXEL_FMT_HSV,      /*!< One `led_strip_hsv_t` per pixel */
+} led_strip_pixel_format_t;
+
+/**
+ * @brief HSV color, as in `led_strip_set_pixel_hsv()`
+ */
+typedef struct {
+    uint16_t hue;       /*!< Hue: 0 - 360 */
+    uint8_t saturation; /*!< Saturation: 0 - 255 */
+    uint8_t value;      /*!< Value: 0 - 255 */
+} led_strip_hsv_t;
+
+/**
+ * @brief Type of LED strip refresh done callback
+ *
+ * @param strip LED strip handle
+ * @param user_ctx User context, passed from `led_strip_register_event_callbacks()`
+ * @return Whether a high priority task has been woken up by this function
+ *
+ * @note Called from the backend's ISR: keep it short, use only ISR-safe APIs, and place it in IRAM
+ *       if the RMT or SPI ISR is IRAM-safe (CONFIG_RMT_ISR_IRAM_SAFE, CONFIG_SPI_MASTER_ISR_IN_IRAM).
+ */
+typedef bool (*led_strip_refresh_done_cb_t)(led_strip_handle_t strip, void *user_ctx);
+
+/**
+ * @brief Group of supported LED strip event callbacks
+ */
+typedef struct {
+    led_strip_refresh_done_cb_t on_refresh_done; /*!< A frame has been shifted out to the LEDs */
+} led_strip_event_callbacks_t;
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,180 @@
+/*
+ * SPDX-FileCopyrightText: 2022 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#pragma once
+
+#include <stdint.h>
+#include "esp_err.h"
+#include "led_strip_types.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct led_strip_t led_strip_t; /*!< Type of LED strip */
+
+/**
+ * @brief LED strip interface definition
+ */
+struct led_strip_t {
+    /**
+     * @brief Set RGB for a specific pixel
+     *
+     * @param strip: LED strip
+     * @param index: index of pixel to set
+     * @param red: red part of color
+     * @param green: green part of color
+     * @param blue: blue part of color
+     *
+     * @return
+     *      - ESP_OK: Set RGB for a specific pixel successfully
+     *      - ESP_ERR_INVALID_ARG: Set RGB for a specific pixel failed because of invalid parameters
+     *      - ESP_FAIL: Set RGB for a specific pixel failed because other error occurred
+     */
+    esp_err_t (*set_pixel)(led_strip_t *strip, uint32_t index, uint32_t red, uint32_t green, uint32_t blue);
+
+    /**
+     * @brief Set RGBW for a specific pixel. Similar to `set_pixel` but also set the white component
+     *
+     * @param strip: LED strip
+     * @param index: index of pixel to set
+     * @param red: red part of color
+     * @param green: green part of color
+     * @param blue: blue part of color
+     * @param white: separate white component
+     *
+     * @return
+     *      - ESP_OK: Set RGBW color for a specific pixel successfully
+     *      - ESP_ERR_INVALID_ARG: Set RGBW color for a specific pixel failed because of an invalid argument
+     *      - ESP_FAIL: Set RGBW color for a specific pixel failed because other error occurred
+     */
+    esp_err_t (*set_pixel_rgbw)(led_strip_t *strip, uint32_t index, uint32_t red, uint32_t green, uint32_t blue, uint32_t white);
+
+    /**
+     * @brief Set consecutive pixels from a packed buffer, reordering the color components
+     *
+     * @param strip: LED strip
+     * @param index: index of the first pixel to set
+     * @param count: number of pixels to set
+     * @param pixels: `count` pixels in `format`
+     * @param format: layout of `pixels`
+     *
+     * @return
+     *      - ESP_OK: Set the pixels successfully
+     *      - ESP_ERR_INVALID_ARG: Set the pixels failed because of invalid parameters
+     */
+    esp_err_t (*blit)(led_strip_t *strip, uint32_t index, uint32_t count, const void *pixels, led_strip_pixel_format_t format);
+
+    /**
+     * @brief Set a color of the palette; NULL if the backend has no palette mode
+     *
+     * @param strip: LED strip
+     * @param palette_index: palette entry, 1 to the palette size - 1
+     * @param red: red part of color
+     * @param green: green part of color
+     * @param blue: blue part of color
+     * @param white: separate white component
+     *
+     * @return
+     *      - ESP_OK: Set the palette color successfully
+     *      - ESP_ERR_INVALID_ARG: Set the palette color failed because of invalid parameters
+     *      - ESP_ERR_INVALID_STATE: Set the palette color failed because the strip has no palette
+     */
+    esp_err_t (*set_palette_color)(led_strip_t *strip, uint32_t palette_index, uint32_t red, uint32_t green, uint32_t blue, uint32_t white);
+
+    /**
+     * @brief Set consecutive pixels to palette colors; NULL if the backend has no palette mode
+     *
+     * @param strip: LED strip
+     * @param index: index of the first pixel to set
+     * @param count: number of pixels to set
+     * @param palette_indices: `count` palette entries, one byte per pixel
+     *
+     * @return
+     *      - ESP_OK: Set the pixels successfully
+     *      - ESP_ERR_INVALID_ARG: Set the pixels failed because of invalid parameters
+     *      - ESP_ERR_INVALID_STATE: Set the pixels failed because the strip has no palette
+     */
+    esp_err_t (*set_pixel_indices)(led_strip_t *strip, uint32_t index, uint32_t count, const uint8_t *palette_indices);
+
+    /**
+     * @brief Refresh memory colors to LEDs
+     *
+     * @param strip: LED strip
+     * @param timeout_ms: timeout value for refreshing task
+     *
+     * @return
+     *      - ESP_OK: Refresh successfully
+     *      - ESP_FAIL: Refresh failed because some other error occurred
+     *
+     * @note:
+     *      After updating the LED colors in the memory, a following invocation of this API is needed to flush colors to strip.
+     */
+    esp_err_t (*refresh)(led_strip_t *strip);
+
+    /**
+     * @brief Start shifting memory colors out to LEDs from a second pixel buffer, without waiting for the end
+     *
+     * @param strip: LED strip
+     *
+     * @return
+     *      - ESP_OK: Refresh started successfully
+     *      - ESP_ERR_NO_MEM: Refresh failed because the second pixel buffer could not be allocated
+     *      - ESP_FAIL: Refresh failed because some other error occurred
+     */
+    esp_err_t (*refresh_async)(led_strip_t *strip);
+
+    /**
+     * @brief Wait for the frame in flight, if any, to be shifted out
+     *
+     * @param strip: LED strip
+     * @param timeout_ms: Wait timeout, in ms; -1 waits forever
+     *
+     * @return
+     *      - ESP_OK: No frame is in flight any more
+     *      - ESP_ERR_TIMEOUT: The frame is still being shifted out
+     *      - ESP_FAIL: Wait failed because some other error occurred
+     */
+    esp_err_t (*wait_refresh_done)(led_strip_t *strip, int32_t timeout_ms);
+
+    /**
+     * @brief Set the event callbacks
+     *
+     * @param strip: LED strip
+     * @param cbs: Group of callback functions
+     * @param user_ctx: User context, passed to the callbacks
+     *
+     * @return
+     *      - ESP_OK: Set the callbacks successfully
+     */
+    esp_err_t (*register_event_callbacks)(led_strip_t *strip, const led_strip_event_callbacks_t *cbs, void *user_ctx);
+
+    /**
+     * @brief Clear LED strip (turn off all LEDs)
+     *
+     * @param strip: LED strip
+     * @param timeout_ms: timeout value for clearing task
+     *
+     * @return
+     *      - ESP_OK: Clear LEDs successfully
+     *      - ESP_FAIL: Clear LEDs failed because some other error occurred
+     */
+    esp_err_t (*clear)(led_strip_t *strip);
+
+    /**
+     * @brief Free LED strip resources
+     *
+     * @param strip: LED strip
+     *
+     * @return
+     *      - ESP_OK: Free resources successfully
+     *      - ESP_FAIL: Free resources failed because error occurred
+     */
+    esp_err_t (*del)(led_strip_t *strip);
+};
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,97 @@
+/*
+ * SPDX-FileCopyrightText: 2022 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#include "esp_log.h"
+#include "esp_check.h"
+#include "led_strip.h"
+#include "led_strip_interface.h"
+#include "led_strip_common.h"
+
+static const char *TAG = "led_strip";
+
+esp_err_t led_strip_set_pixel(led_strip_handle_t strip, uint32_t index, uint32_t red, uint32_t green, uint32_t blue)
+{
+    ESP_RETURN_ON_FALSE(strip, ESP_ERR_INVALID_ARG, TAG, "invalid argument");
+    return strip->set_pixel(strip, index, red, green, blue);
+}
+
+esp_err_t led_strip_set_pixel_hsv(led_strip_handle_t strip, uint32_t index, uint16_t hue, uint8_t saturation, uint8_t value)
+{
+    ESP_RETURN_ON_FALSE(strip, ESP_ERR_INVALID_ARG, TAG, "invalid argument");
+
+    uint8_t red = 0;
+    uint8_t green = 0;
+    uint8_t blue = 0;
+    led_strip_hsv2rgb(hue, saturation, value, &red, &green, &blue);
+
+    return strip->set_pixel(strip, index, red, green, blue);
+}
+
+esp_err_t led_strip_set_pixel_rgbw(led_strip_handle_t strip, uint32_t index, uint32_t red, uint32_t green, uint32_t blue, uint32_t white)
+{
+    ESP_RETURN_ON_FALSE(strip, ESP_ERR_INVALID_ARG, TAG, "invalid argument");
+    return strip->set_pixel_rgbw(strip, index, red, green, blue, white);
+}
+
+esp_err_t led_strip_set_pixels(led_strip_handle_t strip, uint32_t index, uint32_t count, const uint8_t *rgb)
+{
+    return led_strip_blit(strip, index, count, rgb, LED_STRIP_PIXEL_FMT_RGB888);
+}
+
+esp_err_t led_strip_blit(led_strip_handle_t strip, uint32_t index, uint32_t count, const void *pixels, led_strip_pixel_format_t format)
+{
+    ESP_RETURN_ON_FALSE(strip && (pixels || !count), ESP_ERR_INVALID_ARG, TAG, "invalid argument");
+    return strip->blit(strip, index, count, pixels, format);
+}
+
+esp_err_t led_strip_set_palette_color(led_strip_handle_t strip, uint32_t palette_index, uint32_t red, uint32_t green, uint32_t blue, uint32_t white)
+{
+    ESP_RETURN_ON_FALSE(strip, ESP_ERR_INVALID_ARG, TAG, "invalid argument");
+    ESP_RETURN_ON_FALSE(strip->set_palette_color, ESP_ERR_NOT_SUPPORTED, TAG, "backend has no palette");
+    return strip->set_palette_color(strip, palette_index, red, green, blue, white);
+}
+
+esp_err_t led_strip_set_pixel_indices(led_strip_handle_t strip, uint32_t index, uint32_t count, const uint8_t *palette_indices)
+{
+    ESP_RETURN_ON_FALSE(strip && (palette_indices || !count), ESP_ERR_INVALID_ARG, TAG, "invalid argument");
+    ESP_RETURN_ON_FALSE(strip->set_pixel_indices, ESP_ERR_NOT_SUPPORTED, TAG, "backend has no palette");
+    return strip->set_pixel_indices(strip, index, count, palette_indices);
+}
+
+esp_err_t led_strip_refresh(led_strip_handle_t strip)
+{
+    ESP_RETURN_ON_FALSE(strip, ESP_ERR_INVALID_ARG, TAG, "invalid argument");
+    return strip->refresh(strip);
+}
+
+esp_err_t led_strip_refresh_async(led_strip_handle_t strip)
+{
+    ESP_RETURN_ON_FALSE(strip, ESP_ERR_INVALID_ARG, TAG, "invalid argument");
+    return strip->refresh_async(strip);
+}
+
+esp_err_t led_strip_refresh_wait_done(led_strip_handle_t strip, int32_t timeout_ms)
+{
+    ESP_RETURN_ON_FALSE(strip, ESP_ERR_INVALID_ARG, TAG, "invalid argument");
+    return strip->wait_refresh_done(strip, timeout_ms);
+}
+
+esp_err_t led_strip_register_event_callbacks(led_strip_handle_t strip, const led_strip_event_callbacks_t *cbs, void *user_ctx)
+{
+    ESP_RETURN_ON_FALSE(strip && cbs, ESP_ERR_INVALID_ARG, TAG, "invalid argument");
+    return strip->register_event_callbacks(strip, cbs, user_ctx);
+}
+
+esp_err_t led_strip_clear(led_strip_handle_t strip)
+{
+    ESP_RETURN_ON_FALSE(strip, ESP_ERR_INVALID_ARG, TAG, "invalid argument");
+    return strip->clear(strip);
+}
+
+esp_err_t led_strip_del(led_strip_handle_t strip)
+{
+    ESP_RETURN_ON_FALSE(strip, ESP_ERR_INVALID_ARG, TAG, "invalid argument");
+    return strip->del(strip);
+}
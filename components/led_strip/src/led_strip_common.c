@@ -0,0 +1,234 @@
+/*
+ * SPDX-FileCopyrightText: 2025 FloraLink contributors
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#include <string.h>
+#include "esp_check.h"
+#include "led_strip_common.h"
+
+static const char *TAG = "led_strip_common";
+
+static inline void led_strip_pixels_mark(led_strip_pixels_t *pixels, uint32_t start, uint32_t end)
+{
+    if (!led_strip_pixels_dirty(pixels)) {
+        pixels->dirty_start = start;
+        pixels->dirty_end = end;
+        return;
+    }
+    if (start < pixels->dirty_start) {
+        pixels->dirty_start = start;
+    }
+    if (end > pixels->dirty_end) {
+        pixels->dirty_end = end;
+    }
+}
+
+void led_strip_pixels_init(led_strip_pixels_t *pixels, uint8_t *buf, uint32_t len, led_color_component_format_t component_fmt, bool partial_refresh)
+{
+    pixels->buf = buf;
+    pixels->len = len;
+    pixels->bytes_per_pixel = component_fmt.format.num_components;
+    pixels->component_fmt = component_fmt;
+    pixels->dirty_start = 0;
+    pixels->dirty_end = len;
+    pixels->partial_refresh = partial_refresh;
+}
+
+void led_strip_pixels_init_indexed(led_strip_pixels_t *pixels, uint8_t *buf, uint32_t len, bool partial_refresh)
+{
+    pixels->buf = buf;
+    pixels->len = len;
+    pixels->bytes_per_pixel = 1;
+    pixels->component_fmt = (led_color_component_format_t) {};
+    pixels->dirty_start = 0;
+    pixels->dirty_end = len;
+    pixels->partial_refresh = partial_refresh;
+}
+
+esp_err_t led_strip_pixels_set_indices(led_strip_pixels_t *pixels, uint32_t index, uint32_t count, const uint8_t *indices)
+{
+    ESP_RETURN_ON_FALSE(index <= pixels->len && count <= pixels->len - index, ESP_ERR_INVALID_ARG, TAG, "pixels out of maximum number of LEDs");
+    uint8_t *pixel = pixels->buf + index;
+    uint32_t first = count;
+    uint32_t last = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        if (pixel[i] != indices[i]) {
+            pixel[i] = indices[i];
+            first = first == count ? i : first;
+            last = i;
+        }
+    }
+    if (first < count) {
+        led_strip_pixels_mark(pixels, index + first, index + last + 1);
+    }
+    return ESP_OK;
+}
+
+void led_strip_pixels_mark_index(led_strip_pixels_t *pixels, uint8_t palette_index)
+{
+    uint32_t first = pixels->len;
+    uint32_t last = 0;
+    for (uint32_t i = 0; i < pixels->len; i++) {
+        if (pixels->buf[i] == palette_index) {
+            first = first == pixels->len ? i : first;
+            last = i;
+        }
+    }
+    if (first < pixels->len) {
+        led_strip_pixels_mark(pixels, first, last + 1);
+    }
+}
+
+// Component positions of a pixel, hoisted out of the bit fields for the blit loops
+typedef struct {
+    uint32_t r_pos;
+    uint32_t g_pos;
+    uint32_t b_pos;
+    uint32_t w_pos;
+    bool with_white;
+} led_strip_layout_t;
+
+// Store one pixel, return whether it changed
+static inline bool led_strip_pixel_store(uint8_t *pixel, const led_strip_layout_t *layout, uint8_t red, uint8_t green, uint8_t blue, uint8_t white)
+{
+    uint8_t diff = (pixel[layout->r_pos] ^ red) | (pixel[layout->g_pos] ^ green) | (pixel[layout->b_pos] ^ blue);
+    pixel[layout->r_pos] = red;
+    pixel[layout->g_pos] = green;
+    pixel[layout->b_pos] = blue;
+    if (layout->with_white) {
+        diff |= pixel[layout->w_pos] ^ white;
+        pixel[layout->w_pos] = white;
+    }
+    return diff != 0;
+}
+
+void led_strip_pixels_set(led_strip_pixels_t *pixels, uint32_t index, uint8_t red, uint8_t green, uint8_t blue, uint8_t white)
+{
+    const led_strip_layout_t layout = {
+        .r_pos = pixels->component_fmt.format.r_pos,
+        .g_pos = pixels->component_fmt.format.g_pos,
+        .b_pos = pixels->component_fmt.format.b_pos,
+        .w_pos = pixels->component_fmt.format.w_pos,
+        .with_white = pixels->bytes_per_pixel > 3,
+    };
+    if (led_strip_pixel_store(pixels->buf + index * pixels->bytes_per_pixel, &layout, red, green, blue, white)) {
+        led_strip_pixels_mark(pixels, index, index + 1);
+    }
+}
+
+esp_err_t led_strip_pixels_blit(led_strip_pixels_t *pixels, uint32_t index, uint32_t count, const void *src, led_strip_pixel_format_t format)
+{
+    ESP_RETURN_ON_FALSE(index <= pixels->len && count <= pixels->len - index, ESP_ERR_INVALID_ARG, TAG, "pixels out of maximum number of LEDs");
+    const led_strip_layout_t layout = {
+        .r_pos = pixels->component_fmt.format.r_pos,
+        .g_pos = pixels->component_fmt.format.g_pos,
+        .b_pos = pixels->component_fmt.format.b_pos,
+        .w_pos = pixels->component_fmt.format.w_pos,
+        .with_white = pixels->bytes_per_pixel > 3,
+    };
+    ESP_RETURN_ON_FALSE(format != LED_STRIP_PIXEL_FMT_RGBW8888 || layout.with_white, ESP_ERR_INVALID_ARG, TAG, "led doesn't have 4 components");
+
+    const uint32_t step = pixels->bytes_per_pixel;
+    uint8_t *pixel = pixels->buf + index * step;
+    uint32_t first = count;
+    uint32_t last = 0;
+    bool changed;
+
+    // One loop per source format, so the loops carry no format test
+    switch (format) {
+    case LED_STRIP_PIXEL_FMT_RGB888: {
+        const uint8_t *rgb = (const uint8_t *)src;
+        for (uint32_t i = 0; i < count; i++, pixel += step, rgb += 3) {
+            changed = led_strip_pixel_store(pixel, &layout, rgb[0], rgb[1], rgb[2], 0);
+            if (changed) {
+                first = first == count ? i : first;
+                last = i;
+            }
+        }
+        break;
+    }
+    case LED_STRIP_PIXEL_FMT_RGBW8888: {
+        const uint8_t *rgbw = (const uint8_t *)src;
+        for (uint32_t i = 0; i < count; i++, pixel += step, rgbw += 4) {
+            changed = led_strip_pixel_store(pixel, &layout, rgbw[0], rgbw[1], rgbw[2], rgbw[3]);
+            if (changed) {
+                first = first == count ? i : first;
+                last = i;
+            }
+        }
+        break;
+    }
+    case LED_STRIP_PIXEL_FMT_HSV: {
+        const led_strip_hsv_t *hsv = (const led_strip_hsv_t *)src;
+        for (uint32_t i = 0; i < count; i++, pixel += step) {
+            uint8_t red, green, blue;
+            led_strip_hsv2rgb(hsv[i].hue, hsv[i].saturation, hsv[i].value, &red, &green, &blue);
+            changed = led_strip_pixel_store(pixel, &layout, red, green, blue, 0);
+            if (changed) {
+                first = first == count ? i : first;
+                last = i;
+            }
+        }
+        break;
+    }
+    default:
+        ESP_RETURN_ON_FALSE(false, ESP_ERR_INVALID_ARG, TAG, "invalid pixel format");
+    }
+    if (first < count) {
+        led_strip_pixels_mark(pixels, index + first, index + last + 1);
+    }
+    return ESP_OK;
+}
+
+void led_strip_pixels_clear(led_strip_pixels_t *pixels)
+{
+    memset(pixels->buf, 0, pixels->len * pixels->bytes_per_pixel);
+    pixels->dirty_start = 0;
+    pixels->dirty_end = pixels->len;
+}
+
+void led_strip_hsv2rgb(uint16_t hue, uint8_t saturation, uint8_t value, uint8_t *red, uint8_t *green, uint8_t *blue)
+{
+    uint32_t rgb_max = value;
+    uint32_t rgb_min = rgb_max * (255 - saturation) / 255.0f;
+
+    uint32_t i = hue / 60;
+    uint32_t diff = hue % 60;
+
+    // RGB adjustment amount by hue
+    uint32_t rgb_adj = (rgb_max - rgb_min) * diff / 60;
+
+    switch (i) {
+    case 0:
+        *red = rgb_max;
+        *green = rgb_min + rgb_adj;
+        *blue = rgb_min;
+        break;
+    case 1:
+        *red = rgb_max - rgb_adj;
+        *green = rgb_max;
+        *blue = rgb_min;
+        break;
+    case 2:
+        *red = rgb_min;
+        *green = rgb_max;
+        *blue = rgb_min + rgb_adj;
+        break;
+    case 3:
+        *red = rgb_min;
+        *green = rgb_max - rgb_adj;
+        *blue = rgb_max;
+        break;
+    case 4:
+        *red = rgb_min + rgb_adj;
+        *green = rgb_min;
+        *blue = rgb_max;
+        break;
+    default:
+        *red = rgb_max;
+        *green = rgb_min;
+        *blue = rgb_max - rgb_adj;
+        break;
+    }
+}
@@ -0,0 +1,107 @@
+/*
+ * SPDX-FileCopyrightText: 2025 FloraLink contributors
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "led_strip_types.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Pixel buffer of a backend, with the range of pixels changed since the last refresh
+ *
+ * Without `partial_refresh`, the whole buffer stays marked changed, so each refresh sends the whole strip.
+ */
+typedef struct {
+    uint8_t *buf;                               /*!< Color bytes, in the order they are sent */
+    uint32_t len;                               /*!< Number of pixels */
+    uint8_t bytes_per_pixel;                    /*!< Number of color components: 3 or 4 */
+    led_color_component_format_t component_fmt; /*!< Position of each color component in a pixel */
+    uint32_t dirty_start;                       /*!< First pixel changed since the last refresh */
+    uint32_t dirty_end;                         /*!< One past the last changed pixel, equal to `dirty_start` if none */
+    bool partial_refresh;                       /*!< Send only the pixels up to the last changed one, see `led_strip_config_t` */
+} led_strip_pixels_t;
+
+/**
+ * @brief Set up a pixel buffer; all of it is marked changed, so the first refresh sends the whole strip
+ */
+void led_strip_pixels_init(led_strip_pixels_t *pixels, uint8_t *buf, uint32_t len, led_color_component_format_t component_fmt, bool partial_refresh);
+
+/**
+ * @brief Set up a buffer of palette indices, one byte per pixel; all of it is marked changed
+ */
+void led_strip_pixels_init_indexed(led_strip_pixels_t *pixels, uint8_t *buf, uint32_t len, bool partial_refresh);
+
+/**
+ * @brief Set `count` palette indices from pixel `index` on, in a buffer set up by `led_strip_pixels_init_indexed()`
+ *
+ * @return
+ *      - ESP_OK: Pixels set
+ *      - ESP_ERR_INVALID_ARG: The range is out of the strip
+ */
+esp_err_t led_strip_pixels_set_indices(led_strip_pixels_t *pixels, uint32_t index, uint32_t count, const uint8_t *indices);
+
+/**
+ * @brief Mark the pixels showing palette entry `palette_index` as changed, after a change of that entry
+ */
+void led_strip_pixels_mark_index(led_strip_pixels_t *pixels, uint8_t palette_index);
+
+/**
+ * @brief Set one pixel, already validated; `white` is ignored without a white component
+ */
+void led_strip_pixels_set(led_strip_pixels_t *pixels, uint32_t index, uint8_t red, uint8_t green, uint8_t blue, uint8_t white);
+
+/**
+ * @brief Set `count` pixels from `index` on, reordering the color components of `src`
+ *
+ * @return
+ *      - ESP_OK: Pixels set
+ *      - ESP_ERR_INVALID_ARG: The range is out of the strip, or `format` has a white component the strip does not have
+ */
+esp_err_t led_strip_pixels_blit(led_strip_pixels_t *pixels, uint32_t index, uint32_t count, const void *src, led_strip_pixel_format_t format);
+
+/**
+ * @brief Turn all pixels off, and mark all of them changed
+ */
+void led_strip_pixels_clear(led_strip_pixels_t *pixels);
+
+/**
+ * @brief Whether any pixel changed since the last refresh
+ */
+static inline bool led_strip_pixels_dirty(const led_strip_pixels_t *pixels)
+{
+    return pixels->dirty_start != pixels->dirty_end;
+}
+
+/**
+ * @brief Size of the frame to send: the pixels up to the last changed one, the LEDs after it keep their colors
+ */
+static inline size_t led_strip_pixels_frame_size(const led_strip_pixels_t *pixels)
+{
+    return pixels->dirty_end * pixels->bytes_per_pixel;
+}
+
+/**
+ * @brief Forget the changes, once the frame is on its way; without partial refresh, all pixels stay changed
+ */
+static inline void led_strip_pixels_sent(led_strip_pixels_t *pixels)
+{
+    pixels->dirty_start = 0;
+    pixels->dirty_end = pixels->partial_refresh ? 0 : pixels->len;
+}
+
+/**
+ * @brief Convert a HSV color (hue 0 - 360, saturation and value 0 - 255) to RGB
+ */
+void led_strip_hsv2rgb(uint16_t hue, uint8_t saturation, uint8_t value, uint8_t *red, uint8_t *green, uint8_t *blue);
+
+#ifdef __cplusplus
+}
+#endif
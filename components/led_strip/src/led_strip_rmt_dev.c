@@ -0,0 +1,432 @@
+/*
+ * SPDX-FileCopyrightText: 2022-2024 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <sys/cdefs.h>
+#include "esp_log.h"
+#include "esp_check.h"
+#include "esp_attr.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/timers.h"
+#include "driver/rmt_tx.h"
+#include "led_strip.h"
+#include "led_strip_interface.h"
+#include "led_strip_rmt_encoder.h"
+#include "led_strip_common.h"
+
+#define LED_STRIP_RMT_DEFAULT_RESOLUTION 10000000 // 10MHz resolution
+#define LED_STRIP_RMT_DEFAULT_TRANS_QUEUE_SIZE 4
+// the memory size of each RMT channel, in words (4 bytes)
+#if CONFIG_IDF_TARGET_ESP32 || CONFIG_IDF_TARGET_ESP32S2
+#define LED_STRIP_RMT_DEFAULT_MEM_BLOCK_SYMBOLS 64
+#else
+#define LED_STRIP_RMT_DEFAULT_MEM_BLOCK_SYMBOLS 48
+#endif
+
+static const char *TAG = "led_strip_rmt";
+
+typedef struct {
+    led_strip_t base;
+    rmt_channel_handle_t rmt_chan;
+    rmt_encoder_handle_t strip_encoder;
+    led_strip_refresh_done_cb_t on_refresh_done;
+    void *user_ctx;
+    bool enabled;     // The channel (and its PM lock) stays enabled from a frame start until it is released
+    SemaphoreHandle_t lock;         // Serializes enabling and disabling the channel with the deferred release
+    volatile bool release_on_done;  // The frame in flight is asynchronous: release the channel when it is out
+    volatile bool release_pending;  // A release is queued to the timer service task and has not started yet
+    uint32_t releases_queued;       // Releases queued since the strip was created, each gives `released` once
+    uint32_t release_failures;      // Releases that could not be queued, logged by the next frame start
+    SemaphoreHandle_t released;     // Counts the releases that have finished
+    uint8_t *tx_buf;  // Second pixel buffer, transmitted by the asynchronous refresh; allocated on first use
+    led_color_component_format_t component_fmt;
+    uint8_t bytes_per_pixel;    // Color bytes per pixel, sent for each pixel
+    uint8_t *palette;           // Palette colors, in the order they are sent, after the pixels; NULL if the pixels hold colors
+    uint32_t palette_size;
+    led_strip_pixels_t pixels;  // Colors, or palette indices with a palette
+    uint8_t pixel_buf[];
+} led_strip_rmt_obj;
+
+// Lay a color out in the order it is sent
+static void led_strip_rmt_pack_color(const led_strip_rmt_obj *rmt_strip, uint8_t *color, uint32_t red, uint32_t green, uint32_t blue, uint32_t white)
+{
+    led_color_component_format_t component_fmt = rmt_strip->component_fmt;
+    color[component_fmt.format.r_pos] = red & 0xFF;
+    color[component_fmt.format.g_pos] = green & 0xFF;
+    color[component_fmt.format.b_pos] = blue & 0xFF;
+    if (component_fmt.format.num_components > 3) {
+        color[component_fmt.format.w_pos] = white & 0xFF;
+    }
+}
+
+// With a palette: point the pixel to the palette entry of this color
+static esp_err_t led_strip_rmt_set_pixel_color(led_strip_rmt_obj *rmt_strip, uint32_t index, uint32_t red, uint32_t green, uint32_t blue, uint32_t white)
+{
+    uint8_t color[4] = {0};
+    led_strip_rmt_pack_color(rmt_strip, color, red, green, blue, white);
+    const uint8_t *entry = rmt_strip->palette;
+    for (uint32_t i = 0; i < rmt_strip->palette_size; i++, entry += rmt_strip->bytes_per_pixel) {
+        if (memcmp(entry, color, rmt_strip->bytes_per_pixel) == 0) {
+            uint8_t palette_index = i;
+            return led_strip_pixels_set_indices(&rmt_strip->pixels, index, 1, &palette_index);
+        }
+    }
+    ESP_LOGE(TAG, "color not in the palette");
+    return ESP_ERR_NOT_FOUND;
+}
+
+static esp_err_t led_strip_rmt_set_pixel(led_strip_t *strip, uint32_t index, uint32_t red, uint32_t green, uint32_t blue)
+{
+    led_strip_rmt_obj *rmt_strip = __containerof(strip, led_strip_rmt_obj, base);
+    ESP_RETURN_ON_FALSE(index < rmt_strip->pixels.len, ESP_ERR_INVALID_ARG, TAG, "index out of maximum number of LEDs");
+
+    if (rmt_strip->palette) {
+        return led_strip_rmt_set_pixel_color(rmt_strip, index, red, green, blue, 0);
+    }
+    led_strip_pixels_set(&rmt_strip->pixels, index, red & 0xFF, green & 0xFF, blue & 0xFF, 0);
+    return ESP_OK;
+}
+
+static esp_err_t led_strip_rmt_set_pixel_rgbw(led_strip_t *strip, uint32_t index, uint32_t red, uint32_t green, uint32_t blue, uint32_t white)
+{
+    led_strip_rmt_obj *rmt_strip = __containerof(strip, led_strip_rmt_obj, base);
+    ESP_RETURN_ON_FALSE(index < rmt_strip->pixels.len, ESP_ERR_INVALID_ARG, TAG, "index out of maximum number of LEDs");
+    ESP_RETURN_ON_FALSE(rmt_strip->bytes_per_pixel == 4, ESP_ERR_INVALID_ARG, TAG, "led doesn't have 4 components");
+
+    if (rmt_strip->palette) {
+        return led_strip_rmt_set_pixel_color(rmt_strip, index, red, green, blue, white);
+    }
+    led_strip_pixels_set(&rmt_strip->pixels, index, red & 0xFF, green & 0xFF, blue & 0xFF, white & 0xFF);
+    return ESP_OK;
+}
+
+static esp_err_t led_strip_rmt_blit(led_strip_t *strip, uint32_t index, uint32_t count, const void *pixels, led_strip_pixel_format_t format)
+{
+    led_strip_rmt_obj *rmt_strip = __containerof(strip, led_strip_rmt_obj, base);
+    ESP_RETURN_ON_FALSE(!rmt_strip->palette, ESP_ERR_NOT_SUPPORTED, TAG, "strip with a palette, set palette indices");
+    return led_strip_pixels_blit(&rmt_strip->pixels, index, count, pixels, format);
+}
+
+static esp_err_t led_strip_rmt_set_palette_color(led_strip_t *strip, uint32_t palette_index, uint32_t red, uint32_t green, uint32_t blue, uint32_t white)
+{
+    led_strip_rmt_obj *rmt_strip = __containerof(strip, led_strip_rmt_obj, base);
+    ESP_RETURN_ON_FALSE(rmt_strip->palette, ESP_ERR_INVALID_STATE, TAG, "strip without a palette");
+    // Entry 0 stays black for led_strip_clear()
+    ESP_RETURN_ON_FALSE(palette_index > 0 && palette_index < rmt_strip->palette_size, ESP_ERR_INVALID_ARG, TAG, "invalid palette index");
+
+    uint8_t color[4] = {0};
+    uint8_t *entry = rmt_strip->palette + palette_index * rmt_strip->bytes_per_pixel;
+    led_strip_rmt_pack_color(rmt_strip, color, red, green, blue, white);
+    if (memcmp(entry, color, rmt_strip->bytes_per_pixel) != 0) {
+        // An asynchronous frame in flight reads its own copy of the palette
+        memcpy(entry, color, rmt_strip->bytes_per_pixel);
+        led_strip_pixels_mark_index(&rmt_strip->pixels, palette_index);
+    }
+    return ESP_OK;
+}
+
+static esp_err_t led_strip_rmt_set_pixel_indices(led_strip_t *strip, uint32_t index, uint32_t count, const uint8_t *palette_indices)
+{
+    led_strip_rmt_obj *rmt_strip = __containerof(strip, led_strip_rmt_obj, base);
+    ESP_RETURN_ON_FALSE(rmt_strip->palette, ESP_ERR_INVALID_STATE, TAG, "strip without a palette");
+    for (uint32_t i = 0; i < count; i++) {
+        ESP_RETURN_ON_FALSE(palette_indices[i] < rmt_strip->palette_size, ESP_ERR_INVALID_ARG, TAG, "invalid palette index");
+    }
+    return led_strip_pixels_set_indices(&rmt_strip->pixels, index, count, palette_indices);
+}
+
+// Deferred from the trans-done ISR: disable the channel, releasing its PM lock, if no frame is in flight
+static void led_strip_rmt_release(void *arg, uint32_t unused)
+{
+    led_strip_rmt_obj *rmt_strip = (led_strip_rmt_obj *)arg;
+    // Cleared first, so that a frame finishing from here on queues another release
+    rmt_strip->release_pending = false;
+    // The timer service task must not block: a caller holding the lock is starting a frame, which
+    // queues its own release, or waiting for one, which disables the channel itself
+    if (xSemaphoreTake(rmt_strip->lock, 0) == pdTRUE) {
+        if (rmt_strip->enabled && rmt_tx_wait_all_done(rmt_strip->rmt_chan, 0) == ESP_OK) {
+            if (rmt_disable(rmt_strip->rmt_chan) == ESP_OK) {
+                rmt_strip->enabled = false;
+            } else {
+                ESP_LOGW(TAG, "disable RMT channel failed");
+            }
+        }
+        xSemaphoreGive(rmt_strip->lock);
+    }
+    // Last access to the strip, which may be deleted from here on
+    xSemaphoreGive(rmt_strip->released);
+}
+
+static bool IRAM_ATTR led_strip_rmt_trans_done(rmt_channel_handle_t chan, const rmt_tx_done_event_data_t *edata, void *user_ctx)
+{
+    led_strip_rmt_obj *rmt_strip = (led_strip_rmt_obj *)user_ctx;
+    led_strip_refresh_done_cb_t cb = rmt_strip->on_refresh_done;
+    BaseType_t task_woken = pdFALSE;
+    // rmt_disable() may block, so it cannot be called from here
+    if (rmt_strip->release_on_done && !rmt_strip->release_pending) {
+        if (xTimerPendFunctionCallFromISR(led_strip_rmt_release, rmt_strip, 0, &task_woken) == pdPASS) {
+            rmt_strip->release_pending = true;
+            rmt_strip->releases_queued++;
+        } else {
+            // Timer command queue full: the channel stays enabled until the next frame or wait
+            rmt_strip->release_failures++;
+        }
+    }
+    bool need_yield = cb ? cb(&rmt_strip->base, rmt_strip->user_ctx) : false;
+    return need_yield || task_woken == pdTRUE;
+}
+
+// Start shifting out the first `size` bytes of a frame (palette indices with `palette`), once the previous frame is out;
+// with `release`, the channel is released when the frame is out, else by the next wait for it
+static esp_err_t led_strip_rmt_transmit(led_strip_rmt_obj *rmt_strip, const uint8_t *pixels, size_t size, const uint8_t *palette, bool release)
+{
+    esp_err_t ret = ESP_OK;
+    rmt_transmit_config_t tx_conf = {
+        .loop_count = 0,
+    };
+
+    ESP_RETURN_ON_ERROR(rmt_tx_wait_all_done(rmt_strip->rmt_chan, -1), TAG, "flush RMT channel failed");
+    xSemaphoreTake(rmt_strip->lock, portMAX_DELAY);
+    if (rmt_strip->release_failures) {
+        // No frame in flight, the ISR does not update it meanwhile
+        ESP_LOGW(TAG, "%"PRIu32" channel releases could not be queued to the timer service task", rmt_strip->release_failures);
+        rmt_strip->release_failures = 0;
+    }
+    if (!rmt_strip->enabled) {
+        ESP_GOTO_ON_ERROR(rmt_enable(rmt_strip->rmt_chan), out, TAG, "enable RMT channel failed");
+        rmt_strip->enabled = true;
+    }
+    if (palette) {
+        ESP_GOTO_ON_ERROR(rmt_led_strip_encoder_set_palette(rmt_strip->strip_encoder, palette, rmt_strip->bytes_per_pixel), out, TAG, "set palette failed");
+    }
+    rmt_strip->release_on_done = release;
+    ESP_GOTO_ON_ERROR(rmt_transmit(rmt_strip->rmt_chan, rmt_strip->strip_encoder, pixels, size, &tx_conf), out, TAG, "transmit pixels by RMT failed");
+    led_strip_pixels_sent(&rmt_strip->pixels);
+out:
+    xSemaphoreGive(rmt_strip->lock);
+    return ret;
+}
+
+static esp_err_t led_strip_rmt_wait_refresh_done(led_strip_t *strip, int32_t timeout_ms)
+{
+    led_strip_rmt_obj *rmt_strip = __containerof(strip, led_strip_rmt_obj, base);
+    esp_err_t ret = rmt_tx_wait_all_done(rmt_strip->rmt_chan, timeout_ms);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    xSemaphoreTake(rmt_strip->lock, portMAX_DELAY);
+    if (rmt_strip->enabled) {
+        ret = rmt_disable(rmt_strip->rmt_chan);
+        rmt_strip->enabled = ret != ESP_OK;
+    }
+    xSemaphoreGive(rmt_strip->lock);
+    ESP_RETURN_ON_ERROR(ret, TAG, "disable RMT channel failed");
+    return ESP_OK;
+}
+
+static esp_err_t led_strip_rmt_refresh(led_strip_t *strip)
+{
+    led_strip_rmt_obj *rmt_strip = __containerof(strip, led_strip_rmt_obj, base);
+    if (led_strip_pixels_dirty(&rmt_strip->pixels)) {
+        size_t frame_size = led_strip_pixels_frame_size(&rmt_strip->pixels);
+        ESP_RETURN_ON_ERROR(led_strip_rmt_transmit(rmt_strip, rmt_strip->pixel_buf, frame_size, rmt_strip->palette, false), TAG, "start refresh failed");
+    }
+    return led_strip_rmt_wait_refresh_done(strip, -1);
+}
+
+static esp_err_t led_strip_rmt_refresh_async(led_strip_t *strip)
+{
+    led_strip_rmt_obj *rmt_strip = __containerof(strip, led_strip_rmt_obj, base);
+    if (!led_strip_pixels_dirty(&rmt_strip->pixels)) {
+        return ESP_OK;
+    }
+    size_t frame_size = led_strip_pixels_frame_size(&rmt_strip->pixels);
+    size_t pixels_size = rmt_strip->pixels.len * rmt_strip->pixels.bytes_per_pixel;
+    size_t palette_size = rmt_strip->palette_size * rmt_strip->bytes_per_pixel;
+    if (!rmt_strip->tx_buf) {
+        // The palette is copied too, after the pixels, so that it can be changed during the transmission
+        rmt_strip->tx_buf = malloc(pixels_size + palette_size);
+        ESP_RETURN_ON_FALSE(rmt_strip->tx_buf, ESP_ERR_NO_MEM, TAG, "no mem for second pixel buffer");
+    }
+    // The second buffer may still be shifted out
+    ESP_RETURN_ON_ERROR(rmt_tx_wait_all_done(rmt_strip->rmt_chan, -1), TAG, "flush RMT channel failed");
+    memcpy(rmt_strip->tx_buf, rmt_strip->pixel_buf, frame_size);
+    uint8_t *tx_palette = NULL;
+    if (rmt_strip->palette) {
+        tx_palette = rmt_strip->tx_buf + pixels_size;
+        memcpy(tx_palette, rmt_strip->palette, palette_size);
+    }
+    return led_strip_rmt_transmit(rmt_strip, rmt_strip->tx_buf, frame_size, tx_palette, true);
+}
+
+static esp_err_t led_strip_rmt_register_event_callbacks(led_strip_t *strip, const led_strip_event_callbacks_t *cbs, void *user_ctx)
+{
+    led_strip_rmt_obj *rmt_strip = __containerof(strip, led_strip_rmt_obj, base);
+    rmt_strip->user_ctx = user_ctx;
+    rmt_strip->on_refresh_done = cbs->on_refresh_done;
+    return ESP_OK;
+}
+
+static esp_err_t led_strip_rmt_clear(led_strip_t *strip)
+{
+    led_strip_rmt_obj *rmt_strip = __containerof(strip, led_strip_rmt_obj, base);
+    // Write zero to turn off all leds, and send the whole strip
+    led_strip_pixels_clear(&rmt_strip->pixels);
+    return led_strip_rmt_refresh(strip);
+}
+
+static esp_err_t led_strip_rmt_del(led_strip_t *strip)
+{
+    led_strip_rmt_obj *rmt_strip = __containerof(strip, led_strip_rmt_obj, base);
+    ESP_RETURN_ON_ERROR(led_strip_rmt_wait_refresh_done(strip, -1), TAG, "flush RMT channel failed");
+    // No frame in flight, so no more releases are queued: wait for those that refer to the strip
+    for (; rmt_strip->releases_queued; rmt_strip->releases_queued--) {
+        xSemaphoreTake(rmt_strip->released, portMAX_DELAY);
+    }
+    ESP_RETURN_ON_ERROR(rmt_del_channel(rmt_strip->rmt_chan), TAG, "delete RMT channel failed");
+    ESP_RETURN_ON_ERROR(rmt_del_encoder(rmt_strip->strip_encoder), TAG, "delete strip encoder failed");
+    vSemaphoreDelete(rmt_strip->lock);
+    vSemaphoreDelete(rmt_strip->released);
+    free(rmt_strip->tx_buf);
+    free(rmt_strip);
+    return ESP_OK;
+}
+
+esp_err_t led_strip_rmt_encode_frame(led_strip_handle_t strip, rmt_symbol_word_t *symbols, size_t symbols_size, size_t *ret_symbols)
+{
+    ESP_RETURN_ON_FALSE(strip && symbols && symbols_size >= 8 && ret_symbols, ESP_ERR_INVALID_ARG, TAG, "invalid argument");
+    ESP_RETURN_ON_FALSE(strip->del == led_strip_rmt_del, ESP_ERR_INVALID_ARG, TAG, "not an RMT strip");
+    led_strip_rmt_obj *rmt_strip = __containerof(strip, led_strip_rmt_obj, base);
+    // The encoder may still be expanding the palette copy of an asynchronous frame
+    ESP_RETURN_ON_ERROR(rmt_tx_wait_all_done(rmt_strip->rmt_chan, -1), TAG, "flush RMT channel failed");
+    if (rmt_strip->palette) {
+        ESP_RETURN_ON_ERROR(rmt_led_strip_encoder_set_palette(rmt_strip->strip_encoder, rmt_strip->palette, rmt_strip->bytes_per_pixel), TAG, "set palette failed");
+    }
+    size_t frame_size = rmt_strip->pixels.len * rmt_strip->pixels.bytes_per_pixel;
+    size_t symbols_written = 0;
+    bool done = false;
+    while (!done) {
+        size_t written = 0;
+        ESP_RETURN_ON_ERROR(rmt_led_strip_encoder_encode_symbols(rmt_strip->strip_encoder, rmt_strip->pixel_buf, frame_size, symbols_written,
+                                                                 symbols_size, symbols, &written, &done), TAG, "encode pixels failed");
+        symbols_written += written;
+    }
+    *ret_symbols = symbols_written;
+    return ESP_OK;
+}
+
+esp_err_t led_strip_new_rmt_device(const led_strip_config_t *led_config, const led_strip_rmt_config_t *rmt_config, led_strip_handle_t *ret_strip)
+{
+    led_strip_rmt_obj *rmt_strip = NULL;
+    esp_err_t ret = ESP_OK;
+    ESP_GOTO_ON_FALSE(led_config && rmt_config && ret_strip, ESP_ERR_INVALID_ARG, err, TAG, "invalid argument");
+    led_color_component_format_t component_fmt = led_config->color_component_format;
+    // If R/G/B order is not specified, set default GRB order as fallback
+    if (component_fmt.format_id == 0) {
+        component_fmt = LED_STRIP_COLOR_COMPONENT_FMT_GRB;
+    }
+    // check the validation of the color component format
+    uint8_t mask = 0;
+    if (component_fmt.format.num_components == 3) {
+        mask = BIT(component_fmt.format.r_pos) | BIT(component_fmt.format.g_pos) | BIT(component_fmt.format.b_pos);
+        // Check for invalid values
+        ESP_RETURN_ON_FALSE(mask == 0x07, ESP_ERR_INVALID_ARG, TAG, "invalid order argument");
+    } else if (component_fmt.format.num_components == 4) {
+        mask = BIT(component_fmt.format.r_pos) | BIT(component_fmt.format.g_pos) | BIT(component_fmt.format.b_pos) | BIT(component_fmt.format.w_pos);
+        // Check for invalid values
+        ESP_RETURN_ON_FALSE(mask == 0x0F, ESP_ERR_INVALID_ARG, TAG, "invalid order argument");
+    } else {
+        ESP_RETURN_ON_FALSE(false, ESP_ERR_INVALID_ARG, TAG, "invalid number of color components: %d", component_fmt.format.num_components);
+    }
+    // TODO: we assume each color component is 8 bits, may need to support other configurations in the future, e.g. 10bits per color component?
+    uint8_t bytes_per_pixel = component_fmt.format.num_components;
+    uint32_t palette_size = rmt_config->palette_size;
+    ESP_RETURN_ON_FALSE(palette_size == 0 || (palette_size >= 2 && palette_size <= 256), ESP_ERR_INVALID_ARG, TAG, "invalid palette size");
+    // With a palette, one index byte per pixel, then the palette colors
+    size_t pixels_size = palette_size ? led_config->max_leds : led_config->max_leds * bytes_per_pixel;
+    rmt_strip = calloc(1, sizeof(led_strip_rmt_obj) + pixels_size + palette_size * bytes_per_pixel);
+    ESP_GOTO_ON_FALSE(rmt_strip, ESP_ERR_NO_MEM, err, TAG, "no mem for rmt strip");
+    rmt_strip->lock = xSemaphoreCreateMutex();
+    ESP_GOTO_ON_FALSE(rmt_strip->lock, ESP_ERR_NO_MEM, err, TAG, "no mem for rmt strip lock");
+    rmt_strip->released = xSemaphoreCreateCounting(UINT32_MAX, 0);
+    ESP_GOTO_ON_FALSE(rmt_strip->released, ESP_ERR_NO_MEM, err, TAG, "no mem for rmt strip semaphore");
+    uint32_t resolution = rmt_config->resolution_hz ? rmt_config->resolution_hz : LED_STRIP_RMT_DEFAULT_RESOLUTION;
+
+    // for backward compatibility, if the user does not set the clk_src, use the default value
+    rmt_clock_source_t clk_src = RMT_CLK_SRC_DEFAULT;
+    if (rmt_config->clk_src) {
+        clk_src = rmt_config->clk_src;
+    }
+    size_t mem_block_symbols = LED_STRIP_RMT_DEFAULT_MEM_BLOCK_SYMBOLS;
+    // override the default value if the user sets it
+    if (rmt_config->mem_block_symbols) {
+        mem_block_symbols = rmt_config->mem_block_symbols;
+    }
+    rmt_tx_channel_config_t rmt_chan_config = {
+        .clk_src = clk_src,
+        .gpio_num = led_config->strip_gpio_num,
+        .mem_block_symbols = mem_block_symbols,
+        .resolution_hz = resolution,
+        .trans_queue_depth = LED_STRIP_RMT_DEFAULT_TRANS_QUEUE_SIZE,
+        .flags.with_dma = rmt_config->flags.with_dma,
+        .flags.invert_out = led_config->flags.invert_out,
+    };
+    ESP_GOTO_ON_ERROR(rmt_new_tx_channel(&rmt_chan_config, &rmt_strip->rmt_chan), err, TAG, "create RMT TX channel failed");
+    rmt_tx_event_callbacks_t rmt_cbs = {
+        .on_trans_done = led_strip_rmt_trans_done,
+    };
+    ESP_GOTO_ON_ERROR(rmt_tx_register_event_callbacks(rmt_strip->rmt_chan, &rmt_cbs, rmt_strip), err, TAG, "register RMT callbacks failed");
+
+    led_strip_encoder_config_t strip_encoder_conf = {
+        .resolution = resolution,
+        .led_model = led_config->led_model
+    };
+    ESP_GOTO_ON_ERROR(rmt_new_led_strip_encoder(&strip_encoder_conf, &rmt_strip->strip_encoder), err, TAG, "create LED strip encoder failed");
+
+    rmt_strip->component_fmt = component_fmt;
+    rmt_strip->bytes_per_pixel = bytes_per_pixel;
+    if (palette_size) {
+        rmt_strip->palette = rmt_strip->pixel_buf + pixels_size;
+        rmt_strip->palette_size = palette_size;
+        ESP_GOTO_ON_ERROR(rmt_led_strip_encoder_set_palette(rmt_strip->strip_encoder, rmt_strip->palette, bytes_per_pixel), err, TAG, "palette not supported");
+        led_strip_pixels_init_indexed(&rmt_strip->pixels, rmt_strip->pixel_buf, led_config->max_leds, led_config->flags.partial_refresh);
+    } else {
+        led_strip_pixels_init(&rmt_strip->pixels, rmt_strip->pixel_buf, led_config->max_leds, component_fmt, led_config->flags.partial_refresh);
+    }
+    rmt_strip->base.set_pixel = led_strip_rmt_set_pixel;
+    rmt_strip->base.set_pixel_rgbw = led_strip_rmt_set_pixel_rgbw;
+    rmt_strip->base.blit = led_strip_rmt_blit;
+    rmt_strip->base.set_palette_color = led_strip_rmt_set_palette_color;
+    rmt_strip->base.set_pixel_indices = led_strip_rmt_set_pixel_indices;
+    rmt_strip->base.refresh = led_strip_rmt_refresh;
+    rmt_strip->base.refresh_async = led_strip_rmt_refresh_async;
+    rmt_strip->base.wait_refresh_done = led_strip_rmt_wait_refresh_done;
+    rmt_strip->base.register_event_callbacks = led_strip_rmt_register_event_callbacks;
+    rmt_strip->base.clear = led_strip_rmt_clear;
+    rmt_strip->base.del = led_strip_rmt_del;
+
+    *ret_strip = &rmt_strip->base;
+    return ESP_OK;
+err:
+    if (rmt_strip) {
+        if (rmt_strip->rmt_chan) {
+            rmt_del_channel(rmt_strip->rmt_chan);
+        }
+        if (rmt_strip->strip_encoder) {
+            rmt_del_encoder(rmt_strip->strip_encoder);
+        }
+        if (rmt_strip->lock) {
+            vSemaphoreDelete(rmt_strip->lock);
+        }
+        if (rmt_strip->released) {
+            vSemaphoreDelete(rmt_strip->released);
+        }
+        free(rmt_strip);
+    }
+    return ret;
+}
@@ -4,22 +4,85 @@
  * SPDX-License-Identifier: Apache-2.0
  */
 
+#include <string.h>
 #include "esp_check.h"
+#include "esp_attr.h"
+#include "esp_idf_version.h"
 #include "led_strip_rmt_encoder.h"
 
+// rmt_new_simple_encoder() is available from ESP-IDF v5.3
+#define LED_STRIP_RMT_SYMBOL_TABLE (ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(5, 3, 0))
+#define LED_STRIP_RMT_SYMBOLS_PER_BYTE 8
+
 static const char *TAG = "led_rmt_encoder";
 
 typedef struct {
     rmt_encoder_t base;
     rmt_encoder_t *bytes_encoder;
     rmt_encoder_t *copy_encoder;
+    rmt_encoder_t *table_encoder;
     int state;
     rmt_symbol_word_t reset_code;
+    const uint8_t *palette;     // Palette colors, the data is then one index per pixel; NULL if the data is color bytes
+    uint32_t bytes_per_pixel;   // Color bytes per palette entry
+    // The symbols of each nibble, MSB first: a color byte is two 16-byte copies (a byte table would take 8 KB)
+    rmt_symbol_word_t nibble_symbols[16][LED_STRIP_RMT_SYMBOLS_PER_BYTE / 2];
 } rmt_led_strip_encoder_t;
 
+#if LED_STRIP_RMT_SYMBOL_TABLE
+FORCE_INLINE_ATTR void rmt_led_strip_put_byte(const rmt_led_strip_encoder_t *led_encoder, rmt_symbol_word_t *out, uint8_t color)
+{
+    memcpy(out, led_encoder->nibble_symbols[color >> 4], sizeof(led_encoder->nibble_symbols[0]));
+    memcpy(out + LED_STRIP_RMT_SYMBOLS_PER_BYTE / 2, led_encoder->nibble_symbols[color & 0x0F], sizeof(led_encoder->nibble_symbols[0]));
+}
+
+// Called by the simple encoder, from the RMT ISR on each refill: whole color bytes while they fit, then the reset code
+static size_t IRAM_ATTR rmt_encode_led_strip_symbols(const void *data, size_t data_size, size_t symbols_written, size_t symbols_free,
+                                                     rmt_symbol_word_t *symbols, bool *done, void *arg)
+{
+    rmt_led_strip_encoder_t *led_encoder = (rmt_led_strip_encoder_t *)arg;
+    const uint8_t *palette = led_encoder->palette;
+    size_t bytes_per_pixel = led_encoder->bytes_per_pixel;
+    size_t frame_size = palette ? data_size * bytes_per_pixel : data_size;
+    size_t index = symbols_written / LED_STRIP_RMT_SYMBOLS_PER_BYTE;
+    size_t count = symbols_free / LED_STRIP_RMT_SYMBOLS_PER_BYTE;
+    if (count > frame_size - index) {
+        count = frame_size - index;
+    }
+    rmt_symbol_word_t *out = symbols;
+    if (palette) {
+        // Expand each palette index to the color bytes of its entry
+        const uint8_t *indices = (const uint8_t *)data;
+        size_t pixel = index / bytes_per_pixel;
+        size_t component = index % bytes_per_pixel;
+        for (size_t i = 0; i < count; i++, out += LED_STRIP_RMT_SYMBOLS_PER_BYTE) {
+            rmt_led_strip_put_byte(led_encoder, out, palette[indices[pixel] * bytes_per_pixel + component]);
+            if (++component == bytes_per_pixel) {
+                component = 0;
+                pixel++;
+            }
+        }
+    } else {
+        const uint8_t *colors = (const uint8_t *)data;
+        for (size_t i = 0; i < count; i++, out += LED_STRIP_RMT_SYMBOLS_PER_BYTE) {
+            rmt_led_strip_put_byte(led_encoder, out, colors[index + i]);
+        }
+    }
+    size_t written = out - symbols;
+    if (index + count == frame_size && written < symbols_free) {
+        symbols[written++] = led_encoder->reset_code;
+        *done = true;
+    }
+    return written;
+}
+#endif
+
 static size_t rmt_encode_led_strip(rmt_encoder_t *encoder, rmt_channel_handle_t channel, const void *primary_data, size_t data_size, rmt_encode_state_t *ret_state)
 {
     rmt_led_strip_encoder_t *led_encoder = __containerof(encoder, rmt_led_strip_encoder_t, base);
+    if (led_encoder->table_encoder) {
+        return led_encoder->table_encoder->encode(led_encoder->table_encoder, channel, primary_data, data_size, ret_state);
+    }
     rmt_encoder_handle_t bytes_encoder = led_encoder->bytes_encoder;
     rmt_encoder_handle_t copy_encoder = led_encoder->copy_encoder;
     rmt_encode_state_t session_state = 0;
@@ -56,8 +119,12 @@ out:
 static esp_err_t rmt_del_led_strip_encoder(rmt_encoder_t *encoder)
 {
     rmt_led_strip_encoder_t *led_encoder = __containerof(encoder, rmt_led_strip_encoder_t, base);
-    rmt_del_encoder(led_encoder->bytes_encoder);
-    rmt_del_encoder(led_encoder->copy_encoder);
+    if (led_encoder->table_encoder) {
+        rmt_del_encoder(led_encoder->table_encoder);
+    } else {
+        rmt_del_encoder(led_encoder->bytes_encoder);
+        rmt_del_encoder(led_encoder->copy_encoder);
+    }
     free(led_encoder);
     return ESP_OK;
 }
@@ -65,12 +132,40 @@ static esp_err_t rmt_del_led_strip_encoder(rmt_encoder_t *encoder)
 static esp_err_t rmt_led_strip_encoder_reset(rmt_encoder_t *encoder)
 {
     rmt_led_strip_encoder_t *led_encoder = __containerof(encoder, rmt_led_strip_encoder_t, base);
-    rmt_encoder_reset(led_encoder->bytes_encoder);
-    rmt_encoder_reset(led_encoder->copy_encoder);
+    if (led_encoder->table_encoder) {
+        rmt_encoder_reset(led_encoder->table_encoder);
+    } else {
+        rmt_encoder_reset(led_encoder->bytes_encoder);
+        rmt_encoder_reset(led_encoder->copy_encoder);
+    }
     led_encoder->state = 0;
     return ESP_OK;
 }
 
+esp_err_t rmt_led_strip_encoder_set_palette(rmt_encoder_handle_t encoder, const uint8_t *palette, uint8_t bytes_per_pixel)
+{
+    ESP_RETURN_ON_FALSE(encoder && (!palette || bytes_per_pixel), ESP_ERR_INVALID_ARG, TAG, "invalid argument");
+    rmt_led_strip_encoder_t *led_encoder = __containerof(encoder, rmt_led_strip_encoder_t, base);
+    // The bytes encoder cannot expand the indices
+    ESP_RETURN_ON_FALSE(!palette || led_encoder->table_encoder, ESP_ERR_NOT_SUPPORTED, TAG, "palette needs ESP-IDF v5.3 or later");
+    led_encoder->palette = palette;
+    led_encoder->bytes_per_pixel = bytes_per_pixel;
+    return ESP_OK;
+}
+
+esp_err_t rmt_led_strip_encoder_encode_symbols(rmt_encoder_handle_t encoder, const void *data, size_t data_size, size_t symbols_written,
+                                               size_t symbols_free, rmt_symbol_word_t *symbols, size_t *ret_written, bool *done)
+{
+    ESP_RETURN_ON_FALSE(encoder && data && symbols && ret_written && done, ESP_ERR_INVALID_ARG, TAG, "invalid argument");
+#if LED_STRIP_RMT_SYMBOL_TABLE
+    rmt_led_strip_encoder_t *led_encoder = __containerof(encoder, rmt_led_strip_encoder_t, base);
+    *ret_written = rmt_encode_led_strip_symbols(data, data_size, symbols_written, symbols_free, symbols, done, led_encoder);
+    return ESP_OK;
+#else
+    return ESP_ERR_NOT_SUPPORTED;
+#endif
+}
+
 esp_err_t rmt_new_led_strip_encoder(const led_strip_encoder_config_t *config, rmt_encoder_handle_t *ret_encoder)
 {
     esp_err_t ret = ESP_OK;
@@ -138,20 +233,37 @@ esp_err_t rmt_new_led_strip_encoder(const led_strip_encoder_config_t *config, rm
     } else {
         assert(false);
     }
-    ESP_GOTO_ON_ERROR(rmt_new_bytes_encoder(&bytes_encoder_config, &led_encoder->bytes_encoder), err, TAG, "create bytes encoder failed");
-    rmt_copy_encoder_config_t copy_encoder_config = {};
-    ESP_GOTO_ON_ERROR(rmt_new_copy_encoder(&copy_encoder_config, &led_encoder->copy_encoder), err, TAG, "create copy encoder failed");
-
     led_encoder->reset_code = (rmt_symbol_word_t) {
         .level0 = 0,
         .duration0 = reset_ticks,
         .level1 = 0,
         .duration1 = reset_ticks,
     };
+#if LED_STRIP_RMT_SYMBOL_TABLE
+    for (int nibble = 0; nibble < 16; nibble++) {
+        for (int bit = 0; bit < LED_STRIP_RMT_SYMBOLS_PER_BYTE / 2; bit++) {
+            bool one = nibble & (0x08 >> bit);
+            led_encoder->nibble_symbols[nibble][bit] = one ? bytes_encoder_config.bit1 : bytes_encoder_config.bit0;
+        }
+    }
+    rmt_simple_encoder_config_t table_encoder_config = {
+        .callback = rmt_encode_led_strip_symbols,
+        .arg = led_encoder,
+        .min_chunk_size = LED_STRIP_RMT_SYMBOLS_PER_BYTE,
+    };
+    ESP_GOTO_ON_ERROR(rmt_new_simple_encoder(&table_encoder_config, &led_encoder->table_encoder), err, TAG, "create symbol table encoder failed");
+#else
+    ESP_GOTO_ON_ERROR(rmt_new_bytes_encoder(&bytes_encoder_config, &led_encoder->bytes_encoder), err, TAG, "create bytes encoder failed");
+    rmt_copy_encoder_config_t copy_encoder_config = {};
+    ESP_GOTO_ON_ERROR(rmt_new_copy_encoder(&copy_encoder_config, &led_encoder->copy_encoder), err, TAG, "create copy encoder failed");
+#endif
     *ret_encoder = &led_encoder->base;
     return ESP_OK;
 err:
     if (led_encoder) {
+        if (led_encoder->table_encoder) {
+            rmt_del_encoder(led_encoder->table_encoder);
+        }
         if (led_encoder->bytes_encoder) {
             rmt_del_encoder(led_encoder->bytes_encoder);
         }
@@ -0,0 +1,76 @@
+/*
+ * SPDX-FileCopyrightText: 2022 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#pragma once
+
+#include <stdint.h>
+#include "driver/rmt_encoder.h"
+#include "led_strip_types.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Type of led strip encoder configuration
+ */
+typedef struct {
+    uint32_t resolution;   /*!< Encoder resolution, in Hz */
+    led_model_t led_model; /*!< LED model */
+} led_strip_encoder_config_t;
+
+/**
+ * @brief Create RMT encoder for encoding LED strip pixels into RMT symbols
+ *
+ * @param[in] config Encoder configuration
+ * @param[out] ret_encoder Returned encoder handle
+ * @return
+ *      - ESP_ERR_INVALID_ARG for any invalid arguments
+ *      - ESP_ERR_NO_MEM out of memory when creating led strip encoder
+ *      - ESP_OK if creating encoder successfully
+ */
+esp_err_t rmt_new_led_strip_encoder(const led_strip_encoder_config_t *config, rmt_encoder_handle_t *ret_encoder);
+
+/**
+ * @brief Make the encoder expand palette indices instead of encoding color bytes
+ *
+ * With a palette, the data passed to `rmt_transmit()` is one palette index per pixel, and its size is the
+ * number of pixels. Each index is replaced by the color bytes of its palette entry as the symbols are produced.
+ *
+ * @param[in] encoder Encoder created by `rmt_new_led_strip_encoder()`
+ * @param[in] palette Palette colors, `bytes_per_pixel` bytes per entry in the order they are sent, or NULL to encode color bytes.
+ *                    It is read during the transmission: only change it or its contents while no frame is in flight.
+ * @param[in] bytes_per_pixel Color bytes per palette entry: 3 or 4
+ * @return
+ *      - ESP_ERR_INVALID_ARG for any invalid arguments
+ *      - ESP_ERR_NOT_SUPPORTED if the encoder cannot expand palette indices (ESP-IDF before v5.3)
+ *      - ESP_OK if the palette is set successfully
+ */
+esp_err_t rmt_led_strip_encoder_set_palette(rmt_encoder_handle_t encoder, const uint8_t *palette, uint8_t bytes_per_pixel);
+
+/**
+ * @brief Produce the next symbols of a frame, as the encoder does from the RMT ISR on each refill
+ *
+ * Used by `led_strip_rmt_encode_frame()` to run the encoder in a task, e.g. to time it.
+ *
+ * @param[in] encoder Encoder created by `rmt_new_led_strip_encoder()`
+ * @param[in] data Frame, as passed to `rmt_transmit()`
+ * @param[in] data_size Size of the frame, in bytes
+ * @param[in] symbols_written Symbols of the frame produced by the previous calls
+ * @param[in] symbols_free Room in `symbols`, in symbols
+ * @param[out] symbols Symbols produced
+ * @param[out] ret_written Number of symbols produced
+ * @param[out] done Set once the last symbol of the frame, the reset code, is produced
+ * @return
+ *      - ESP_ERR_INVALID_ARG for any invalid arguments
+ *      - ESP_ERR_NOT_SUPPORTED if the encoder does not produce the symbols itself (ESP-IDF before v5.3)
+ *      - ESP_OK if the symbols are produced successfully
+ */
+esp_err_t rmt_led_strip_encoder_encode_symbols(rmt_encoder_handle_t encoder, const void *data, size_t data_size, size_t symbols_written,
+                                               size_t symbols_free, rmt_symbol_word_t *symbols, size_t *ret_written, bool *done);
+
+#ifdef __cplusplus
+}
+#endif
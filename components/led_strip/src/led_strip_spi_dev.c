@@ -8,10 +8,13 @@
 #include <sys/cdefs.h>
 #include "esp_log.h"
 #include "esp_check.h"
+#include "esp_attr.h"
+#include "freertos/FreeRTOS.h"
 #include "esp_rom_gpio.h"
 #include "soc/spi_periph.h"
 #include "led_strip.h"
 #include "led_strip_interface.h"
+#include "led_strip_common.h"
 
 #define LED_STRIP_SPI_DEFAULT_RESOLUTION (2.5 * 1000 * 1000) // 2.5MHz resolution
 #define LED_STRIP_SPI_DEFAULT_TRANS_QUEUE_SIZE 4
@@ -25,93 +28,137 @@ typedef struct {
     led_strip_t base;
     spi_host_device_t spi_host;
     spi_device_handle_t spi_device;
-    uint32_t strip_len;
-    uint8_t bytes_per_pixel;
-    led_color_component_format_t component_fmt;
-    uint8_t pixel_buf[];
+    spi_transaction_t trans;    // Frame in flight
+    bool trans_queued;          // `trans` still has to be collected with spi_device_get_trans_result()
+    led_strip_refresh_done_cb_t on_refresh_done;
+    void *user_ctx;
+    uint8_t *spi_buf;           // Encoded frame, 3 SPI bytes per color byte: what is shifted out while pixel_buf is redrawn
+    led_strip_pixels_t pixels;  // Over pixel_buf; spi_buf holds the encoding of its last refreshed state
+    uint8_t pixel_buf[];        // Color bytes, in the order they are sent
 } led_strip_spi_obj;
 
-// please make sure to zero-initialize the buf before calling this function
-static void __led_strip_spi_bit(uint8_t data, uint8_t *buf)
+/*
+ * Each color bit is represented by 3 SPI bits, low_level:100, high_level:110, so a color byte
+ * occupies 3 SPI bytes: the 24-bit pattern of all zeros, 0x924924, with bit n of the color byte
+ * copied to bit 3n+1. The 256 patterns are computed by the compiler.
+ */
+#define SPI_PATTERN(v) (0x924924 | ((v) & BIT(0)) << 1 | ((v) & BIT(1)) << 3 | ((v) & BIT(2)) << 5 | ((v) & BIT(3)) << 7 | \
+                        ((v) & BIT(4)) << 9 | ((v) & BIT(5)) << 11 | ((v) & BIT(6)) << 13 | ((v) & BIT(7)) << 15)
+#define SPI_ENTRY(v) {(SPI_PATTERN(v) >> 16) & 0xFF, (SPI_PATTERN(v) >> 8) & 0xFF, SPI_PATTERN(v) & 0xFF}
+#define SPI_ENTRY4(v) SPI_ENTRY(v), SPI_ENTRY((v) + 1), SPI_ENTRY((v) + 2), SPI_ENTRY((v) + 3)
+#define SPI_ENTRY16(v) SPI_ENTRY4(v), SPI_ENTRY4((v) + 4), SPI_ENTRY4((v) + 8), SPI_ENTRY4((v) + 12)
+#define SPI_ENTRY64(v) SPI_ENTRY16(v), SPI_ENTRY16((v) + 16), SPI_ENTRY16((v) + 32), SPI_ENTRY16((v) + 48)
+
+static const uint8_t s_spi_patterns[256][SPI_BYTES_PER_COLOR_BYTE] = {
+    SPI_ENTRY64(0), SPI_ENTRY64(64), SPI_ENTRY64(128), SPI_ENTRY64(192)
+};
+
+// Encode a whole frame of color bytes into the SPI buffer, in one pass
+static void led_strip_spi_encode(uint8_t *restrict out, const uint8_t *restrict colors, size_t len)
 {
-    // Each color of 1 bit is represented by 3 bits of SPI, low_level:100 ,high_level:110
-    // So a color byte occupies 3 bytes of SPI.
-    *(buf + 2) |= data & BIT(0) ? BIT(2) | BIT(1) : BIT(2);
-    *(buf + 2) |= data & BIT(1) ? BIT(5) | BIT(4) : BIT(5);
-    *(buf + 2) |= data & BIT(2) ? BIT(7) : 0x00;
-    *(buf + 1) |= BIT(0);
-    *(buf + 1) |= data & BIT(3) ? BIT(3) | BIT(2) : BIT(3);
-    *(buf + 1) |= data & BIT(4) ? BIT(6) | BIT(5) : BIT(6);
-    *(buf + 0) |= data & BIT(5) ? BIT(1) | BIT(0) : BIT(1);
-    *(buf + 0) |= data & BIT(6) ? BIT(4) | BIT(3) : BIT(4);
-    *(buf + 0) |= data & BIT(7) ? BIT(7) | BIT(6) : BIT(7);
+    for (size_t i = 0; i < len; i++, out += SPI_BYTES_PER_COLOR_BYTE) {
+        const uint8_t *pattern = s_spi_patterns[colors[i]];
+        out[0] = pattern[0];
+        out[1] = pattern[1];
+        out[2] = pattern[2];
+    }
 }
 
 static esp_err_t led_strip_spi_set_pixel(led_strip_t *strip, uint32_t index, uint32_t red, uint32_t green, uint32_t blue)
 {
     led_strip_spi_obj *spi_strip = __containerof(strip, led_strip_spi_obj, base);
-    ESP_RETURN_ON_FALSE(index < spi_strip->strip_len, ESP_ERR_INVALID_ARG, TAG, "index out of maximum number of LEDs");
-    // 3 pixels take 72bits(9bytes)
-    uint32_t start = index * spi_strip->bytes_per_pixel * SPI_BYTES_PER_COLOR_BYTE;
-    uint8_t *pixel_buf = spi_strip->pixel_buf;
-    led_color_component_format_t component_fmt = spi_strip->component_fmt;
-    memset(pixel_buf + start, 0, spi_strip->bytes_per_pixel * SPI_BYTES_PER_COLOR_BYTE);
-
-    __led_strip_spi_bit(red, &pixel_buf[start + SPI_BYTES_PER_COLOR_BYTE * component_fmt.format.r_pos]);
-    __led_strip_spi_bit(green, &pixel_buf[start + SPI_BYTES_PER_COLOR_BYTE * component_fmt.format.g_pos]);
-    __led_strip_spi_bit(blue, &pixel_buf[start + SPI_BYTES_PER_COLOR_BYTE * component_fmt.format.b_pos]);
-    if (component_fmt.format.num_components > 3) {
-        __led_strip_spi_bit(0, &pixel_buf[start + SPI_BYTES_PER_COLOR_BYTE * component_fmt.format.w_pos]);
-    }
+    ESP_RETURN_ON_FALSE(index < spi_strip->pixels.len, ESP_ERR_INVALID_ARG, TAG, "index out of maximum number of LEDs");
 
+    led_strip_pixels_set(&spi_strip->pixels, index, red & 0xFF, green & 0xFF, blue & 0xFF, 0);
     return ESP_OK;
 }
 
 static esp_err_t led_strip_spi_set_pixel_rgbw(led_strip_t *strip, uint32_t index, uint32_t red, uint32_t green, uint32_t blue, uint32_t white)
 {
     led_strip_spi_obj *spi_strip = __containerof(strip, led_strip_spi_obj, base);
-    led_color_component_format_t component_fmt = spi_strip->component_fmt;
-    ESP_RETURN_ON_FALSE(index < spi_strip->strip_len, ESP_ERR_INVALID_ARG, TAG, "index out of maximum number of LEDs");
-    ESP_RETURN_ON_FALSE(component_fmt.format.num_components == 4, ESP_ERR_INVALID_ARG, TAG, "led doesn't have 4 components");
+    ESP_RETURN_ON_FALSE(index < spi_strip->pixels.len, ESP_ERR_INVALID_ARG, TAG, "index out of maximum number of LEDs");
+    ESP_RETURN_ON_FALSE(spi_strip->pixels.bytes_per_pixel == 4, ESP_ERR_INVALID_ARG, TAG, "led doesn't have 4 components");
+
+    led_strip_pixels_set(&spi_strip->pixels, index, red & 0xFF, green & 0xFF, blue & 0xFF, white & 0xFF);
+    return ESP_OK;
+}
 
-    // LED_PIXEL_FORMAT_GRBW takes 96bits(12bytes)
-    uint32_t start = index * spi_strip->bytes_per_pixel * SPI_BYTES_PER_COLOR_BYTE;
-    uint8_t *pixel_buf = spi_strip->pixel_buf;
-    memset(pixel_buf + start, 0, spi_strip->bytes_per_pixel * SPI_BYTES_PER_COLOR_BYTE);
+static esp_err_t led_strip_spi_blit(led_strip_t *strip, uint32_t index, uint32_t count, const void *pixels, led_strip_pixel_format_t format)
+{
+    led_strip_spi_obj *spi_strip = __containerof(strip, led_strip_spi_obj, base);
+    return led_strip_pixels_blit(&spi_strip->pixels, index, count, pixels, format);
+}
 
-    __led_strip_spi_bit(red, &pixel_buf[start + SPI_BYTES_PER_COLOR_BYTE * component_fmt.format.r_pos]);
-    __led_strip_spi_bit(green, &pixel_buf[start + SPI_BYTES_PER_COLOR_BYTE * component_fmt.format.g_pos]);
-    __led_strip_spi_bit(blue, &pixel_buf[start + SPI_BYTES_PER_COLOR_BYTE * component_fmt.format.b_pos]);
-    __led_strip_spi_bit(white, &pixel_buf[start + SPI_BYTES_PER_COLOR_BYTE * component_fmt.format.w_pos]);
+static void IRAM_ATTR led_strip_spi_post_cb(spi_transaction_t *trans)
+{
+    led_strip_spi_obj *spi_strip = (led_strip_spi_obj *)trans->user;
+    led_strip_refresh_done_cb_t cb = spi_strip->on_refresh_done;
+    if (cb && cb(&spi_strip->base, spi_strip->user_ctx)) {
+        portYIELD_FROM_ISR();
+    }
+}
 
+static esp_err_t led_strip_spi_wait_refresh_done(led_strip_t *strip, int32_t timeout_ms)
+{
+    led_strip_spi_obj *spi_strip = __containerof(strip, led_strip_spi_obj, base);
+    if (!spi_strip->trans_queued) {
+        return ESP_OK;
+    }
+    spi_transaction_t *ret_trans = NULL;
+    esp_err_t ret = spi_device_get_trans_result(spi_strip->spi_device, &ret_trans, timeout_ms < 0 ? portMAX_DELAY : pdMS_TO_TICKS(timeout_ms));
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    spi_strip->trans_queued = false;
     return ESP_OK;
 }
 
-static esp_err_t led_strip_spi_refresh(led_strip_t *strip)
+// Encode the changed pixels and start shifting out the frame up to the last of them, once the previous frame is out
+static esp_err_t led_strip_spi_refresh_async(led_strip_t *strip)
 {
     led_strip_spi_obj *spi_strip = __containerof(strip, led_strip_spi_obj, base);
-    spi_transaction_t tx_conf;
-    memset(&tx_conf, 0, sizeof(tx_conf));
+    led_strip_pixels_t *pixels = &spi_strip->pixels;
+    if (!led_strip_pixels_dirty(pixels)) {
+        return ESP_OK;
+    }
+    size_t frame_size = led_strip_pixels_frame_size(pixels);
+    size_t dirty_start = pixels->dirty_start * pixels->bytes_per_pixel;
+    ESP_RETURN_ON_ERROR(led_strip_spi_wait_refresh_done(strip, -1), TAG, "wait for previous frame failed");
+    // The pixels before the changed ones are still encoded in spi_buf from the previous refreshes
+    led_strip_spi_encode(spi_strip->spi_buf + dirty_start * SPI_BYTES_PER_COLOR_BYTE, spi_strip->pixel_buf + dirty_start,
+                         frame_size - dirty_start);
+
+    spi_transaction_t *tx_conf = &spi_strip->trans;
+    memset(tx_conf, 0, sizeof(*tx_conf));
+    tx_conf->length = frame_size * SPI_BITS_PER_COLOR_BYTE;
+    tx_conf->tx_buffer = spi_strip->spi_buf;
+    tx_conf->rx_buffer = NULL;
+    tx_conf->user = spi_strip;
+    ESP_RETURN_ON_ERROR(spi_device_queue_trans(spi_strip->spi_device, tx_conf, portMAX_DELAY), TAG, "transmit pixels by SPI failed");
+    spi_strip->trans_queued = true;
+    led_strip_pixels_sent(pixels);
+    return ESP_OK;
+}
 
-    tx_conf.length = spi_strip->strip_len * spi_strip->bytes_per_pixel * SPI_BITS_PER_COLOR_BYTE;
-    tx_conf.tx_buffer = spi_strip->pixel_buf;
-    tx_conf.rx_buffer = NULL;
-    ESP_RETURN_ON_ERROR(spi_device_transmit(spi_strip->spi_device, &tx_conf), TAG, "transmit pixels by SPI failed");
+static esp_err_t led_strip_spi_refresh(led_strip_t *strip)
+{
+    ESP_RETURN_ON_ERROR(led_strip_spi_refresh_async(strip), TAG, "start refresh failed");
+    return led_strip_spi_wait_refresh_done(strip, -1);
+}
 
+static esp_err_t led_strip_spi_register_event_callbacks(led_strip_t *strip, const led_strip_event_callbacks_t *cbs, void *user_ctx)
+{
+    led_strip_spi_obj *spi_strip = __containerof(strip, led_strip_spi_obj, base);
+    spi_strip->user_ctx = user_ctx;
+    spi_strip->on_refresh_done = cbs->on_refresh_done;
     return ESP_OK;
 }
 
 static esp_err_t led_strip_spi_clear(led_strip_t *strip)
 {
     led_strip_spi_obj *spi_strip = __containerof(strip, led_strip_spi_obj, base);
-    //Write zero to turn off all leds
-    memset(spi_strip->pixel_buf, 0, spi_strip->strip_len * spi_strip->bytes_per_pixel * SPI_BYTES_PER_COLOR_BYTE);
-    uint8_t *buf = spi_strip->pixel_buf;
-    for (int index = 0; index < spi_strip->strip_len * spi_strip->bytes_per_pixel; index++) {
-        __led_strip_spi_bit(0, buf);
-        buf += SPI_BYTES_PER_COLOR_BYTE;
-    }
-
+    //Write zero to turn off all leds, and send the whole strip
+    led_strip_pixels_clear(&spi_strip->pixels);
     return led_strip_spi_refresh(strip);
 }
 
@@ -119,9 +166,11 @@ static esp_err_t led_strip_spi_del(led_strip_t *strip)
 {
     led_strip_spi_obj *spi_strip = __containerof(strip, led_strip_spi_obj, base);
 
+    ESP_RETURN_ON_ERROR(led_strip_spi_wait_refresh_done(strip, -1), TAG, "wait for last frame failed");
     ESP_RETURN_ON_ERROR(spi_bus_remove_device(spi_strip->spi_device), TAG, "delete spi device failed");
     ESP_RETURN_ON_ERROR(spi_bus_free(spi_strip->spi_host), TAG, "free spi bus failed");
 
+    free(spi_strip->spi_buf);
     free(spi_strip);
     return ESP_OK;
 }
@@ -156,9 +205,10 @@ esp_err_t led_strip_new_spi_device(const led_strip_config_t *led_config, const l
         // DMA buffer must be placed in internal SRAM
         mem_caps |= MALLOC_CAP_INTERNAL | MALLOC_CAP_DMA;
     }
-    spi_strip = heap_caps_calloc(1, sizeof(led_strip_spi_obj) + led_config->max_leds * bytes_per_pixel * SPI_BYTES_PER_COLOR_BYTE, mem_caps);
-
+    spi_strip = calloc(1, sizeof(led_strip_spi_obj) + led_config->max_leds * bytes_per_pixel);
     ESP_GOTO_ON_FALSE(spi_strip, ESP_ERR_NO_MEM, err, TAG, "no mem for spi strip");
+    spi_strip->spi_buf = heap_caps_calloc(1, led_config->max_leds * bytes_per_pixel * SPI_BYTES_PER_COLOR_BYTE, mem_caps);
+    ESP_GOTO_ON_FALSE(spi_strip->spi_buf, ESP_ERR_NO_MEM, err, TAG, "no mem for spi buffer");
 
     spi_strip->spi_host = spi_config->spi_bus;
     // for backward compatibility, if the user does not set the clk_src, use the default value
@@ -192,6 +242,7 @@ esp_err_t led_strip_new_spi_device(const led_strip_config_t *led_config, const l
         //set -1 when CS is not used
         .spics_io_num = -1,
         .queue_size = LED_STRIP_SPI_DEFAULT_TRANS_QUEUE_SIZE,
+        .post_cb = led_strip_spi_post_cb,
     };
 
     ESP_GOTO_ON_ERROR(spi_bus_add_device(spi_strip->spi_host, &spi_dev_cfg, &spi_strip->spi_device), err, TAG, "Failed to add spi device");
@@ -205,12 +256,14 @@ esp_err_t led_strip_new_spi_device(const led_strip_config_t *led_config, const l
     ESP_GOTO_ON_FALSE((clock_resolution_khz < LED_STRIP_SPI_DEFAULT_RESOLUTION / 1000 + 300) && (clock_resolution_khz > LED_STRIP_SPI_DEFAULT_RESOLUTION / 1000 - 300), ESP_ERR_NOT_SUPPORTED, err,
                       TAG, "unsupported clock resolution:%dKHz", clock_resolution_khz);
 
-    spi_strip->component_fmt = component_fmt;
-    spi_strip->bytes_per_pixel = bytes_per_pixel;
-    spi_strip->strip_len = led_config->max_leds;
+    led_strip_pixels_init(&spi_strip->pixels, spi_strip->pixel_buf, led_config->max_leds, component_fmt, led_config->flags.partial_refresh);
     spi_strip->base.set_pixel = led_strip_spi_set_pixel;
     spi_strip->base.set_pixel_rgbw = led_strip_spi_set_pixel_rgbw;
+    spi_strip->base.blit = led_strip_spi_blit;
     spi_strip->base.refresh = led_strip_spi_refresh;
+    spi_strip->base.refresh_async = led_strip_spi_refresh_async;
+    spi_strip->base.wait_refresh_done = led_strip_spi_wait_refresh_done;
+    spi_strip->base.register_event_callbacks = led_strip_spi_register_event_callbacks;
     spi_strip->base.clear = led_strip_spi_clear;
     spi_strip->base.del = led_strip_spi_del;
 
@@ -224,6 +277,7 @@ err:
         if (spi_strip->spi_host) {
             spi_bus_free(spi_strip->spi_host);
         }
+        free(spi_strip->spi_buf);
         free(spi_strip);
     }
     return ret;
@@ -6,6 +6,11 @@
  * This module provides initialization and toggling functions for both addressable LED strips
  * and simple GPIO LEDs, depending on project configuration. It abstracts the hardware details
  * so the application can blink an LED with a simple API.
+ *
+ * With CONFIG_BLINK_HARDWARE both LED types are driven by one RMT TX channel instead, which
+ * can replay a whole on/off cycle from its memory block in an endless loop (see
+ * blink_start_hw()). LEDC was not used for the GPIO LED: its integer frequencies of a few Hz
+ * and up cannot express the 100 ms to 10 s blink periods.
  */
 
 #include "blink.h"
@@ -13,8 +18,203 @@
 #include "led_strip.h"
 #include "sdkconfig.h"
 #include "esp_log.h"
+#include "profile.h"
+
+#if CONFIG_BLINK_HARDWARE
+#include "driver/rmt_tx.h"
+#include "soc/soc_caps.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+/*
+ * A loop replays the channel memory as is, so a whole cycle must fit in it: two blocks (the
+ * TX channel takes the neighbouring block; the monitor only uses an RX channel), less the
+ * end marker the driver appends. A symbol holds two pieces of up to 32767 ticks each.
+ */
+#define BLINK_HW_MEM_SYMBOLS (2 * SOC_RMT_MEM_WORDS_PER_CHANNEL)
+#define BLINK_HW_MAX_SYMBOLS (BLINK_HW_MEM_SYMBOLS - 1)
+#define BLINK_HW_SYMBOL_TICKS (2 * 32767U)
+
+#ifdef CONFIG_BLINK_LED_STRIP
+// 0.4 us ticks: a WS2812 bit is 3 ticks, 0 = high 1 / low 2, 1 = high 2 / low 1 (as the SPI
+// backend of led_strip); a full cycle fits for periods up to ~600 ms
+#define BLINK_HW_RESOLUTION_HZ 2500000U
+#define BLINK_HW_FRAME_BITS 24
+#else
+// 3.2 us ticks, the slowest the 80 MHz RMT clock divides to; cycles fit up to ~9.8 s
+#define BLINK_HW_RESOLUTION_HZ 312500U
+#define BLINK_HW_FRAME_BITS 0
+#endif
+
+static const char *TAG = "blink";
+
+static rmt_channel_handle_t s_chan = NULL;
+static rmt_encoder_handle_t s_encoder = NULL;
+static SemaphoreHandle_t s_lock = NULL;
+// The loop in the channel memory, when running
+static rmt_symbol_word_t s_loop[BLINK_HW_MAX_SYMBOLS];
+static bool s_looping = false;
+// State variable for LED (on/off)
+static uint8_t s_led_state = 0;
+
+#ifdef CONFIG_BLINK_LED_STRIP
+// Pixel shown in the on state, in WS2812 order (GRB): dim blue, as with the led_strip backend
+static const uint8_t s_on_grb[3] = {0, 0, 1};
+// One frame per state for blink_toggle()
+static rmt_symbol_word_t s_frames[2][BLINK_HW_FRAME_BITS];
+
+// Append the WS2812 bits of the pixel for @p on to @p out; returns the symbols written
+static size_t blink_hw_frame(rmt_symbol_word_t *out, bool on)
+{
+    for (int i = 0; i < BLINK_HW_FRAME_BITS; i++)
+    {
+        bool bit = on && (s_on_grb[i / 8] & (0x80 >> (i % 8)));
+        out[i] = (rmt_symbol_word_t){
+            .level0 = 1, .duration0 = bit ? 2 : 1, .level1 = 0, .duration1 = bit ? 1 : 2};
+    }
+    return BLINK_HW_FRAME_BITS;
+}
+#else
+// One constant level per state for blink_toggle(); the line keeps it as end-of-transmission level
+static rmt_symbol_word_t s_frames[2][1] = {
+    {{.level0 = 0, .duration0 = 1, .level1 = 0, .duration1 = 1}},
+    {{.level0 = 1, .duration0 = 1, .level1 = 1, .duration1 = 1}},
+};
+#endif
+
+// Symbols holding @p ticks at one level: as few as possible, the ticks spread evenly so no
+// piece is 0 (a 0 duration ends the transmission)
+static size_t blink_hw_hold_symbols(uint32_t ticks)
+{
+    return (ticks + BLINK_HW_SYMBOL_TICKS - 1) / BLINK_HW_SYMBOL_TICKS;
+}
+
+static size_t blink_hw_hold(rmt_symbol_word_t *out, uint32_t ticks, bool level)
+{
+    size_t n = blink_hw_hold_symbols(ticks);
+    for (size_t i = 0; i < n; i++)
+    {
+        uint32_t t = ticks / n + (i < ticks % n ? 1 : 0);
+        out[i] = (rmt_symbol_word_t){
+            .level0 = level, .duration0 = t - t / 2, .level1 = level, .duration1 = t / 2};
+    }
+    return n;
+}
 
+// Build one cycle: each state shows for @p period_ms (the strip: its frame, then the idle line
+// latching and holding it). Returns the symbol count, 0 if the cycle does not fit.
+static size_t blink_hw_build(uint32_t period_ms)
+{
+    uint64_t ticks = (uint64_t)period_ms * BLINK_HW_RESOLUTION_HZ / 1000;
+    uint32_t frame_ticks = BLINK_HW_FRAME_BITS * 3;
+    if (ticks <= frame_ticks + 2 || ticks > UINT32_MAX)
+        return 0;
+    uint32_t hold = (uint32_t)ticks - frame_ticks;
+    if (2 * (BLINK_HW_FRAME_BITS + blink_hw_hold_symbols(hold)) > BLINK_HW_MAX_SYMBOLS)
+        return 0;
+    size_t n = 0;
+    for (int on = 1; on >= 0; on--)
+    {
 #ifdef CONFIG_BLINK_LED_STRIP
+        n += blink_hw_frame(s_loop + n, on);
+        n += blink_hw_hold(s_loop + n, hold, false);
+#else
+        n += blink_hw_hold(s_loop + n, hold, on);
+#endif
+    }
+    return n;
+}
+
+// Stop a running loop; the channel stays enabled for blink_toggle(). Called with s_lock held.
+static void blink_hw_stop(void)
+{
+    if (!s_looping)
+        return;
+    // Disabling aborts the endless transaction, which would never complete otherwise
+    rmt_disable(s_chan);
+    rmt_enable(s_chan);
+    s_looping = false;
+}
+
+// Show the state in s_led_state. Called with s_lock held.
+static void blink_hw_show(void)
+{
+    rmt_transmit_config_t tx = {.loop_count = 0, .flags.eot_level = 0};
+#ifndef CONFIG_BLINK_LED_STRIP
+    tx.flags.eot_level = s_led_state;
+#endif
+    rmt_transmit(s_chan, s_encoder, s_frames[s_led_state], sizeof(s_frames[0]), &tx);
+}
+
+/**
+ * @brief Initialize the RMT channel driving the LED and switch the LED off.
+ */
+void blink_init(void)
+{
+    rmt_tx_channel_config_t chan_config = {
+        .gpio_num = CONFIG_BLINK_GPIO,
+        .clk_src = RMT_CLK_SRC_DEFAULT,
+        .resolution_hz = BLINK_HW_RESOLUTION_HZ,
+        .mem_block_symbols = BLINK_HW_MEM_SYMBOLS,
+        .trans_queue_depth = 2,
+    };
+    rmt_copy_encoder_config_t encoder_config = {};
+    s_lock = xSemaphoreCreateMutex();
+    if (!s_lock || rmt_new_tx_channel(&chan_config, &s_chan) != ESP_OK ||
+        rmt_new_copy_encoder(&encoder_config, &s_encoder) != ESP_OK || rmt_enable(s_chan) != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Failed to set up the RMT channel, LED disabled");
+        s_chan = NULL;
+        return;
+    }
+#ifdef CONFIG_BLINK_LED_STRIP
+    blink_hw_frame(s_frames[0], false);
+    blink_hw_frame(s_frames[1], true);
+#endif
+    blink_hw_show();
+}
+
+/**
+ * @brief Toggle the LED state (on/off) with a single transmission; no-op while the loop runs.
+ */
+void blink_toggle(void)
+{
+    PROF_SCOPE("blink_toggle");
+    if (!s_chan)
+        return;
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    if (!s_looping)
+    {
+        s_led_state = !s_led_state;
+        blink_hw_show();
+    }
+    xSemaphoreGive(s_lock);
+}
+
+bool blink_start_hw(uint32_t period_ms)
+{
+    if (!s_chan)
+        return false;
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    blink_hw_stop();
+    size_t n = blink_hw_build(period_ms);
+    if (n)
+    {
+        rmt_transmit_config_t tx = {.loop_count = -1};
+        s_looping = rmt_transmit(s_chan, s_encoder, s_loop, n * sizeof(rmt_symbol_word_t), &tx) == ESP_OK;
+        ESP_LOGI(TAG, "Hardware blinking at %lu ms (%u symbols)%s", (unsigned long)period_ms, (unsigned)n,
+                 s_looping ? "" : " failed");
+    }
+    else
+    {
+        ESP_LOGI(TAG, "Period %lu ms beyond the RMT loop, toggling in software", (unsigned long)period_ms);
+    }
+    bool looping = s_looping;
+    xSemaphoreGive(s_lock);
+    return looping;
+}
+
+#elif defined(CONFIG_BLINK_LED_STRIP)
 // Handle for addressable LED strip
 static led_strip_handle_t led_strip;
 // State variable for LED (on/off)
@@ -30,6 +230,8 @@ void blink_init(void)
     led_strip_config_t strip_config = {
         .strip_gpio_num = CONFIG_BLINK_GPIO,
         .max_leds = 1,
+        // Shared by both backends: a refresh with the pixel unchanged sends nothing
+        .flags.partial_refresh = true,
     };
 #if CONFIG_BLINK_LED_STRIP_BACKEND_RMT
     led_strip_rmt_config_t rmt_config = {
@@ -52,20 +254,17 @@ void blink_init(void)
 /**
  * @brief Toggle the LED state (on/off) for the addressable LED strip.
  *
- * Turns the LED on or off by setting the pixel color and refreshing the strip.
+ * Turns the LED on or off by setting the pixel color and starting the refresh. It runs as a
+ * scheduler job, so it does not wait for the frame: the backend releases its channel once the
+ * frame is out.
  */
 void blink_toggle(void)
 {
+    PROF_SCOPE("blink_toggle");
     s_led_state = !s_led_state;
-    if (s_led_state)
-    {
-        led_strip_set_pixel(led_strip, 0, 0, 0, 1); // Set pixel to blue (example)
-        led_strip_refresh(led_strip);
-    }
-    else
-    {
-        led_strip_clear(led_strip);
-    }
+    // Dim blue when on (example)
+    led_strip_set_pixel(led_strip, 0, 0, 0, s_led_state ? 1 : 0);
+    led_strip_refresh_async(led_strip);
 }
 
 #else // GPIO LED
@@ -90,7 +289,15 @@ void blink_init(void)
  */
 void blink_toggle(void)
 {
+    PROF_SCOPE("blink_toggle");
     s_led_state = !s_led_state;
     gpio_set_level(CONFIG_BLINK_GPIO, s_led_state);
 }
 #endif
+
+#if !CONFIG_BLINK_HARDWARE
+bool blink_start_hw(uint32_t period_ms)
+{
+    return false;
+}
+#endif
@@ -9,6 +9,9 @@
 #ifndef BLINK_H
 #define BLINK_H
 
+#include <stdbool.h>
+#include <stdint.h>
+
 /**
  * @brief Initialize the LED (strip or GPIO) for blinking.
  */
@@ -19,5 +22,17 @@ void blink_init(void);
  */
 void blink_toggle(void);
 
+/**
+ * @brief Hand the blinking over to the hardware, or reprogram it for a new period.
+ *
+ * With CONFIG_BLINK_HARDWARE an RMT channel replays a whole on/off cycle in an endless loop:
+ * no task, timer or interrupt runs until the next call.
+ * @param period_ms Time the LED stays on, then off
+ * @return true if the hardware blinks; false if hardware blinking is disabled or the cycle
+ *         does not fit in the channel memory. The loop is stopped then, and blink_toggle()
+ *         must be called every @p period_ms instead.
+ */
+bool blink_start_hw(uint32_t period_ms);
+
 #include "blink_config.h"
 #endif // BLINK_H
@@ -1,22 +1,40 @@
 // blink_config.c
+#include <stddef.h>
 #include "blink_config.h"
-#include "sdkconfig.h"
+#include "config_store.h"
 
-/* Blink period in milliseconds */
-static uint32_t s_blink_period_ms = CONFIG_BLINK_PERIOD; // default from menuconfig
+/* Notified after the period changes (e.g. to re-arm the LED task immediately) */
+static void (*s_period_listener)(uint32_t period_ms) = NULL;
 
-/* Get the blink period in milliseconds */
+/* Forwards blink period changes from the configuration store to the listener */
+static void blink_config_changed(cfg_key_t key, uint32_t value, void *arg)
+{
+    if (s_period_listener)
+        s_period_listener(value);
+}
+
+static cfg_sub_t s_config_sub = CFG_SUB_INIT(blink_config_changed, NULL, CFG_BIT(CFG_BLINK_PERIOD_MS));
+
+/* Get the blink period in milliseconds (persisted in NVS by the configuration store) */
 uint32_t blink_get_period_ms(void)
 {
-    return s_blink_period_ms;
+    return config_get(CFG_BLINK_PERIOD_MS);
 }
 
-/* Set the blink period in milliseconds */
+/* Set the blink period in milliseconds; clamped to [BLINK_PERIOD_MIN, BLINK_PERIOD_MAX] by the store */
 void blink_set_period_ms(uint32_t period_ms)
 {
-    if (period_ms < BLINK_PERIOD_MIN)
-        period_ms = BLINK_PERIOD_MIN;
-    if (period_ms > BLINK_PERIOD_MAX)
-        period_ms = BLINK_PERIOD_MAX;
-    s_blink_period_ms = period_ms;
+    config_set(CFG_BLINK_PERIOD_MS, period_ms);
+}
+
+/* Register the period change listener */
+void blink_set_period_listener(void (*listener)(uint32_t period_ms))
+{
+    static bool s_subscribed = false;
+    s_period_listener = listener;
+    if (!s_subscribed)
+    {
+        config_subscribe(&s_config_sub);
+        s_subscribed = true;
+    }
 }
@@ -13,6 +13,8 @@ extern "C"
     uint32_t blink_get_period_ms(void);
     // Set the blink period in ms (range-limited inside implementation)
     void blink_set_period_ms(uint32_t period_ms);
+    // Register a callback run after every period change (single listener, NULL to clear)
+    void blink_set_period_listener(void (*listener)(uint32_t period_ms));
 
 // Expose min/max blink period for use in UI and backend
 #define BLINK_PERIOD_MIN 100
@@ -0,0 +1,719 @@
+/**
+ * @file coap_server.c
+ * @brief CoAP message codec, resources and observer notifications over one UDP socket.
+ *
+ * Everything runs in the CoAP task, so no state is shared: it select()s on the socket and
+ * on an eventfd that the sample bus signals from the publish path (sample_sub_t.wake).
+ * The socket only exists while the link is up: the task starts before the network stack is
+ * initialised, waits on the eventfd alone, and opens the socket once LINK_EVENT_UP has been
+ * seen (the link handler signals the eventfd too). A link loss closes it and drops the
+ * observers, and the next LINK_EVENT_UP opens it again.
+ * A wake-up drains the bus into the latest reading and marks every observer as having a
+ * pending notification; notifications then leave as each observer's pacing allows, and
+ * the select timeout is the nearest retransmission or pacing deadline.
+ *
+ * Requests are answered statelessly: a CON request gets a piggybacked ACK with the same
+ * message ID, a NON request a NON response. GET is idempotent, so duplicates of a request
+ * are simply answered again and no deduplication cache is kept.
+ */
+
+#include "sdkconfig.h"
+
+#if CONFIG_FLORALINK_COAP
+
+#include "coap_server.h"
+#include <errno.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/select.h>
+#include <esp_log.h>
+#include <esp_random.h>
+#include <esp_timer.h>
+#include <esp_vfs_eventfd.h>
+#include "lwip/sockets.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "sample_bus.h"
+#include "config_store.h"
+#include "wifi_setup.h"
+
+#define COAP_VERSION 1
+#define COAP_CON 0
+#define COAP_NON 1
+#define COAP_ACK 2
+#define COAP_RST 3
+
+#define COAP_CODE(c, d) (((c) << 5) | (d))
+#define COAP_EMPTY COAP_CODE(0, 0)
+#define COAP_GET COAP_CODE(0, 1)
+#define COAP_CONTENT COAP_CODE(2, 5)
+#define COAP_BAD_REQUEST COAP_CODE(4, 0)
+#define COAP_BAD_OPTION COAP_CODE(4, 2)
+#define COAP_NOT_FOUND COAP_CODE(4, 4)
+#define COAP_NOT_ALLOWED COAP_CODE(4, 5)
+#define COAP_NOT_ACCEPTABLE COAP_CODE(4, 6)
+#define COAP_UNAVAILABLE COAP_CODE(5, 3)
+
+#define COAP_OPT_OBSERVE 6
+#define COAP_OPT_URI_PATH 11
+#define COAP_OPT_CONTENT_FORMAT 12
+#define COAP_OPT_MAX_AGE 14
+#define COAP_OPT_URI_QUERY 15
+#define COAP_OPT_ACCEPT 17
+
+#define COAP_FORMAT_LINK 40
+#define COAP_FORMAT_JSON 50
+#define COAP_FORMAT_CBOR 60
+#define COAP_FORMAT_NONE 0xFFFF
+
+#define COAP_ACK_TIMEOUT_MS 2000 // RFC 7252 4.8 transmission parameters
+#define COAP_MAX_RETRANSMIT 4
+#define COAP_MAX_INTERVAL_MS 60000
+#define COAP_BACKOFF_MIN_MS 1000 // Interval after the first retransmission when the minimum is 0
+#define COAP_RX_MAX 256
+#define COAP_TX_MAX 320 // Fits the /stats JSON
+
+typedef struct
+{
+    uint8_t type;
+    uint8_t code;
+    uint16_t mid;
+    uint8_t tkl;
+    uint8_t token[8];
+    int32_t observe; // -1 when absent
+    uint16_t accept;
+    bool bad_option;
+    char path[32];
+    char query[32];
+} coap_req_t;
+
+typedef struct
+{
+    uint8_t *buf;
+    size_t len;
+    uint16_t last_opt;
+} coap_pkt_t;
+
+typedef struct
+{
+    bool used;
+    struct sockaddr_in addr;
+    uint8_t tkl;
+    uint8_t token[8];
+    uint16_t format;
+    int8_t con_mode;      // -1 automatic, 0 always NON, 1 always CON
+    uint32_t obs_seq;     // Observe option value, 24 bits on the wire
+    uint32_t sent;        // Notifications sent, for the automatic CON selection
+    bool pending;         // A newer reading than the last notified one
+    int64_t next_us;      // Earliest next notification (pacing)
+    uint32_t interval_ms; // Current minimum interval between notifications
+    bool inflight;        // A CON notification waits for its ACK
+    uint16_t mid;         // Message ID of the last notification (ACK/RST matching)
+    uint8_t retries;
+    uint32_t timeout_ms;
+    int64_t deadline_us;  // Retransmission deadline while inflight
+} coap_observer_t;
+
+static const char *TAG = "CoAP";
+
+static int s_sock = -1;
+static int s_event_fd = -1;
+static volatile bool s_link_up = false;
+static uint16_t s_mid = 0;
+static coap_observer_t s_obs[CONFIG_FLORALINK_COAP_MAX_OBSERVERS];
+static sample_t s_latest;
+static bool s_have_latest = false;
+static uint8_t s_rx[COAP_RX_MAX];
+static uint8_t s_tx[COAP_TX_MAX];
+static coap_server_stats_t s_stats = {0};
+
+static void coap_wake(sample_sub_t *sub);
+static sample_sub_t s_sub = {.name = "coap", .wake = coap_wake};
+
+// Runs in the sampling task: one eventfd write, picked up by the select() of the CoAP task
+static void coap_wake(sample_sub_t *sub)
+{
+    uint64_t one = 1;
+    if (s_event_fd >= 0)
+        write(s_event_fd, &one, sizeof(one));
+}
+
+// Runs in the default event loop task; the CoAP task opens or closes the socket
+static void coap_link_handler(void *arg, esp_event_base_t base, int32_t id, void *data)
+{
+    s_link_up = id == LINK_EVENT_UP;
+    coap_wake(NULL);
+}
+
+static bool coap_parse(const uint8_t *p, size_t len, coap_req_t *req)
+{
+    memset(req, 0, sizeof(*req));
+    req->observe = -1;
+    req->accept = COAP_FORMAT_NONE;
+    if (len < 4 || (p[0] >> 6) != COAP_VERSION || (p[0] & 0x0F) > 8)
+        return false;
+    req->type = (p[0] >> 4) & 3;
+    req->tkl = p[0] & 0x0F;
+    req->code = p[1];
+    req->mid = (uint16_t)(p[2] << 8 | p[3]);
+    size_t pos = 4;
+    if (pos + req->tkl > len)
+        return false;
+    memcpy(req->token, &p[pos], req->tkl);
+    pos += req->tkl;
+
+    uint32_t num = 0;
+    while (pos < len && p[pos] != 0xFF)
+    {
+        uint32_t delta = p[pos] >> 4, olen = p[pos] & 0x0F;
+        pos++;
+        uint32_t *field[2] = {&delta, &olen};
+        for (int i = 0; i < 2; i++)
+        {
+            if (*field[i] == 13 && pos < len)
+                *field[i] = 13 + p[pos++];
+            else if (*field[i] == 14 && pos + 1 < len)
+            {
+                *field[i] = 269 + (p[pos] << 8 | p[pos + 1]);
+                pos += 2;
+            }
+            else if (*field[i] >= 13)
+                return false; // 15 is reserved, or the extension is truncated
+        }
+        num += delta;
+        if (pos + olen > len)
+            return false;
+        const uint8_t *v = &p[pos];
+        uint32_t uint = 0;
+        for (uint32_t i = 0; i < olen && i < 4; i++)
+            uint = uint << 8 | v[i];
+        switch (num)
+        {
+        case COAP_OPT_URI_PATH:
+        case COAP_OPT_URI_QUERY:
+        {
+            char *dst = num == COAP_OPT_URI_PATH ? req->path : req->query;
+            size_t used = strlen(dst);
+            const char *sep = num == COAP_OPT_URI_PATH ? "/" : (used ? "&" : "");
+            if (used + strlen(sep) + olen >= sizeof(req->path))
+                return false;
+            strcat(dst, sep);
+            memcpy(dst + strlen(dst), v, olen);
+            break;
+        }
+        case COAP_OPT_OBSERVE:
+            req->observe = (int32_t)uint;
+            break;
+        case COAP_OPT_ACCEPT:
+            req->accept = (uint16_t)uint;
+            break;
+        default:
+            if (num & 1)
+                req->bad_option = true; // Unknown critical option
+            break;
+        }
+        pos += olen;
+    }
+    return true;
+}
+
+static void coap_begin(coap_pkt_t *pkt, uint8_t type, uint8_t code, uint16_t mid, const uint8_t *token, uint8_t tkl)
+{
+    pkt->buf = s_tx;
+    pkt->buf[0] = (uint8_t)(COAP_VERSION << 6 | type << 4 | tkl);
+    pkt->buf[1] = code;
+    pkt->buf[2] = (uint8_t)(mid >> 8);
+    pkt->buf[3] = (uint8_t)mid;
+    memcpy(&pkt->buf[4], token, tkl);
+    pkt->len = 4 + tkl;
+    pkt->last_opt = 0;
+}
+
+// Nibble of an option delta or length; extension bytes are appended to ext[*n]
+static uint8_t coap_nibble(uint32_t v, uint8_t *ext, size_t *n)
+{
+    if (v < 13)
+        return (uint8_t)v;
+    if (v < 269)
+    {
+        ext[(*n)++] = (uint8_t)(v - 13);
+        return 13;
+    }
+    ext[(*n)++] = (uint8_t)((v - 269) >> 8);
+    ext[(*n)++] = (uint8_t)(v - 269);
+    return 14;
+}
+
+// Options must be added in increasing number order
+static void coap_option(coap_pkt_t *pkt, uint16_t num, const void *value, size_t len)
+{
+    uint8_t ext[4];
+    size_t n = 0;
+    uint8_t d = coap_nibble(num - pkt->last_opt, ext, &n);
+    uint8_t l = coap_nibble((uint32_t)len, ext, &n);
+    if (pkt->len + 1 + n + len > COAP_TX_MAX)
+        return;
+    pkt->buf[pkt->len++] = (uint8_t)(d << 4 | l);
+    memcpy(&pkt->buf[pkt->len], ext, n);
+    pkt->len += n;
+    memcpy(&pkt->buf[pkt->len], value, len);
+    pkt->len += len;
+    pkt->last_opt = num;
+}
+
+// Unsigned option in the fewest bytes (0 is the empty value)
+static void coap_option_uint(coap_pkt_t *pkt, uint16_t num, uint32_t v)
+{
+    uint8_t b[4];
+    size_t n = 0;
+    for (int shift = 24; shift >= 0; shift -= 8)
+    {
+        if (n || (v >> shift) & 0xFF)
+            b[n++] = (uint8_t)(v >> shift);
+    }
+    coap_option(pkt, num, b, n);
+}
+
+// Start the payload; returns the room left for it
+static size_t coap_payload_start(coap_pkt_t *pkt)
+{
+    pkt->buf[pkt->len++] = 0xFF;
+    return COAP_TX_MAX - pkt->len;
+}
+
+static void coap_send(const coap_pkt_t *pkt, const struct sockaddr_in *to)
+{
+    if (sendto(s_sock, pkt->buf, pkt->len, 0, (const struct sockaddr *)to, sizeof(*to)) < 0)
+        s_stats.errors++;
+}
+
+// CBOR integer (major type 0 or 1)
+static size_t cbor_int(uint8_t *p, int64_t v)
+{
+    uint8_t major = v < 0 ? 0x20 : 0x00;
+    uint64_t u = v < 0 ? (uint64_t)(-1 - v) : (uint64_t)v;
+    if (u < 24)
+    {
+        p[0] = major | (uint8_t)u;
+        return 1;
+    }
+    int bytes = u <= 0xFF ? 1 : u <= 0xFFFF ? 2 : 4;
+    p[0] = major | (bytes == 1 ? 24 : bytes == 2 ? 25 : 26);
+    for (int i = 0; i < bytes; i++)
+        p[1 + i] = (uint8_t)(u >> (8 * (bytes - 1 - i)));
+    return 1 + bytes;
+}
+
+// Payload of /distance in @p format; returns its length
+static size_t coap_distance_payload(uint8_t *p, size_t room, uint16_t format)
+{
+    sample_t s = s_latest;
+    if (format == COAP_FORMAT_CBOR)
+    {
+        size_t n = 0;
+        p[n++] = 0x83; // Array of 3
+        n += cbor_int(&p[n], s.distance_cm);
+        n += cbor_int(&p[n], s.err);
+        n += cbor_int(&p[n], s.seq);
+        return n;
+    }
+    int n = snprintf((char *)p, room, "{\"d\":%lu,\"e\":%ld,\"seq\":%lu}", (unsigned long)s.distance_cm,
+                     (long)s.err, (unsigned long)s.seq);
+    return n < (int)room ? (size_t)n : room;
+}
+
+// Max-Age of /distance: until the next reading is due
+static uint32_t coap_max_age_s(void)
+{
+    return (config_get(CFG_SAMPLE_PERIOD_MS) + 999) / 1000;
+}
+
+static coap_observer_t *coap_find_observer(const struct sockaddr_in *from)
+{
+    for (int i = 0; i < CONFIG_FLORALINK_COAP_MAX_OBSERVERS; i++)
+    {
+        coap_observer_t *o = &s_obs[i];
+        if (o->used && o->addr.sin_addr.s_addr == from->sin_addr.s_addr && o->addr.sin_port == from->sin_port)
+            return o;
+    }
+    return NULL;
+}
+
+static void coap_drop_observer(coap_observer_t *o, const char *why)
+{
+    char ip[16];
+    inet_ntoa_r(o->addr.sin_addr, ip, sizeof(ip));
+    ESP_LOGI(TAG, "Observer %s:%u removed (%s)", ip, ntohs(o->addr.sin_port), why);
+    o->used = false;
+    s_stats.observers--;
+}
+
+// Register (or refresh) the observer of /distance; NULL when the table is full
+static coap_observer_t *coap_register(const coap_req_t *req, const struct sockaddr_in *from, uint16_t format)
+{
+    coap_observer_t *o = coap_find_observer(from);
+    for (int i = 0; !o && i < CONFIG_FLORALINK_COAP_MAX_OBSERVERS; i++)
+    {
+        if (!s_obs[i].used)
+        {
+            o = &s_obs[i];
+            memset(o, 0, sizeof(*o));
+            o->used = true;
+            o->addr = *from;
+            o->interval_ms = CONFIG_FLORALINK_COAP_MIN_INTERVAL_MS;
+            s_stats.observers++;
+        }
+    }
+    if (!o)
+        return NULL;
+    o->tkl = req->tkl;
+    memcpy(o->token, req->token, req->tkl);
+    o->format = format;
+    o->con_mode = strstr(req->query, "con=1") ? 1 : strstr(req->query, "con=0") ? 0 : -1;
+    o->pending = false;
+    o->next_us = esp_timer_get_time() + (int64_t)o->interval_ms * 1000;
+    return o;
+}
+
+// JSON writer into the payload of the packet being built
+typedef struct
+{
+    coap_pkt_t *pkt;
+} coap_writer_t;
+
+static esp_err_t coap_write_payload(void *ctx, const char *buf, size_t len)
+{
+    coap_pkt_t *pkt = ((coap_writer_t *)ctx)->pkt;
+    if (pkt->len + len > COAP_TX_MAX)
+        return ESP_ERR_NO_MEM;
+    memcpy(&pkt->buf[pkt->len], buf, len);
+    pkt->len += len;
+    return ESP_OK;
+}
+
+static void coap_handle_request(const coap_req_t *req, const struct sockaddr_in *from)
+{
+    coap_pkt_t pkt;
+    bool con = req->type == COAP_CON;
+    uint8_t type = con ? COAP_ACK : COAP_NON;
+    uint16_t mid = con ? req->mid : s_mid++;
+    s_stats.requests++;
+
+    if (req->bad_option)
+    {
+        coap_begin(&pkt, type, COAP_BAD_OPTION, mid, req->token, req->tkl);
+    }
+    else if (req->code != COAP_GET)
+    {
+        coap_begin(&pkt, type, COAP_NOT_ALLOWED, mid, req->token, req->tkl);
+    }
+    else if (strcmp(req->path, "/distance") == 0)
+    {
+        uint16_t format = req->accept == COAP_FORMAT_NONE ? COAP_FORMAT_JSON : req->accept;
+        if (format != COAP_FORMAT_JSON && format != COAP_FORMAT_CBOR)
+        {
+            coap_begin(&pkt, type, COAP_NOT_ACCEPTABLE, mid, req->token, req->tkl);
+            coap_send(&pkt, from);
+            return;
+        }
+        if (!s_have_latest && sample_bus_latest(&s_latest) == ESP_OK)
+            s_have_latest = true;
+        if (!s_have_latest)
+        {
+            coap_begin(&pkt, type, COAP_UNAVAILABLE, mid, req->token, req->tkl);
+            coap_option_uint(&pkt, COAP_OPT_MAX_AGE, coap_max_age_s());
+            coap_send(&pkt, from);
+            return;
+        }
+        coap_observer_t *o = NULL;
+        if (req->observe == 0)
+            o = coap_register(req, from, format);
+        else if (req->observe == 1 && (o = coap_find_observer(from)) != NULL)
+        {
+            coap_drop_observer(o, "deregistered");
+            o = NULL;
+        }
+        coap_begin(&pkt, type, COAP_CONTENT, mid, req->token, req->tkl);
+        if (o)
+            coap_option_uint(&pkt, COAP_OPT_OBSERVE, o->obs_seq++ & 0xFFFFFF);
+        coap_option_uint(&pkt, COAP_OPT_CONTENT_FORMAT, format);
+        coap_option_uint(&pkt, COAP_OPT_MAX_AGE, coap_max_age_s());
+        size_t room = coap_payload_start(&pkt);
+        pkt.len += coap_distance_payload(&pkt.buf[pkt.len], room, format);
+    }
+    else if (strcmp(req->path, "/stats") == 0)
+    {
+        coap_begin(&pkt, type, COAP_CONTENT, mid, req->token, req->tkl);
+        coap_option_uint(&pkt, COAP_OPT_CONTENT_FORMAT, COAP_FORMAT_JSON);
+        coap_payload_start(&pkt);
+        coap_writer_t w = {&pkt};
+        coap_server_export_json(coap_write_payload, &w);
+    }
+    else if (strcmp(req->path, "/.well-known/core") == 0)
+    {
+        static const char links[] = "</distance>;rt=\"distance\";obs;ct=\"50 60\",</stats>;ct=50";
+        coap_begin(&pkt, type, COAP_CONTENT, mid, req->token, req->tkl);
+        coap_option_uint(&pkt, COAP_OPT_CONTENT_FORMAT, COAP_FORMAT_LINK);
+        coap_payload_start(&pkt);
+        coap_writer_t w = {&pkt};
+        coap_write_payload(&w, links, sizeof(links) - 1);
+    }
+    else
+    {
+        coap_begin(&pkt, type, COAP_NOT_FOUND, mid, req->token, req->tkl);
+    }
+    coap_send(&pkt, from);
+}
+
+// Send the newest reading to @p o; a CON keeps the retransmission state of @p o
+static void coap_notify(coap_observer_t *o, bool con, int64_t now)
+{
+    coap_pkt_t pkt;
+    o->mid = s_mid++;
+    coap_begin(&pkt, con ? COAP_CON : COAP_NON, COAP_CONTENT, o->mid, o->token, o->tkl);
+    coap_option_uint(&pkt, COAP_OPT_OBSERVE, o->obs_seq++ & 0xFFFFFF);
+    coap_option_uint(&pkt, COAP_OPT_CONTENT_FORMAT, o->format);
+    coap_option_uint(&pkt, COAP_OPT_MAX_AGE, coap_max_age_s());
+    size_t room = coap_payload_start(&pkt);
+    pkt.len += coap_distance_payload(&pkt.buf[pkt.len], room, o->format);
+    coap_send(&pkt, &o->addr);
+    o->pending = false;
+    o->next_us = now + (int64_t)o->interval_ms * 1000;
+    if (con)
+        o->inflight = true;
+}
+
+static void coap_handle_reply(const coap_req_t *msg, const struct sockaddr_in *from)
+{
+    coap_observer_t *o = coap_find_observer(from);
+    if (!o || msg->mid != o->mid)
+        return;
+    if (msg->type == COAP_RST)
+    {
+        // The client forgot the observation (RFC 7641 3.6)
+        s_stats.dropped++;
+        coap_drop_observer(o, "reset");
+        return;
+    }
+    if (!o->inflight)
+        return;
+    o->inflight = false;
+    if (o->retries == 0 && o->interval_ms > CONFIG_FLORALINK_COAP_MIN_INTERVAL_MS)
+    {
+        // Acknowledged at the first attempt: the path has room, speed up again
+        uint32_t half = o->interval_ms / 2;
+        o->interval_ms = half > CONFIG_FLORALINK_COAP_MIN_INTERVAL_MS && half >= COAP_BACKOFF_MIN_MS / 2
+                             ? half
+                             : CONFIG_FLORALINK_COAP_MIN_INTERVAL_MS;
+        o->next_us = esp_timer_get_time() + (int64_t)o->interval_ms * 1000;
+    }
+}
+
+// Retransmissions and due notifications; returns the nearest deadline, INT64_MAX if none
+static int64_t coap_service_observers(int64_t now)
+{
+    int64_t next = INT64_MAX;
+    for (int i = 0; i < CONFIG_FLORALINK_COAP_MAX_OBSERVERS; i++)
+    {
+        coap_observer_t *o = &s_obs[i];
+        if (!o->used)
+            continue;
+        if (o->inflight && now >= o->deadline_us)
+        {
+            if (o->retries == COAP_MAX_RETRANSMIT)
+            {
+                s_stats.dropped++;
+                coap_drop_observer(o, "not acknowledged");
+                continue;
+            }
+            // Congestion or a lost client: slow this observer down, resend the newest state
+            o->retries++;
+            o->timeout_ms *= 2;
+            o->deadline_us = now + (int64_t)o->timeout_ms * 1000;
+            o->interval_ms = o->interval_ms * 2 < COAP_BACKOFF_MIN_MS ? COAP_BACKOFF_MIN_MS : o->interval_ms * 2;
+            if (o->interval_ms > COAP_MAX_INTERVAL_MS)
+                o->interval_ms = COAP_MAX_INTERVAL_MS;
+            s_stats.retransmits++;
+            coap_notify(o, true, now);
+        }
+        else if (!o->inflight && o->pending && now >= o->next_us)
+        {
+            o->sent++;
+            bool con = o->con_mode == 1 || (o->con_mode == -1 && CONFIG_FLORALINK_COAP_CON_EVERY > 0 &&
+                                             o->sent % CONFIG_FLORALINK_COAP_CON_EVERY == 0);
+            if (con)
+            {
+                o->retries = 0;
+                // Initial timeout randomized within [ACK_TIMEOUT, 1.5 x ACK_TIMEOUT]
+                o->timeout_ms = COAP_ACK_TIMEOUT_MS + esp_random() % (COAP_ACK_TIMEOUT_MS / 2 + 1);
+                o->deadline_us = now + (int64_t)o->timeout_ms * 1000;
+                s_stats.con++;
+            }
+            s_stats.notifications++;
+            coap_notify(o, con, now);
+        }
+        if (o->inflight && o->deadline_us < next)
+            next = o->deadline_us;
+        else if (!o->inflight && o->pending && o->next_us < next)
+            next = o->next_us;
+    }
+    return next;
+}
+
+// Take the new readings from the bus; only the newest is ever notified
+static void coap_take_samples(void)
+{
+    uint64_t count;
+    read(s_event_fd, &count, sizeof(count));
+    sample_t s;
+    bool any = false;
+    while (sample_bus_read(&s_sub, &s) == ESP_OK)
+    {
+        s_latest = s;
+        any = true;
+    }
+    if (!any)
+        return;
+    s_have_latest = true;
+    for (int i = 0; i < CONFIG_FLORALINK_COAP_MAX_OBSERVERS; i++)
+    {
+        if (!s_obs[i].used)
+            continue;
+        if (s_obs[i].pending)
+            s_stats.coalesced++;
+        s_obs[i].pending = true;
+    }
+}
+
+esp_err_t coap_server_init(void)
+{
+    esp_err_t err = esp_event_handler_register(LINK_EVENT, ESP_EVENT_ANY_ID, coap_link_handler, NULL);
+    if (err != ESP_OK)
+        return err;
+    s_link_up = wifi_is_connected();
+    coap_wake(NULL);
+    return ESP_OK;
+}
+
+// Open the socket once the link is up, close it when the link is gone
+static void coap_follow_link(void)
+{
+    if (s_link_up && s_sock < 0)
+    {
+        struct sockaddr_in addr = {
+            .sin_family = AF_INET,
+            .sin_port = htons(CONFIG_FLORALINK_COAP_PORT),
+            .sin_addr.s_addr = htonl(INADDR_ANY),
+        };
+        s_sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_IP);
+        if (s_sock >= 0 && bind(s_sock, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+        {
+            close(s_sock);
+            s_sock = -1;
+        }
+        if (s_sock < 0)
+            ESP_LOGE(TAG, "Cannot open UDP port %d (errno %d)", CONFIG_FLORALINK_COAP_PORT, errno);
+        else
+            ESP_LOGI(TAG, "Listening on UDP port %d", CONFIG_FLORALINK_COAP_PORT);
+    }
+    else if (!s_link_up && s_sock >= 0)
+    {
+        close(s_sock);
+        s_sock = -1;
+        for (int i = 0; i < CONFIG_FLORALINK_COAP_MAX_OBSERVERS; i++)
+        {
+            if (s_obs[i].used)
+                coap_drop_observer(&s_obs[i], "link down");
+        }
+        ESP_LOGI(TAG, "Link down, socket closed");
+    }
+}
+
+void coap_server_run(void)
+{
+    esp_vfs_eventfd_config_t efd_cfg = ESP_VFS_EVENTD_CONFIG_DEFAULT();
+    esp_err_t err = esp_vfs_eventfd_register(&efd_cfg);
+    if (err != ESP_OK && err != ESP_ERR_INVALID_STATE) // Already registered is fine
+        ESP_LOGE(TAG, "eventfd registration failed (%s)", esp_err_to_name(err));
+    s_event_fd = eventfd(0, 0);
+    if (s_event_fd < 0)
+    {
+        ESP_LOGE(TAG, "Cannot create the eventfd (errno %d)", errno);
+        vTaskDelete(NULL);
+    }
+    sample_bus_subscribe(&s_sub, false, false);
+
+    int64_t next = INT64_MAX;
+    for (;;)
+    {
+        coap_follow_link();
+        fd_set rfds;
+        FD_ZERO(&rfds);
+        if (s_sock >= 0)
+            FD_SET(s_sock, &rfds);
+        FD_SET(s_event_fd, &rfds);
+        struct timeval tv, *timeout = NULL;
+        if (next != INT64_MAX && s_sock >= 0)
+        {
+            int64_t left = next - esp_timer_get_time();
+            left = left > 0 ? left : 0;
+            tv.tv_sec = (time_t)(left / 1000000);
+            tv.tv_usec = (suseconds_t)(left % 1000000);
+            timeout = &tv;
+        }
+        int n = select((s_sock > s_event_fd ? s_sock : s_event_fd) + 1, &rfds, NULL, NULL, timeout);
+        if (n > 0 && FD_ISSET(s_event_fd, &rfds))
+            coap_take_samples();
+        if (n > 0 && s_sock >= 0 && FD_ISSET(s_sock, &rfds))
+        {
+            struct sockaddr_in from;
+            socklen_t from_len = sizeof(from);
+            int len = recvfrom(s_sock, s_rx, sizeof(s_rx), 0, (struct sockaddr *)&from, &from_len);
+            coap_req_t req;
+            if (len > 0 && coap_parse(s_rx, (size_t)len, &req))
+            {
+                if (req.type == COAP_ACK || req.type == COAP_RST)
+                    coap_handle_reply(&req, &from);
+                else if (req.code == COAP_EMPTY && req.type == COAP_CON)
+                {
+                    // CoAP ping: answered with a RST
+                    coap_pkt_t pkt;
+                    coap_begin(&pkt, COAP_RST, COAP_EMPTY, req.mid, req.token, 0);
+                    coap_send(&pkt, &from);
+                }
+                else if (req.code >= COAP_CODE(1, 0))
+                    s_stats.errors++; // A response sent to the server
+                else
+                    coap_handle_request(&req, &from);
+            }
+            else if (len > 0)
+            {
+                s_stats.errors++;
+            }
+        }
+        next = s_sock >= 0 ? coap_service_observers(esp_timer_get_time()) : INT64_MAX;
+    }
+}
+
+void coap_server_get_stats(coap_server_stats_t *stats)
+{
+    *stats = s_stats;
+}
+
+esp_err_t coap_server_export_json(trace_write_fn_t write, void *ctx)
+{
+    coap_server_stats_t st;
+    coap_server_get_stats(&st);
+    char buf[224];
+    int n = snprintf(buf, sizeof(buf),
+                     "{\"requests\":%lu,\"observers\":%lu,\"notifications\":%lu,\"con\":%lu,\"retransmits\":%lu,"
+                     "\"dropped\":%lu,\"coalesced\":%lu,\"errors\":%lu}",
+                     (unsigned long)st.requests, (unsigned long)st.observers, (unsigned long)st.notifications,
+                     (unsigned long)st.con, (unsigned long)st.retransmits, (unsigned long)st.dropped,
+                     (unsigned long)st.coalesced, (unsigned long)st.errors);
+    return write(ctx, buf, n);
+}
+
+#endif // CONFIG_FLORALINK_COAP
@@ -0,0 +1,72 @@
+/**
+ * @file coap_server.h
+ * @brief Minimal CoAP server (RFC 7252) with an observable distance resource (RFC 7641).
+ *
+ * For gateways that speak CoAP rather than HTTP. Runs next to esp_http_server on UDP port
+ * CONFIG_FLORALINK_COAP_PORT, in one task with a few hundred bytes of buffers: no
+ * connection state, no chunked responses, a 4-byte header per message.
+ *
+ * Resources (GET only):
+ * - /distance: latest reading. Observable: a GET with Observe=0 registers the client, which
+ *   then receives a notification for each new reading; Observe=1 or a RST deregisters it.
+ *   JSON (content-format 50) {"d":cm,"e":err,"seq":n}, or with Accept: 60 the CBOR array
+ *   [cm, err, seq] (6 to 10 bytes).
+ * - /stats: server counters (coap_server_export_json()), JSON.
+ * - /.well-known/core: resource discovery (link format).
+ *
+ * Notifications are non-confirmable, except every CONFIG_FLORALINK_COAP_CON_EVERY-th,
+ * which is confirmable to check that the observer is still there (RFC 7641 4.5).
+ * ?con=1 or ?con=0 on the registration makes all of that observer's notifications CON or
+ * NON. Pacing per observer:
+ * - at most one CON is in flight (NSTART = 1); readings taken meanwhile are folded into the
+ *   next notification, which always carries the newest state;
+ * - a CON that needs a retransmission doubles the observer's minimum notification interval
+ *   (up to 60 s), and each CON acknowledged at the first attempt halves it again, down to
+ *   CONFIG_FLORALINK_COAP_MIN_INTERVAL_MS;
+ * - an observer whose CON stays unacknowledged after 4 retransmissions is dropped.
+ */
+
+#ifndef COAP_SERVER_H
+#define COAP_SERVER_H
+
+#include <stdint.h>
+#include "esp_err.h"
+#include "trace.h"
+
+typedef struct
+{
+    uint32_t requests;      ///< Requests handled
+    uint32_t observers;     ///< Current observers
+    uint32_t notifications; ///< Notifications sent (first transmissions)
+    uint32_t con;           ///< ... of which confirmable
+    uint32_t retransmits;   ///< CON retransmissions
+    uint32_t dropped;       ///< Observers dropped (timeout or RST)
+    uint32_t coalesced;     ///< Readings not notified because a newer one superseded them
+    uint32_t errors;        ///< Malformed messages and send failures
+} coap_server_stats_t;
+
+/**
+ * @brief Follow LINK_EVENT: the server listens while the link is up. Call after wifi_setup().
+ */
+esp_err_t coap_server_init(void);
+
+/**
+ * @brief Body of the CoAP task: serve requests and notify observers. Never returns.
+ *        The socket is opened once coap_server_init() has seen the link come up.
+ */
+void coap_server_run(void);
+
+/**
+ * @brief Copy the request, observer and notification counters.
+ */
+void coap_server_get_stats(coap_server_stats_t *stats);
+
+/**
+ * @brief Stream the counters as JSON, for the /stats resource and the "coap" object of HTTP /stats.
+ * @param write Output callback (same contract as trace_export_json())
+ * @param ctx Opaque pointer passed to @p write
+ * @return ESP_OK on success, or the error returned by @p write.
+ */
+esp_err_t coap_server_export_json(trace_write_fn_t write, void *ctx);
+
+#endif // COAP_SERVER_H
@@ -0,0 +1,250 @@
+/**
+ * @file config_store.c
+ * @brief RAM-cached, NVS-backed configuration registry with write coalescing.
+ *
+ * config_set() only updates the cache, sets the key's dirty bit and wakes the config task,
+ * which writes the dirty keys once no change arrived for CONFIG_FLORALINK_CONFIG_COMMIT_DELAY_MS,
+ * or at the latest CFG_COMMIT_MAX_DEFER times that delay after the first pending change, so a
+ * form posted continuously is still saved. An NVS commit may erase a page, so it runs on that
+ * low-priority task of its own, never in an HTTP handler or on the shared scheduler task.
+ */
+
+#include "config_store.h"
+#include <stdatomic.h>
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <nvs.h>
+#include <nvs_flash.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "sdkconfig.h"
+#include "blink_config.h"
+#include "wifi_setup.h"
+
+#define CFG_NAMESPACE "floralink"
+#define CFG_COMMIT_DELAY_US ((int64_t)CONFIG_FLORALINK_CONFIG_COMMIT_DELAY_MS * 1000)
+#define CFG_COMMIT_MAX_DEFER 5 // Commit delays a continuously changing value may stay unsaved
+
+static const char *TAG = "ConfigStore";
+
+static const char *profile_name(uint32_t value)
+{
+    return wifi_profile_name((wifi_profile_t)value);
+}
+
+static const cfg_desc_t s_desc[CFG_KEY_COUNT] = {
+    [CFG_BLINK_PERIOD_MS] = {"blink_ms", "Blink period (ms)", CFG_TYPE_U32,
+                             CONFIG_BLINK_PERIOD, BLINK_PERIOD_MIN, BLINK_PERIOD_MAX},
+    [CFG_SAMPLE_PERIOD_MS] = {"sample_ms", "Sampling interval (ms)", CFG_TYPE_U32,
+                              CONFIG_FLORALINK_DISTANCE_PERIOD_MS, 50, 60000},
+    [CFG_FILTER_WINDOW] = {"filter_win", "Median filter (samples, 1 = off)", CFG_TYPE_U32, 1, 1, 9},
+    [CFG_FILTER_MAX_CM] = {"max_cm", "Maximum distance (cm)", CFG_TYPE_U32, 400, 2, 400},
+    [CFG_WIFI_PROFILE] = {"wifi_profile", "Wi-Fi power profile", CFG_TYPE_ENUM,
+#if CONFIG_FLORALINK_WIFI_PROFILE_PERFORMANCE
+                          WIFI_PROFILE_PERFORMANCE,
+#elif CONFIG_FLORALINK_WIFI_PROFILE_LOW_POWER
+                          WIFI_PROFILE_LOW_POWER,
+#elif CONFIG_FLORALINK_WIFI_PROFILE_BALANCED
+                          WIFI_PROFILE_BALANCED,
+#else
+                          WIFI_PROFILE_DEFAULT,
+#endif
+                          0, WIFI_PROFILE_COUNT - 1, profile_name},
+};
+
+static atomic_uint s_values[CFG_KEY_COUNT];
+static atomic_uint s_dirty; // CFG_BIT() mask of the keys changed since the last commit
+static bool s_loaded = false;
+static nvs_handle_t s_nvs = 0;
+static bool s_nvs_ok = false;
+static cfg_sub_t *s_subs = NULL;
+static portMUX_TYPE s_lock = portMUX_INITIALIZER_UNLOCKED;
+static int64_t s_first_change_us = 0; // First change not yet committed, 0 if none
+static int64_t s_last_change_us = 0;
+static cfg_stats_t s_stats = {0};
+static TaskHandle_t s_task = NULL; // Config task, woken by each change
+
+static uint32_t config_clamp(const cfg_desc_t *d, uint32_t value)
+{
+    if (value < d->min)
+        return d->min;
+    if (value > d->max)
+        return d->max;
+    return value;
+}
+
+// Defaults until config_init() has loaded the stored values
+static void config_load_defaults(void)
+{
+    for (int i = 0; i < CFG_KEY_COUNT; i++)
+        atomic_store(&s_values[i], config_clamp(&s_desc[i], s_desc[i].def));
+    s_loaded = true;
+}
+
+esp_err_t config_init(void)
+{
+    if (!s_loaded)
+        config_load_defaults();
+    esp_err_t err = nvs_flash_init();
+    if (err == ESP_ERR_NVS_NO_FREE_PAGES || err == ESP_ERR_NVS_NEW_VERSION_FOUND)
+    {
+        ESP_LOGW(TAG, "NVS partition unusable (%s), erasing", esp_err_to_name(err));
+        nvs_flash_erase();
+        err = nvs_flash_init();
+    }
+    if (err == ESP_OK)
+        err = nvs_open(CFG_NAMESPACE, NVS_READWRITE, &s_nvs);
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(TAG, "NVS unavailable (%s), using defaults", esp_err_to_name(err));
+        return err;
+    }
+    s_nvs_ok = true;
+
+    for (int i = 0; i < CFG_KEY_COUNT; i++)
+    {
+        uint32_t value;
+        if (nvs_get_u32(s_nvs, s_desc[i].name, &value) == ESP_OK)
+            atomic_store(&s_values[i], config_clamp(&s_desc[i], value));
+        ESP_LOGI(TAG, "%s = %lu", s_desc[i].name, (unsigned long)atomic_load(&s_values[i]));
+    }
+    return ESP_OK;
+}
+
+uint32_t config_get(cfg_key_t key)
+{
+    if ((unsigned)key >= CFG_KEY_COUNT)
+        return 0;
+    if (!s_loaded)
+        return config_clamp(&s_desc[key], s_desc[key].def);
+    return atomic_load_explicit(&s_values[key], memory_order_relaxed);
+}
+
+esp_err_t config_set(cfg_key_t key, uint32_t value)
+{
+    if ((unsigned)key >= CFG_KEY_COUNT)
+        return ESP_ERR_INVALID_ARG;
+    if (!s_loaded)
+        config_load_defaults();
+    value = config_clamp(&s_desc[key], value);
+    if (atomic_exchange(&s_values[key], value) == value)
+        return ESP_OK; // Unchanged: nothing to write or report
+
+    int64_t now = esp_timer_get_time();
+    portENTER_CRITICAL(&s_lock);
+    if (!s_first_change_us)
+        s_first_change_us = now;
+    s_last_change_us = now;
+    s_stats.sets++;
+    portEXIT_CRITICAL(&s_lock);
+    atomic_fetch_or(&s_dirty, CFG_BIT(key));
+    if (s_task)
+        xTaskNotifyGive(s_task);
+
+    for (cfg_sub_t *sub = s_subs; sub; sub = sub->next)
+    {
+        if (sub->keys & CFG_BIT(key))
+            sub->fn(key, value, sub->arg);
+    }
+    return ESP_OK;
+}
+
+void config_subscribe(cfg_sub_t *sub)
+{
+    portENTER_CRITICAL(&s_lock);
+    sub->next = s_subs;
+    s_subs = sub;
+    portEXIT_CRITICAL(&s_lock);
+}
+
+esp_err_t config_flush(void)
+{
+    if (!s_nvs_ok)
+        return ESP_ERR_INVALID_STATE;
+    uint32_t dirty = atomic_exchange(&s_dirty, 0);
+    if (!dirty)
+        return ESP_OK;
+    portENTER_CRITICAL(&s_lock);
+    s_first_change_us = 0;
+    portEXIT_CRITICAL(&s_lock);
+
+    uint32_t written = 0;
+    esp_err_t err = ESP_OK;
+    for (int i = 0; i < CFG_KEY_COUNT && err == ESP_OK; i++)
+    {
+        if (dirty & CFG_BIT(i))
+        {
+            err = nvs_set_u32(s_nvs, s_desc[i].name, atomic_load(&s_values[i]));
+            written++;
+        }
+    }
+    if (err == ESP_OK)
+        err = nvs_commit(s_nvs);
+
+    portENTER_CRITICAL(&s_lock);
+    if (err == ESP_OK)
+    {
+        s_stats.commits++;
+        s_stats.nvs_writes += written;
+    }
+    else
+    {
+        s_stats.errors++;
+        if (!s_first_change_us)
+            s_first_change_us = esp_timer_get_time();
+    }
+    portEXIT_CRITICAL(&s_lock);
+    if (err != ESP_OK)
+    {
+        // Keep the keys pending; the next commit retries them
+        atomic_fetch_or(&s_dirty, dirty);
+        ESP_LOGE(TAG, "Commit failed (%s)", esp_err_to_name(err));
+        return err;
+    }
+    ESP_LOGI(TAG, "Committed %lu setting(s)", (unsigned long)written);
+    return ESP_OK;
+}
+
+// Ticks until the pending changes are due for a commit: settled, or waited long enough
+static TickType_t config_ticks_until_commit(void)
+{
+    int64_t now = esp_timer_get_time();
+    portENTER_CRITICAL(&s_lock);
+    int64_t due = s_last_change_us + CFG_COMMIT_DELAY_US;
+    if (s_first_change_us && s_first_change_us + CFG_COMMIT_MAX_DEFER * CFG_COMMIT_DELAY_US < due)
+        due = s_first_change_us + CFG_COMMIT_MAX_DEFER * CFG_COMMIT_DELAY_US;
+    portEXIT_CRITICAL(&s_lock);
+    return due > now ? pdMS_TO_TICKS((due - now) / 1000) + 1 : 0;
+}
+
+void config_run(void)
+{
+    if (!s_nvs_ok)
+        vTaskDelete(NULL);
+    s_task = xTaskGetCurrentTaskHandle();
+    for (;;)
+    {
+        if (!atomic_load(&s_dirty))
+        {
+            ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+            continue;
+        }
+        TickType_t wait = config_ticks_until_commit();
+        if (wait)
+            ulTaskNotifyTake(pdTRUE, wait); // A change restarts the wait
+        else if (config_flush() != ESP_OK)
+            vTaskDelay(pdMS_TO_TICKS(CONFIG_FLORALINK_CONFIG_COMMIT_DELAY_MS)); // Retry after a pause
+    }
+}
+
+const cfg_desc_t *config_describe(cfg_key_t key)
+{
+    return (unsigned)key < CFG_KEY_COUNT ? &s_desc[key] : NULL;
+}
+
+void config_get_stats(cfg_stats_t *stats)
+{
+    portENTER_CRITICAL(&s_lock);
+    *stats = s_stats;
+    portEXIT_CRITICAL(&s_lock);
+}
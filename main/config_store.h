@@ -0,0 +1,125 @@
+/**
+ * @file config_store.h
+ * @brief Runtime configuration registry persisted in NVS.
+ *
+ * Every tunable that can change at runtime has a key in this registry, with a type, a range
+ * and a default. Values live in a RAM cache and are read without locking; a change is
+ * applied to the cache at once, reported to the subscribers of that key and written to NVS
+ * later: all changes made until the settings stay untouched for
+ * CONFIG_FLORALINK_CONFIG_COMMIT_DELAY_MS go out in a single NVS commit, so a burst of
+ * /configure posts costs one flash write instead of one per request.
+ *
+ * Usage Example:
+ * @code
+ *   static void on_change(cfg_key_t key, uint32_t value, void *arg) { ... }
+ *   static cfg_sub_t s_sub = CFG_SUB_INIT(on_change, NULL, CFG_BIT(CFG_SAMPLE_PERIOD_MS));
+ *   config_subscribe(&s_sub);
+ *   config_set(CFG_SAMPLE_PERIOD_MS, 500);
+ * @endcode
+ */
+
+#ifndef CONFIG_STORE_H
+#define CONFIG_STORE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+typedef enum
+{
+    CFG_BLINK_PERIOD_MS,  ///< LED blink period
+    CFG_SAMPLE_PERIOD_MS, ///< Interval between two ultrasonic measurements
+    CFG_FILTER_WINDOW,    ///< Median filter length in samples, 1 = off
+    CFG_FILTER_MAX_CM,    ///< Measurement range; farther echoes are reported as errors
+    CFG_WIFI_PROFILE,     ///< wifi_profile_t
+    CFG_KEY_COUNT
+} cfg_key_t;
+
+typedef enum
+{
+    CFG_TYPE_U32,  ///< Unsigned integer within [min, max]
+    CFG_TYPE_ENUM, ///< Named value in [0, max]
+} cfg_type_t;
+
+typedef struct
+{
+    const char *name;  ///< Form field and JSON name; also the NVS key (max 15 characters)
+    const char *label; ///< Human readable description
+    cfg_type_t type;
+    uint32_t def;
+    uint32_t min;
+    uint32_t max;
+    const char *(*value_name)(uint32_t value); ///< Name of a CFG_TYPE_ENUM value
+} cfg_desc_t;
+
+#define CFG_BIT(key) (1u << (key))
+
+typedef void (*cfg_notify_fn_t)(cfg_key_t key, uint32_t value, void *arg);
+
+typedef struct cfg_sub
+{
+    cfg_notify_fn_t fn;
+    void *arg;
+    uint32_t keys; ///< CFG_BIT() mask of the keys of interest
+    struct cfg_sub *next;
+} cfg_sub_t;
+
+#define CFG_SUB_INIT(sub_fn, sub_arg, sub_keys) {.fn = (sub_fn), .arg = (sub_arg), .keys = (sub_keys)}
+
+typedef struct
+{
+    uint32_t sets;       ///< Changes accepted (same-value writes excluded)
+    uint32_t commits;    ///< NVS commits
+    uint32_t nvs_writes; ///< Keys written by those commits
+    uint32_t errors;     ///< Failed commits (retried on the next one)
+} cfg_stats_t;
+
+/**
+ * @brief Initialise NVS and load the stored values. Call before any other module reads its
+ *        settings, and before Wi-Fi, which keeps its calibration in NVS; until then
+ *        config_get() returns the defaults.
+ * @return ESP_OK, or the NVS error (the defaults are used and nothing is persisted).
+ */
+esp_err_t config_init(void);
+
+/**
+ * @brief Body of the config task: commit the changes to NVS once they settled. Never returns;
+ *        deletes the task if config_init() could not open NVS.
+ */
+void config_run(void);
+
+/**
+ * @brief Cached value of @p key.
+ */
+uint32_t config_get(cfg_key_t key);
+
+/**
+ * @brief Change @p key: the value is clamped to the key's range, cached, reported to the
+ *        subscribers (in the caller's context) and queued for the next NVS commit.
+ * @return ESP_OK, or ESP_ERR_INVALID_ARG for an unknown key.
+ */
+esp_err_t config_set(cfg_key_t key, uint32_t value);
+
+/**
+ * @brief Register a change callback. @p sub needs static storage; it is never detached.
+ *
+ * Callbacks run in the task calling config_set() and must not block.
+ */
+void config_subscribe(cfg_sub_t *sub);
+
+/**
+ * @brief Write the pending changes now, e.g. before deep sleep.
+ */
+esp_err_t config_flush(void);
+
+/**
+ * @brief Type, range and default of @p key, NULL for an unknown key.
+ */
+const cfg_desc_t *config_describe(cfg_key_t key);
+
+/**
+ * @brief Copy the write coalescing counters.
+ */
+void config_get_stats(cfg_stats_t *stats);
+
+#endif // CONFIG_STORE_H
@@ -12,33 +12,42 @@
  */
 
 #include "distance.h"
-#include "webserver/webserver.h"
+#include <stdbool.h>
+#include "profile.h"
+#include "dlog.h"
+#include "sample_bus.h"
+#include "modemanager.h"
+#include "config_store.h"
 #include "hcsr04_driver.h"
 #include "esp_log.h"
 
 static const char *TAG = "Ultrasonic";
+static pm_lock_t s_pm_lock = NULL;
+static sample_sub_t s_log_sub = SAMPLE_SUB_INIT("log");
+static uint32_t s_log_lost = 0;
 
-void distance_publish(pub_t publisher, uint32_t distance)
-{
-    if (publisher == PUB_LOG)
-    {
-        ESP_LOGI(TAG, "Measured distance: %d cm", distance);
-    }
-    else if (publisher == PUB_WEBSERVER)
-    {
-        webserver_publish_distance(distance);
-    }
-}
+#define FILTER_WINDOW_MAX 9 // Upper bound of CFG_FILTER_WINDOW
+
+static uint32_t s_history[FILTER_WINDOW_MAX];
+static uint32_t s_history_len = 0;
+static uint32_t s_history_pos = 0;
 
-void distance_publish_err(pub_t publisher, esp_err_t result)
+void distance_log_samples(void)
 {
-    if (publisher == PUB_LOG)
+    sample_t s;
+    while (sample_bus_read(&s_log_sub, &s) == ESP_OK)
     {
-        ESP_LOGE(TAG, "Failed to measure distance: %s, code: 0x%X", esp_err_to_name(result), result);
+        if (s.seq == 1)
+            DLOGI(TAG, "First sample %lld us after start", (long long)s.ts_us);
+        if (s.err == ESP_OK)
+            DLOGD(TAG, "Measured distance: %u cm", (unsigned)s.distance_cm);
+        else
+            DLOGE(TAG, "Failed to measure distance: %s, code: 0x%X", esp_err_to_name(s.err), (unsigned)s.err);
     }
-    else if (publisher == PUB_WEBSERVER)
+    if (s_log_sub.lost != s_log_lost)
     {
-        webserver_publish_error((int32_t)result);
+        DLOGW(TAG, "%u samples not logged (bus overrun)", (unsigned)(s_log_sub.lost - s_log_lost));
+        s_log_lost = s_log_sub.lost;
     }
 }
 
@@ -50,7 +59,15 @@ void distance_publish_err(pub_t publisher, esp_err_t result)
  */
 esp_err_t distance_init(void)
 {
-    return UltrasonicInit();
+    // May run twice: from the deep sleep wake path, then from the full boot
+    static bool s_initialized = false;
+    if (s_initialized)
+        return ESP_OK;
+    sample_bus_subscribe(&s_log_sub, false, true);
+    s_pm_lock = modemanager_pm_lock_create("ultrasonic");
+    esp_err_t err = UltrasonicInit();
+    s_initialized = err == ESP_OK;
+    return err;
 }
 
 /**
@@ -63,5 +80,35 @@ esp_err_t distance_init(void)
  */
 esp_err_t distance_measure(uint32_t max_distance, uint32_t *distance_cm)
 {
+    // The driver's ultrasonic_measure_raw() is private; it is the whole cost of this call
+    PROF_SCOPE("ultrasonic_measure_raw");
+    // Echo timing is busy-waited; keep the CPU at full speed and awake for the whole ping
+    PM_LOCK_SCOPE(s_pm_lock);
     return UltrasonicMeasure(max_distance, distance_cm);
 }
+
+uint32_t distance_filter(uint32_t distance_cm)
+{
+    s_history[s_history_pos] = distance_cm;
+    s_history_pos = (s_history_pos + 1) % FILTER_WINDOW_MAX;
+    if (s_history_len < FILTER_WINDOW_MAX)
+        s_history_len++;
+
+    uint32_t window = config_get(CFG_FILTER_WINDOW);
+    if (window > s_history_len)
+        window = s_history_len;
+    if (window <= 1)
+        return distance_cm;
+
+    // Insertion sort of the newest readings; at most 9 of them
+    uint32_t sorted[FILTER_WINDOW_MAX];
+    for (uint32_t i = 0; i < window; i++)
+    {
+        uint32_t v = s_history[(s_history_pos + FILTER_WINDOW_MAX - 1 - i) % FILTER_WINDOW_MAX];
+        uint32_t j = i;
+        for (; j > 0 && sorted[j - 1] > v; j--)
+            sorted[j] = sorted[j - 1];
+        sorted[j] = v;
+    }
+    return sorted[window / 2];
+}
@@ -28,15 +28,6 @@
 #include <stdint.h>
 #include "esp_err.h"
 
-typedef enum
-{
-    PUB_LOG,
-    PUB_WEBSERVER
-} pub_t;
-
-void distance_publish(pub_t publisher, uint32_t distance);
-void distance_publish_err(pub_t publisher, esp_err_t result);
-
 /**
  * @brief Initialize the ultrasonic sensor hardware.
  * @return ESP_OK on success, error code otherwise.
@@ -51,4 +42,22 @@ esp_err_t distance_init(void);
  */
 esp_err_t distance_measure(uint32_t max_distance, uint32_t *distance_cm);
 
+/**
+ * @brief Median of the last valid readings, including @p distance_cm.
+ *
+ * The window length is the CFG_FILTER_WINDOW setting (1 returns @p distance_cm unchanged).
+ * Only the sampling task may call this; failed measurements should not be passed in.
+ * @param distance_cm Newest valid reading (in cm)
+ * @return Filtered distance (in cm)
+ */
+uint32_t distance_filter(uint32_t distance_cm);
+
+/**
+ * @brief Log the samples published on the sample bus since the last call.
+ *
+ * Errors are logged as errors, distances at debug level. Called periodically from a
+ * scheduler job, so logging never runs in the sampling task.
+ */
+void distance_log_samples(void);
+
 #endif // DISTANCE_H
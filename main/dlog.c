@@ -0,0 +1,291 @@
+/**
+ * @file dlog.c
+ * @brief Lock-free record ring and background formatter for the deferred logger.
+ *
+ * The ring is a bounded multi-producer/single-consumer queue: every slot carries a sequence
+ * number (the lap base of the position it is free for, +1 once published). Producers claim a
+ * slot with one compare-and-swap on the write index and publish it by bumping the sequence.
+ * A producer preempted half-way (by an ISR or the other core) never blocks the others; the
+ * consumer simply stops at that slot until it is published.
+ *
+ * The consumer expands each record with a small printf interpreter that formats one
+ * conversion at a time from the captured arguments, writes the line through esp_log_write()
+ * and keeps a copy in a text tail buffer that backs the /logs endpoint.
+ *
+ * Configuration:
+ * - CONFIG_FLORALINK_DLOG_SLOTS: ring depth (power of two).
+ * - CONFIG_FLORALINK_DLOG_TAIL_SIZE: bytes of formatted history kept for /logs.
+ */
+
+#include "dlog.h"
+
+#if CONFIG_FLORALINK_DLOG
+
+#include <stdatomic.h>
+#include <stdio.h>
+#include <string.h>
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+
+#define DLOG_SLOTS CONFIG_FLORALINK_DLOG_SLOTS
+#define DLOG_MASK (DLOG_SLOTS - 1)
+#define DLOG_LAP(pos) ((pos) & ~(unsigned)DLOG_MASK)
+#define DLOG_LINE_MAX 192
+
+_Static_assert((DLOG_SLOTS & DLOG_MASK) == 0, "CONFIG_FLORALINK_DLOG_SLOTS must be a power of two");
+
+typedef struct
+{
+    atomic_uint seq;
+    uint8_t level;
+    uint8_t nargs;
+    uint32_t ts_ms;
+    const char *tag;
+    const char *fmt;
+    dlog_arg_t args[DLOG_MAX_ARGS];
+} dlog_slot_t;
+
+static dlog_slot_t s_slots[DLOG_SLOTS];
+static atomic_uint s_write_pos;
+static uint32_t s_read_pos;
+static atomic_uint s_dropped;
+static atomic_bool s_consumer_waiting;
+static TaskHandle_t s_consumer = NULL;
+static uint32_t s_dropped_reported = 0;
+
+static char s_tail[CONFIG_FLORALINK_DLOG_TAIL_SIZE];
+static size_t s_tail_head = 0; // Next write position
+static bool s_tail_wrapped = false;
+static SemaphoreHandle_t s_tail_lock = NULL;
+
+void dlog_write(esp_log_level_t level, const char *tag, const char *fmt, int nargs, const dlog_arg_t *args)
+{
+    dlog_slot_t *slot;
+    unsigned pos = atomic_load_explicit(&s_write_pos, memory_order_relaxed);
+    for (;;)
+    {
+        slot = &s_slots[pos & DLOG_MASK];
+        unsigned seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+        int diff = (int)(seq - DLOG_LAP(pos));
+        if (diff == 0)
+        {
+            if (atomic_compare_exchange_weak_explicit(&s_write_pos, &pos, pos + 1,
+                                                      memory_order_relaxed, memory_order_relaxed))
+                break;
+        }
+        else if (diff < 0)
+        {
+            // Slot still holds last lap's record: ring full
+            atomic_fetch_add_explicit(&s_dropped, 1, memory_order_relaxed);
+            return;
+        }
+        else
+        {
+            pos = atomic_load_explicit(&s_write_pos, memory_order_relaxed);
+        }
+    }
+
+    slot->level = (uint8_t)level;
+    slot->nargs = (uint8_t)(nargs > DLOG_MAX_ARGS ? DLOG_MAX_ARGS : nargs);
+    slot->ts_ms = esp_log_timestamp();
+    slot->tag = tag;
+    slot->fmt = fmt;
+    for (int i = 0; i < slot->nargs; i++)
+        slot->args[i] = args[i];
+    atomic_store_explicit(&slot->seq, DLOG_LAP(pos) + 1, memory_order_release);
+
+    // Only pay for a notification when the formatter is actually asleep
+    if (atomic_load_explicit(&s_consumer_waiting, memory_order_relaxed) &&
+        atomic_exchange(&s_consumer_waiting, false) && s_consumer)
+    {
+        if (xPortInIsrContext())
+        {
+            BaseType_t woken = pdFALSE;
+            vTaskNotifyGiveFromISR(s_consumer, &woken);
+            portYIELD_FROM_ISR(woken);
+        }
+        else
+        {
+            xTaskNotifyGive(s_consumer);
+        }
+    }
+}
+
+// Format a single record into @p line, one conversion specification at a time
+static void dlog_format(const dlog_slot_t *slot, char *line, size_t size)
+{
+    const char *f = slot->fmt;
+    size_t n = 0;
+    int arg = 0;
+    while (*f && n < size - 1)
+    {
+        if (*f != '%')
+        {
+            line[n++] = *f++;
+            continue;
+        }
+        if (f[1] == '%')
+        {
+            line[n++] = '%';
+            f += 2;
+            continue;
+        }
+        // Copy "%[flags][width][.prec][length]conv" into spec
+        char spec[16];
+        size_t s = 0;
+        bool is_ll = false, is_l = false;
+        spec[s++] = *f++;
+        while (*f && strchr("-+ #0123456789.*hlLzjt", *f) && s < sizeof(spec) - 2)
+        {
+            if (*f == 'l')
+            {
+                is_ll = is_l;
+                is_l = true;
+            }
+            spec[s++] = *f++;
+        }
+        if (!*f)
+            break;
+        char conv = *f++;
+        spec[s++] = conv;
+        spec[s] = '\0';
+
+        dlog_arg_t a = arg < slot->nargs ? slot->args[arg] : (dlog_arg_t){.i = 0};
+        arg++;
+        int w;
+        switch (conv)
+        {
+        case 'f':
+        case 'F':
+        case 'e':
+        case 'E':
+        case 'g':
+        case 'G':
+        case 'a':
+        case 'A':
+            w = snprintf(line + n, size - n, spec, a.d);
+            break;
+        case 's':
+            w = snprintf(line + n, size - n, spec, a.p ? (const char *)a.p : "(null)");
+            break;
+        case 'p':
+            w = snprintf(line + n, size - n, spec, a.p);
+            break;
+        default:
+            if (is_ll)
+                w = snprintf(line + n, size - n, spec, (long long)a.i);
+            else if (is_l)
+                w = snprintf(line + n, size - n, spec, (long)a.i);
+            else
+                w = snprintf(line + n, size - n, spec, (int)a.i);
+            break;
+        }
+        if (w < 0)
+            break;
+        n += (size_t)w < size - n ? (size_t)w : size - n - 1;
+    }
+    line[n] = '\0';
+}
+
+static void dlog_tail_append(const char *text, size_t len)
+{
+    if (xSemaphoreTake(s_tail_lock, portMAX_DELAY) != pdTRUE)
+        return;
+    for (size_t i = 0; i < len; i++)
+    {
+        s_tail[s_tail_head++] = text[i];
+        if (s_tail_head == sizeof(s_tail))
+        {
+            s_tail_head = 0;
+            s_tail_wrapped = true;
+        }
+    }
+    xSemaphoreGive(s_tail_lock);
+}
+
+static void dlog_emit(esp_log_level_t level, uint32_t ts_ms, const char *tag, const char *text)
+{
+    static const char letters[] = "NEWIDV";
+    char out[DLOG_LINE_MAX + 48];
+    int n = snprintf(out, sizeof(out), "%c (%lu) %s: %s\n",
+                     letters[level < sizeof(letters) - 1 ? level : 0], (unsigned long)ts_ms, tag, text);
+    if (n < 0)
+        return;
+    if (n >= (int)sizeof(out))
+        n = sizeof(out) - 1;
+    esp_log_write(level, tag, "%s", out);
+    dlog_tail_append(out, n);
+}
+
+void dlog_process(TickType_t wait)
+{
+    if (s_consumer == NULL)
+    {
+        s_consumer = xTaskGetCurrentTaskHandle();
+        s_tail_lock = xSemaphoreCreateMutex();
+    }
+    char line[DLOG_LINE_MAX];
+    for (;;)
+    {
+        dlog_slot_t *slot = &s_slots[s_read_pos & DLOG_MASK];
+        if (atomic_load_explicit(&slot->seq, memory_order_acquire) != DLOG_LAP(s_read_pos) + 1)
+            break;
+        dlog_format(slot, line, sizeof(line));
+        esp_log_level_t level = slot->level;
+        uint32_t ts_ms = slot->ts_ms;
+        const char *tag = slot->tag;
+        // Hand the slot back to producers before the (slow) UART write
+        atomic_store_explicit(&slot->seq, DLOG_LAP(s_read_pos) + DLOG_SLOTS, memory_order_release);
+        s_read_pos++;
+        dlog_emit(level, ts_ms, tag, line);
+    }
+
+    uint32_t dropped = atomic_load(&s_dropped);
+    if (dropped != s_dropped_reported)
+    {
+        snprintf(line, sizeof(line), "%lu records dropped (ring full)", (unsigned long)(dropped - s_dropped_reported));
+        s_dropped_reported = dropped;
+        dlog_emit(ESP_LOG_WARN, esp_log_timestamp(), "dlog", line);
+    }
+
+    atomic_store(&s_consumer_waiting, true);
+    // Re-check after announcing the wait so a record published in between is not missed
+    if (atomic_load_explicit(&s_slots[s_read_pos & DLOG_MASK].seq, memory_order_acquire) == DLOG_LAP(s_read_pos) + 1)
+    {
+        atomic_store(&s_consumer_waiting, false);
+        return;
+    }
+    ulTaskNotifyTake(pdTRUE, wait);
+    atomic_store(&s_consumer_waiting, false);
+}
+
+uint32_t dlog_get_dropped(void)
+{
+    return atomic_load(&s_dropped);
+}
+
+size_t dlog_tail(char *out, size_t out_size)
+{
+    if (!out || out_size == 0)
+        return 0;
+    out[0] = '\0';
+    if (!s_tail_lock || xSemaphoreTake(s_tail_lock, portMAX_DELAY) != pdTRUE)
+        return 0;
+    size_t n = 0;
+    if (s_tail_wrapped)
+    {
+        // Skip the partial line at the wrap point
+        size_t start = s_tail_head;
+        while (start < sizeof(s_tail) && s_tail[start] != '\n')
+            start++;
+        for (size_t i = start + 1; i < sizeof(s_tail) && n < out_size - 1; i++)
+            out[n++] = s_tail[i];
+    }
+    for (size_t i = 0; i < s_tail_head && n < out_size - 1; i++)
+        out[n++] = s_tail[i];
+    out[n] = '\0';
+    xSemaphoreGive(s_tail_lock);
+    return n;
+}
+
+#endif // CONFIG_FLORALINK_DLOG
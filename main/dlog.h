@@ -0,0 +1,108 @@
+/**
+ * @file dlog.h
+ * @brief Deferred binary logging for hot paths.
+ *
+ * DLOGx() call sites only store the format-string pointer, the tag and up to four raw
+ * arguments into a lock-free ring; a low-priority task (see tasks.c) does the printf-style
+ * formatting and the UART write later. When the ring is full the record is dropped and
+ * counted instead of blocking the caller.
+ *
+ * Supported arguments are integers, float/double and pointers to strings that outlive the
+ * call (literals, esp_err_to_name(), ...): only the pointer is captured.
+ *
+ * Without CONFIG_FLORALINK_DLOG the macros fall back to the matching ESP_LOGx().
+ *
+ * Usage Example:
+ * @code
+ *   DLOGI(TAG, "CPU Load: %.2f%%", load * 100);
+ * @endcode
+ */
+
+#ifndef DLOG_H
+#define DLOG_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "esp_log.h"
+#include "sdkconfig.h"
+#include "freertos/FreeRTOS.h"
+
+#define DLOG_MAX_ARGS 4
+
+#if CONFIG_FLORALINK_DLOG
+
+typedef union
+{
+    int64_t i;
+    double d;
+    const void *p;
+} dlog_arg_t;
+
+static inline dlog_arg_t dlog_arg_i(long long v) { return (dlog_arg_t){.i = v}; }
+static inline dlog_arg_t dlog_arg_f(double v) { return (dlog_arg_t){.d = v}; }
+static inline dlog_arg_t dlog_arg_p(const void *v) { return (dlog_arg_t){.p = v}; }
+
+/**
+ * @brief Queue one record (task or ISR context). Use the DLOGx() macros instead.
+ */
+void dlog_write(esp_log_level_t level, const char *tag, const char *fmt, int nargs, const dlog_arg_t *args);
+
+/**
+ * @brief Format and print every queued record, then wait up to @p wait for more.
+ *
+ * Meant to be the body of the logger task loop.
+ */
+void dlog_process(TickType_t wait);
+
+/**
+ * @brief Number of records dropped because the ring was full.
+ */
+uint32_t dlog_get_dropped(void);
+
+/**
+ * @brief Copy the most recent formatted output (oldest first, NUL-terminated).
+ * @return Number of characters copied, excluding the terminator.
+ */
+size_t dlog_tail(char *out, size_t out_size);
+
+#define DLOG_CAT_(a, b) a##b
+#define DLOG_CAT(a, b) DLOG_CAT_(a, b)
+#define DLOG_NARGS_(_0, _1, _2, _3, _4, _5, _6, N, ...) N
+#define DLOG_NARGS(...) DLOG_NARGS_(0 __VA_OPT__(, ) __VA_ARGS__, 6, 5, 4, 3, 2, 1, 0)
+#define DLOG_ARG(x) _Generic((x),          \
+    float: dlog_arg_f,                     \
+    double: dlog_arg_f,                    \
+    char *: dlog_arg_p,                    \
+    const char *: dlog_arg_p,              \
+    void *: dlog_arg_p,                    \
+    const void *: dlog_arg_p,              \
+    default: dlog_arg_i)(x)
+#define DLOG_PACK_0()
+#define DLOG_PACK_1(a) DLOG_ARG(a),
+#define DLOG_PACK_2(a, b) DLOG_ARG(a), DLOG_ARG(b),
+#define DLOG_PACK_3(a, b, c) DLOG_ARG(a), DLOG_ARG(b), DLOG_ARG(c),
+#define DLOG_PACK_4(a, b, c, d) DLOG_ARG(a), DLOG_ARG(b), DLOG_ARG(c), DLOG_ARG(d),
+#define DLOG_PACK_N(n, ...) DLOG_CAT(DLOG_PACK_, n)(__VA_ARGS__)
+
+#define DLOG(level, tag, fmt, ...)                                         \
+    dlog_write((level), (tag), (fmt), DLOG_NARGS(__VA_ARGS__),             \
+               (const dlog_arg_t[]){DLOG_PACK_N(DLOG_NARGS(__VA_ARGS__),   \
+                                                __VA_ARGS__){.i = 0}})
+
+#define DLOGE(tag, fmt, ...) DLOG(ESP_LOG_ERROR, tag, fmt __VA_OPT__(, ) __VA_ARGS__)
+#define DLOGW(tag, fmt, ...) DLOG(ESP_LOG_WARN, tag, fmt __VA_OPT__(, ) __VA_ARGS__)
+#define DLOGI(tag, fmt, ...) DLOG(ESP_LOG_INFO, tag, fmt __VA_OPT__(, ) __VA_ARGS__)
+#define DLOGD(tag, fmt, ...) DLOG(ESP_LOG_DEBUG, tag, fmt __VA_OPT__(, ) __VA_ARGS__)
+
+#else
+
+#define DLOGE(tag, fmt, ...) ESP_LOGE(tag, fmt __VA_OPT__(, ) __VA_ARGS__)
+#define DLOGW(tag, fmt, ...) ESP_LOGW(tag, fmt __VA_OPT__(, ) __VA_ARGS__)
+#define DLOGI(tag, fmt, ...) ESP_LOGI(tag, fmt __VA_OPT__(, ) __VA_ARGS__)
+#define DLOGD(tag, fmt, ...) ESP_LOGD(tag, fmt __VA_OPT__(, ) __VA_ARGS__)
+
+#endif // CONFIG_FLORALINK_DLOG
+
+#endif // DLOG_H
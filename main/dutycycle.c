@@ -0,0 +1,171 @@
+/**
+ * @file dutycycle.c
+ * @brief Deep sleep wake path and RTC-memory sample batch.
+ *
+ * The wake path runs in app_main() before any task, network or server is created: it
+ * initializes only the ultrasonic sensor, takes one reading and decides whether the network
+ * is needed. The batch is a ring in RTC slow memory, which survives deep sleep but not a
+ * power loss; when it is full the oldest reading is overwritten (and an upload forced).
+ *
+ * Wake-to-sleep time is taken from esp_timer just before esp_deep_sleep_start(), i.e. it
+ * covers the application from its start, not the ROM and second stage bootloader. Enabling
+ * CONFIG_BOOTLOADER_SKIP_VALIDATE_IN_DEEP_SLEEP shortens the latter.
+ */
+
+#include "dutycycle.h"
+
+#if CONFIG_FLORALINK_DUTY_CYCLE
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "distance.h"
+#include "modemanager.h"
+#include "esp_attr.h"
+#include "esp_log.h"
+#include "esp_sleep.h"
+#include "esp_timer.h"
+
+#define DUTY_BATCH_SIZE CONFIG_FLORALINK_DUTY_BATCH_SIZE
+
+static const char *TAG = "DutyCycle";
+
+typedef struct
+{
+    uint32_t wakes;            ///< Timer wakes since power-on
+    uint32_t uploads;          ///< Wakes that brought the network up
+    uint32_t head;             ///< Next batch slot to write
+    uint32_t count;
+    uint32_t overwritten;      ///< Readings lost because the batch was full
+    int32_t last_distance_cm;  ///< Previous valid reading, -1 if none
+    int32_t pending;           ///< Slot whose awake_us is filled in at sleep, -1 if none
+    uint32_t awake_us_max;
+    uint64_t awake_us_total;
+    uint32_t cycles;           ///< Cycles accounted in awake_us_total
+    duty_sample_t batch[DUTY_BATCH_SIZE];
+} duty_rtc_t;
+
+static RTC_DATA_ATTR duty_rtc_t s_rtc = {.last_distance_cm = -1, .pending = -1};
+static esp_timer_handle_t s_online_timer = NULL;
+
+// Record the cycle's awake time and enter deep sleep until the next reading
+static void duty_sleep(void)
+{
+    uint32_t awake_us = (uint32_t)esp_timer_get_time();
+    if (s_rtc.pending >= 0)
+        s_rtc.batch[s_rtc.pending].awake_us = awake_us;
+    s_rtc.pending = -1;
+    if (awake_us > s_rtc.awake_us_max)
+        s_rtc.awake_us_max = awake_us;
+    s_rtc.awake_us_total += awake_us;
+    s_rtc.cycles++;
+    esp_sleep_enable_timer_wakeup((uint64_t)CONFIG_FLORALINK_DUTY_PERIOD_S * 1000000ULL);
+    modemanager_deep_sleep();
+}
+
+static bool duty_threshold_crossed(int32_t previous, uint32_t current)
+{
+#if CONFIG_FLORALINK_DUTY_THRESHOLD_CM > 0
+    if (previous < 0)
+        return false;
+    return ((uint32_t)previous < CONFIG_FLORALINK_DUTY_THRESHOLD_CM) != (current < CONFIG_FLORALINK_DUTY_THRESHOLD_CM);
+#else
+    return false;
+#endif
+}
+
+void dutycycle_wake(void)
+{
+    if (esp_sleep_get_wakeup_cause() != ESP_SLEEP_WAKEUP_TIMER)
+    {
+        ESP_LOGI(TAG, "Cold boot, %lu readings in batch", (unsigned long)s_rtc.count);
+        return;
+    }
+    s_rtc.wakes++;
+
+    uint32_t distance = 0;
+    esp_err_t err = distance_init();
+    if (err == ESP_OK)
+        err = distance_measure(400, &distance);
+
+    bool full = s_rtc.count == DUTY_BATCH_SIZE;
+    if (full)
+        s_rtc.overwritten++;
+    else
+        s_rtc.count++;
+    duty_sample_t *slot = &s_rtc.batch[s_rtc.head];
+    slot->t_s = (uint32_t)time(NULL);
+    slot->distance_cm = err == ESP_OK ? distance : 0;
+    slot->err = (int32_t)err;
+    slot->awake_us = 0;
+    s_rtc.pending = (int32_t)s_rtc.head;
+    s_rtc.head = (s_rtc.head + 1) % DUTY_BATCH_SIZE;
+
+    bool crossed = err == ESP_OK && duty_threshold_crossed(s_rtc.last_distance_cm, distance);
+    if (err == ESP_OK)
+        s_rtc.last_distance_cm = (int32_t)distance;
+
+    if (crossed || full || s_rtc.wakes % CONFIG_FLORALINK_DUTY_UPLOAD_EVERY == 0)
+    {
+        s_rtc.uploads++;
+        ESP_LOGI(TAG, "Wake %lu: upload (%s)", (unsigned long)s_rtc.wakes,
+                 crossed ? "threshold" : full ? "batch full" : "schedule");
+        return;
+    }
+    duty_sleep();
+}
+
+static void online_timer_cb(void *arg)
+{
+    ESP_LOGI(TAG, "Online window over, sleeping %d s", CONFIG_FLORALINK_DUTY_PERIOD_S);
+    duty_sleep();
+}
+
+void dutycycle_online(void)
+{
+    const esp_timer_create_args_t args = {
+        .callback = online_timer_cb,
+        .name = "duty_online"};
+    if (s_online_timer == NULL && esp_timer_create(&args, &s_online_timer) != ESP_OK)
+    {
+        ESP_LOGE(TAG, "esp_timer_create failed, staying awake");
+        return;
+    }
+    esp_timer_start_once(s_online_timer, (uint64_t)CONFIG_FLORALINK_DUTY_ONLINE_S * 1000000ULL);
+}
+
+void dutycycle_ack(void)
+{
+    s_rtc.count = 0;
+    s_rtc.head = 0;
+    s_rtc.pending = -1;
+}
+
+esp_err_t dutycycle_export_json(trace_write_fn_t write, void *ctx)
+{
+    char buf[160];
+    int n = snprintf(buf, sizeof(buf),
+                     "{\"wakes\":%lu,\"uploads\":%lu,\"overwritten\":%lu,\"period_s\":%d,"
+                     "\"awake_us_avg\":%lu,\"awake_us_max\":%lu,\"samples\":[",
+                     (unsigned long)s_rtc.wakes, (unsigned long)s_rtc.uploads, (unsigned long)s_rtc.overwritten,
+                     CONFIG_FLORALINK_DUTY_PERIOD_S,
+                     (unsigned long)(s_rtc.cycles ? s_rtc.awake_us_total / s_rtc.cycles : 0),
+                     (unsigned long)s_rtc.awake_us_max);
+    esp_err_t err = write(ctx, buf, n);
+    // Oldest first
+    uint32_t start = (s_rtc.head + DUTY_BATCH_SIZE - s_rtc.count) % DUTY_BATCH_SIZE;
+    for (uint32_t i = 0; i < s_rtc.count && err == ESP_OK; i++)
+    {
+        const duty_sample_t *s = &s_rtc.batch[(start + i) % DUTY_BATCH_SIZE];
+        n = snprintf(buf, sizeof(buf), "%s{\"t\":%lu,\"distance\":%lu,\"error\":%ld,\"awake_us\":%lu}",
+                     i ? "," : "", (unsigned long)s->t_s, (unsigned long)s->distance_cm, (long)s->err,
+                     (unsigned long)s->awake_us);
+        err = write(ctx, buf, n);
+    }
+    if (err == ESP_OK)
+        err = write(ctx, "]}\n", 3);
+    return err;
+}
+
+#endif // CONFIG_FLORALINK_DUTY_CYCLE
@@ -0,0 +1,67 @@
+/**
+ * @file dutycycle.h
+ * @brief Duty-cycled deep sleep sensing with a sample batch in RTC memory.
+ *
+ * With CONFIG_FLORALINK_DUTY_CYCLE the node spends its life in deep sleep. On each RTC timer
+ * wake it takes one reading, appends it to a batch kept in RTC slow memory and goes straight
+ * back to sleep, without starting Wi-Fi or the web server. Every
+ * CONFIG_FLORALINK_DUTY_UPLOAD_EVERY wakes, when the reading crosses
+ * CONFIG_FLORALINK_DUTY_THRESHOLD_CM or when the batch is full, the wake path returns and the
+ * normal boot brings the network up; the batch is then served on /batch for
+ * CONFIG_FLORALINK_DUTY_ONLINE_S seconds before the node sleeps again.
+ *
+ * Each batch entry records the wake-to-sleep time of the cycle that took it.
+ *
+ * Usage Example:
+ * @code
+ *   void app_main(void) {
+ *       dutycycle_wake();    // Only returns when the network is needed
+ *       start_everything();
+ *       dutycycle_online();  // Sleep again after the online window
+ *   }
+ * @endcode
+ */
+
+#ifndef DUTYCYCLE_H
+#define DUTYCYCLE_H
+
+#include <stdint.h>
+#include "esp_err.h"
+#include "trace.h"
+
+typedef struct
+{
+    uint32_t t_s;         ///< RTC clock time of the reading (time(NULL))
+    uint32_t distance_cm; ///< 0 when err != ESP_OK
+    int32_t err;
+    uint32_t awake_us;    ///< Wake-to-sleep time of the cycle that took this reading
+} duty_sample_t;
+
+/**
+ * @brief Handle a wake from deep sleep. Call first thing in app_main().
+ *
+ * On a timer wake this measures, stores the reading and re-enters deep sleep, unless an
+ * upload is due, in which case it returns so the full boot can proceed. On any other
+ * reset it just returns.
+ */
+void dutycycle_wake(void);
+
+/**
+ * @brief Start the online window; deep sleep is entered when it ends.
+ */
+void dutycycle_online(void);
+
+/**
+ * @brief Drop the batch, e.g. once a client has stored it.
+ */
+void dutycycle_ack(void);
+
+/**
+ * @brief Stream the batch and the wake statistics as JSON.
+ * @param write Output callback (same contract as trace_export_json())
+ * @param ctx Opaque pointer passed to @p write
+ * @return ESP_OK on success, or the first error returned by @p write.
+ */
+esp_err_t dutycycle_export_json(trace_write_fn_t write, void *ctx);
+
+#endif // DUTYCYCLE_H
@@ -0,0 +1,170 @@
+/**
+ * @file energy.c
+ * @brief Residency bookkeeping and charge estimate per power state.
+ *
+ * energy_update() takes the esp_timer time elapsed since the previous update (esp_timer
+ * keeps counting through light sleep), removes the light sleep time measured meanwhile and
+ * splits the rest between active and modem sleep with the current CPU load estimate.
+ * Deep sleep is measured with the RTC clock (gettimeofday()), which keeps running while
+ * esp_timer restarts at every boot.
+ *
+ * Configuration ("Energy model" menu): current per state in microamps and the battery
+ * capacity used for the battery-life estimate.
+ */
+
+#include "energy.h"
+#include <stdio.h>
+#include <sys/time.h>
+#include "modemanager.h"
+#include "monitor.h"
+#include "esp_attr.h"
+#include "esp_sleep.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+
+static const char *const s_state_names[PWR_STATE_COUNT] = {
+    "active", "modem_sleep", "light_sleep_auto", "light_sleep_manual", "deep_sleep"};
+
+static const uint32_t s_state_current_ua[PWR_STATE_COUNT] = {
+    CONFIG_FLORALINK_ENERGY_ACTIVE_UA,
+    CONFIG_FLORALINK_ENERGY_MODEM_SLEEP_UA,
+    CONFIG_FLORALINK_ENERGY_LIGHT_SLEEP_UA,
+    CONFIG_FLORALINK_ENERGY_LIGHT_SLEEP_UA,
+    CONFIG_FLORALINK_ENERGY_DEEP_SLEEP_UA};
+
+// Survives deep sleep; reset by power-on
+static RTC_DATA_ATTR energy_stats_t s_rtc;
+static RTC_DATA_ATTR int64_t s_deep_sleep_entry_us = 0;
+
+static portMUX_TYPE s_lock = portMUX_INITIALIZER_UNLOCKED;
+static int64_t s_last_update_us = 0;
+static uint64_t s_last_auto_slept_us = 0;
+static uint64_t s_manual_pending_us = 0; // Manual light sleep not yet subtracted from awake time
+
+static int64_t rtc_time_us(void)
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (int64_t)tv.tv_sec * 1000000LL + tv.tv_usec;
+}
+
+static void energy_count_wake(int cause)
+{
+    if (cause < 0 || cause >= ENERGY_WAKE_CAUSES)
+        cause = 0;
+    s_rtc.wake_causes[cause]++;
+}
+
+void energy_init(void)
+{
+    esp_sleep_wakeup_cause_t cause = esp_sleep_get_wakeup_cause();
+    s_rtc.boots++;
+    energy_count_wake((int)cause);
+    if (cause != ESP_SLEEP_WAKEUP_UNDEFINED && s_deep_sleep_entry_us)
+    {
+        int64_t slept = rtc_time_us() - s_deep_sleep_entry_us;
+        if (slept > 0)
+            s_rtc.residency_us[PWR_DEEP_SLEEP] += (uint64_t)slept;
+    }
+    s_deep_sleep_entry_us = 0;
+    s_last_update_us = 0; // The application started at esp_timer time 0
+}
+
+void energy_update(void)
+{
+    pm_sleep_stats_t sleep;
+    modemanager_get_sleep_stats(&sleep);
+    float load = monitor_get_cpu_load();
+
+    portENTER_CRITICAL(&s_lock);
+    int64_t now = (int64_t)sleep.uptime_us;
+    if (now <= s_last_update_us || sleep.slept_us < s_last_auto_slept_us)
+    {
+        // A concurrent update already accounted a later sample
+        portEXIT_CRITICAL(&s_lock);
+        return;
+    }
+    // Claim the interval, so the float split can run with interrupts enabled
+    uint64_t elapsed = (uint64_t)(now - s_last_update_us);
+    uint64_t auto_slept = sleep.slept_us - s_last_auto_slept_us;
+    uint64_t asleep = auto_slept + s_manual_pending_us;
+    s_last_update_us = now;
+    s_last_auto_slept_us = sleep.slept_us;
+    s_manual_pending_us = 0;
+    portEXIT_CRITICAL(&s_lock);
+
+    uint64_t awake = elapsed > asleep ? elapsed - asleep : 0;
+    uint64_t busy = (uint64_t)((float)awake * load);
+
+    portENTER_CRITICAL(&s_lock);
+    s_rtc.residency_us[PWR_ACTIVE] += busy;
+    s_rtc.residency_us[PWR_MODEM_SLEEP] += awake - busy;
+    s_rtc.residency_us[PWR_LIGHT_SLEEP_AUTO] += auto_slept;
+    portEXIT_CRITICAL(&s_lock);
+}
+
+void energy_light_sleep_done(uint64_t slept_us, int wake_cause)
+{
+    portENTER_CRITICAL(&s_lock);
+    s_rtc.residency_us[PWR_LIGHT_SLEEP_MANUAL] += slept_us;
+    s_manual_pending_us += slept_us;
+    energy_count_wake(wake_cause);
+    portEXIT_CRITICAL(&s_lock);
+}
+
+void energy_before_deep_sleep(void)
+{
+    energy_update();
+    s_rtc.last_awake_us = (uint32_t)esp_timer_get_time();
+    s_deep_sleep_entry_us = rtc_time_us();
+}
+
+void energy_get_stats(energy_stats_t *stats)
+{
+    portENTER_CRITICAL(&s_lock);
+    *stats = s_rtc;
+    portEXIT_CRITICAL(&s_lock);
+}
+
+esp_err_t energy_export_json(trace_write_fn_t write, void *ctx)
+{
+    energy_stats_t st;
+    energy_update();
+    energy_get_stats(&st);
+
+    char buf[192];
+    uint64_t total_us = 0;
+    double charge_uah = 0.0;
+    esp_err_t err = write(ctx, "{\"states\":{", 11);
+    for (int i = 0; i < PWR_STATE_COUNT && err == ESP_OK; i++)
+    {
+        double uah = (double)st.residency_us[i] * s_state_current_ua[i] / 3.6e9;
+        total_us += st.residency_us[i];
+        charge_uah += uah;
+        int n = snprintf(buf, sizeof(buf), "%s\"%s\":{\"ms\":%llu,\"current_ua\":%lu,\"charge_uah\":%.2f}",
+                         i ? "," : "", s_state_names[i], (unsigned long long)(st.residency_us[i] / 1000),
+                         (unsigned long)s_state_current_ua[i], uah);
+        err = write(ctx, buf, n);
+    }
+    if (err != ESP_OK)
+        return err;
+
+    // Average current over the whole accounted time and the battery life it implies
+    double avg_ua = total_us ? charge_uah * 3.6e9 / (double)total_us : 0.0;
+    double life_h = avg_ua > 0.0 ? CONFIG_FLORALINK_ENERGY_BATTERY_MAH * 1000.0 / avg_ua : 0.0;
+    int n = snprintf(buf, sizeof(buf),
+                     "},\"charge_uah\":%.2f,\"avg_current_ua\":%.1f,\"battery_mah\":%d,\"battery_life_h\":%.0f,"
+                     "\"boots\":%lu,\"last_awake_ms\":%lu,\"wake_causes\":[",
+                     charge_uah, avg_ua, CONFIG_FLORALINK_ENERGY_BATTERY_MAH, life_h,
+                     (unsigned long)st.boots, (unsigned long)(st.last_awake_us / 1000));
+    err = write(ctx, buf, n);
+    if (err != ESP_OK)
+        return err;
+    n = 0;
+    for (int i = 0; i < ENERGY_WAKE_CAUSES; i++)
+        n += snprintf(buf + n, sizeof(buf) - n, "%s%lu", i ? "," : "", (unsigned long)st.wake_causes[i]);
+    err = write(ctx, buf, n);
+    if (err == ESP_OK)
+        err = write(ctx, "]}", 2);
+    return err;
+}
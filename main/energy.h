@@ -0,0 +1,79 @@
+/**
+ * @file energy.h
+ * @brief Power-state residency, wake-up causes and an estimated energy model.
+ *
+ * Time is attributed to one of the power states below and multiplied by a configurable
+ * per-state current draw (Kconfig "Energy model") to estimate charge, average current and
+ * battery life. Totals are kept in RTC memory, so they cover all deep sleep cycles since
+ * power-on, not just the current boot.
+ *
+ * - Active / modem sleep: awake time, split by the CPU load estimate (monitor.c). With
+ *   Wi-Fi associated the radio is in modem sleep whenever the CPU is idle.
+ * - Automatic light sleep: measured by the esp_pm light sleep callback (modemanager.c).
+ * - Manual light sleep: measured around esp_light_sleep_start().
+ * - Deep sleep: RTC clock time between entering deep sleep and the next boot.
+ */
+
+#ifndef ENERGY_H
+#define ENERGY_H
+
+#include <stdint.h>
+#include "esp_err.h"
+#include "trace.h"
+
+typedef enum
+{
+    PWR_ACTIVE,
+    PWR_MODEM_SLEEP,
+    PWR_LIGHT_SLEEP_AUTO,
+    PWR_LIGHT_SLEEP_MANUAL,
+    PWR_DEEP_SLEEP,
+    PWR_STATE_COUNT
+} pwr_state_t;
+
+#define ENERGY_WAKE_CAUSES 16 ///< Slots for esp_sleep_wakeup_cause_t values
+
+typedef struct
+{
+    uint64_t residency_us[PWR_STATE_COUNT];
+    uint32_t wake_causes[ENERGY_WAKE_CAUSES]; ///< Indexed by esp_sleep_wakeup_cause_t (0: reset)
+    uint32_t boots;
+    uint32_t last_awake_us;                   ///< Awake time of the boot before the last deep sleep
+} energy_stats_t;
+
+/**
+ * @brief Account the deep sleep that just ended and its wake cause. Call first in app_main().
+ */
+void energy_init(void);
+
+/**
+ * @brief Attribute the time since the last update to the awake and automatic sleep states.
+ *
+ * Call periodically (the CPU load job does, once per CONFIG_FLORALINK_CPU_LOAD_PERIOD_MS).
+ */
+void energy_update(void);
+
+/**
+ * @brief Record a manual light sleep of @p slept_us and the cause that ended it.
+ */
+void energy_light_sleep_done(uint64_t slept_us, int wake_cause);
+
+/**
+ * @brief Close the accounting of this boot before esp_deep_sleep_start().
+ */
+void energy_before_deep_sleep(void);
+
+/**
+ * @brief Copy the residency and wake-up counters.
+ */
+void energy_get_stats(energy_stats_t *stats);
+
+/**
+ * @brief Stream residency, charge per state, average current and battery life as JSON.
+ * @param write Output callback (same contract as trace_export_json())
+ * @param ctx Opaque pointer passed to @p write
+ * @return ESP_OK on success, or the first error returned by @p write.
+ */
+esp_err_t energy_export_json(trace_write_fn_t write, void *ctx);
+
+#endif // ENERGY_H
@@ -1,17 +1,116 @@
+/**
+ * @file modemanager.c
+ * @brief Sleep modes and esp_pm configuration.
+ *
+ * With CONFIG_FLORALINK_AUTO_LIGHT_SLEEP the CPU scales between the XTAL and the default
+ * CPU frequency and the idle task enters light sleep whenever no PM lock is held and the
+ * next timer is far enough away (tickless idle). Wi-Fi stays associated in modem sleep, so
+ * the chip wakes for the beacons it listens to and incoming requests are still served.
+ *
+ * Sleep residency is measured with the light sleep exit callback, which reports the time
+ * actually slept (CONFIG_PM_LIGHT_SLEEP_CALLBACKS).
+ */
+
 #include "modemanager.h"
 #include <esp_sleep.h>
 #include <esp_log.h>
+#include <esp_timer.h>
+#include "esp_attr.h"
+#include "energy.h"
+#include "config_store.h"
+#include "spool.h"
+#include "tsdb.h"
 
 static const char *TAG = "ModeManager";
 
+static volatile uint32_t s_light_sleeps = 0;
+static volatile uint64_t s_slept_us = 0;
+
 void modemanager_light_sleep(void)
 {
+#if CONFIG_FLORALINK_AUTO_LIGHT_SLEEP
+    // Sleep is entered automatically whenever idle; a blocking sleep would only stop the server
+    ESP_LOGI(TAG, "Automatic light sleep is active, ignoring manual request");
+#else
     ESP_LOGI(TAG, "Entering light sleep mode");
+    int64_t start = esp_timer_get_time();
     esp_light_sleep_start();
+    energy_light_sleep_done((uint64_t)(esp_timer_get_time() - start), (int)esp_sleep_get_wakeup_cause());
+#endif
 }
 
 void modemanager_deep_sleep(void)
 {
     ESP_LOGI(TAG, "Entering deep sleep mode");
+    config_flush(); // Settings changed within the commit delay would be lost otherwise
+#if CONFIG_FLORALINK_SPOOL
+    spool_flush();
+#endif
+#if CONFIG_FLORALINK_TSDB
+    tsdb_flush();
+#endif
+    energy_before_deep_sleep();
     esp_deep_sleep_start();
 }
+
+#if CONFIG_PM_LIGHT_SLEEP_CALLBACKS
+// Runs in the idle task with interrupts disabled, right after waking up
+static esp_err_t IRAM_ATTR light_sleep_exit_cb(int64_t sleep_time_us, void *arg)
+{
+    s_light_sleeps++;
+    s_slept_us += (uint64_t)sleep_time_us;
+    return ESP_OK;
+}
+#endif
+
+esp_err_t modemanager_pm_init(void)
+{
+#if CONFIG_PM_ENABLE
+    esp_pm_config_t pm_config = {
+        .max_freq_mhz = CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ,
+        .min_freq_mhz = CONFIG_XTAL_FREQ,
+#if CONFIG_FLORALINK_AUTO_LIGHT_SLEEP
+        .light_sleep_enable = true,
+#endif
+    };
+    esp_err_t err = esp_pm_configure(&pm_config);
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(TAG, "esp_pm_configure failed (%s)", esp_err_to_name(err));
+        return err;
+    }
+#if CONFIG_PM_LIGHT_SLEEP_CALLBACKS
+    esp_pm_sleep_cbs_register_config_t cbs = {
+        .exit_cb = light_sleep_exit_cb,
+    };
+    esp_pm_light_sleep_register_cbs(&cbs);
+#endif
+    ESP_LOGI(TAG, "PM: %d-%d MHz, automatic light sleep %s", pm_config.min_freq_mhz, pm_config.max_freq_mhz,
+             pm_config.light_sleep_enable ? "on" : "off");
+#else
+    ESP_LOGI(TAG, "Power management disabled (CONFIG_PM_ENABLE)");
+#endif
+    return ESP_OK;
+}
+
+pm_lock_t modemanager_pm_lock_create(const char *name)
+{
+#if CONFIG_PM_ENABLE
+    esp_pm_lock_handle_t lock = NULL;
+    if (esp_pm_lock_create(ESP_PM_CPU_FREQ_MAX, 0, name, &lock) != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Failed to create PM lock %s", name);
+        return NULL;
+    }
+    return lock;
+#else
+    return NULL;
+#endif
+}
+
+void modemanager_get_sleep_stats(pm_sleep_stats_t *stats)
+{
+    stats->light_sleeps = s_light_sleeps;
+    stats->slept_us = s_slept_us;
+    stats->uptime_us = (uint64_t)esp_timer_get_time();
+}
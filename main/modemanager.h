@@ -1,7 +1,97 @@
+/**
+ * @file modemanager.h
+ * @brief Sleep modes and power management.
+ *
+ * Besides the manual light/deep sleep entry points, the mode manager configures esp_pm
+ * dynamic frequency scaling and, with CONFIG_FLORALINK_AUTO_LIGHT_SLEEP, automatic light
+ * sleep on tickless idle. Modules that need the CPU awake and at full speed (the ultrasonic
+ * ping, HTTP handling) hold a PM lock only for that time:
+ *
+ * @code
+ *   static pm_lock_t s_lock;
+ *   s_lock = modemanager_pm_lock_create("http");
+ *   ...
+ *   {
+ *       PM_LOCK_SCOPE(s_lock);
+ *       handle_request();
+ *   }
+ * @endcode
+ *
+ * Without CONFIG_PM_ENABLE the locks are NULL and the scope is a no-op.
+ */
+
 #ifndef MODEMANAGER_H
 #define MODEMANAGER_H
 
+#include <stdint.h>
+#include "esp_err.h"
+#include "sdkconfig.h"
+
+#if CONFIG_PM_ENABLE
+#include "esp_pm.h"
+typedef esp_pm_lock_handle_t pm_lock_t;
+#else
+typedef void *pm_lock_t;
+#endif
+
+typedef struct
+{
+    uint32_t light_sleeps; ///< Automatic light sleep entries
+    uint64_t slept_us;     ///< Total time spent in automatic light sleep
+    uint64_t uptime_us;
+} pm_sleep_stats_t;
+
 void modemanager_light_sleep(void);
 void modemanager_deep_sleep(void);
 
+/**
+ * @brief Configure esp_pm (frequency scaling, automatic light sleep) and sleep accounting.
+ *
+ * Call once, early in initialization. Without CONFIG_PM_ENABLE this only logs.
+ * @return ESP_OK, or the error of esp_pm_configure().
+ */
+esp_err_t modemanager_pm_init(void);
+
+/**
+ * @brief Create a lock keeping the CPU at maximum frequency and out of light sleep.
+ * @param name Lock name, shown by esp_pm_dump_locks()
+ * @return The lock, or NULL without CONFIG_PM_ENABLE or on error.
+ */
+pm_lock_t modemanager_pm_lock_create(const char *name);
+
+/**
+ * @brief Get the automatic light sleep residency since boot.
+ *
+ * The counters stay at zero unless CONFIG_PM_LIGHT_SLEEP_CALLBACKS is enabled.
+ */
+void modemanager_get_sleep_stats(pm_sleep_stats_t *stats);
+
+#if CONFIG_PM_ENABLE
+static inline pm_lock_t pm_lock_scope_begin(pm_lock_t lock)
+{
+    if (lock)
+        esp_pm_lock_acquire(lock);
+    return lock;
+}
+
+static inline void pm_lock_scope_end(pm_lock_t *lock)
+{
+    if (*lock)
+        esp_pm_lock_release(*lock);
+}
+
+#define PM_CONCAT_(a, b) a##b
+#define PM_CONCAT(a, b) PM_CONCAT_(a, b)
+
+// Hold @p lock for the rest of the enclosing block
+#define PM_LOCK_SCOPE(lock) \
+    pm_lock_t PM_CONCAT(__pm_lock_, __LINE__) __attribute__((cleanup(pm_lock_scope_end))) = pm_lock_scope_begin(lock)
+#else
+#define PM_LOCK_SCOPE(lock) \
+    do                      \
+    {                       \
+        (void)(lock);       \
+    } while (0)
+#endif // CONFIG_PM_ENABLE
+
 #endif // MODEMANAGER_H
@@ -21,9 +21,15 @@
  * 6. Create a FreeRTOS queue for RMT events and a task to process them.
  * 7. In the callback, push event data to the queue (ISR-safe, no logging).
  * 8. In the task, log pulse timings and re-arm the RMT for the next event.
+ *
+ * With CONFIG_FLORALINK_AUTO_LIGHT_SLEEP the channel is instead enabled only for the
+ * duration of each ultrasonic ping, bracketed by monitor_capture_begin()/monitor_capture_end().
  */
 
 #include "monitor.h"
+#include "trace.h"
+#include "profile.h"
+#include "dlog.h"
 #include "driver/gpio.h"
 #include "driver/rmt_rx.h"
 #include "freertos/FreeRTOS.h"
@@ -61,6 +67,7 @@ void vApplicationIdleHook(void)
 // Call this periodically (e.g., from monitor_task or a timer)
 void monitor_update_cpu_load(void)
 {
+    PROF_SCOPE("monitor_update_cpu_load");
     uint64_t now = esp_timer_get_time();
     uint64_t idle = s_idle_count;
     uint64_t dt = now - s_last_time;
@@ -98,17 +105,22 @@ void monitor_update_cpu_load(void)
         s_cpu_load = 0;
     if (s_cpu_load > 1)
         s_cpu_load = 1;
-    ESP_LOGI(TAG, "=====================");
+    DLOGI(TAG, "=====================");
     // ESP_LOGI(TAG, "idle count: %llu", idle);
     // ESP_LOGI(TAG, "d idle: %llu", didle);
     // ESP_LOGI(TAG, "dt: %llu us", dt);
     // ESP_LOGI(TAG, "max_idle: %.2f", s_max_idle);
     // ESP_LOGI(TAG, "idle fraction: %.2f%%", idle_frac * 100);
-    ESP_LOGI(TAG, "CPU Load: %.2f%%", s_cpu_load * 100);
+    DLOGI(TAG, "CPU Load: %.2f%%", s_cpu_load * 100);
     s_last_time = now;
     s_last_idle_count = idle;
 }
 
+float monitor_get_cpu_load(void)
+{
+    return s_cpu_load;
+}
+
 void monitor_get_device_stats(device_stats_t *stats)
 {
     if (!stats)
@@ -145,6 +157,7 @@ static bool IRAM_ATTR rmt_rx_done_cb(rmt_channel_handle_t chan,
 {
     // 1. Track if a higher-priority task is woken by the queue operation
     BaseType_t hp_task_woken = pdFALSE;
+    TRACE_INSTANT("rmt_rx_done");
 
     // 2. Send the event data to the queue (by value, ISR-safe)
     //    - This allows the main monitor task to process the event outside the ISR
@@ -168,19 +181,38 @@ void monitor_process_rmt_rx(void)
     rmt_rx_done_event_data_t evt;
     if (xQueueReceive(s_rmt_evt_q, &evt, 1000 / portTICK_PERIOD_MS)) // 1s timeout
     {
+        TRACE_SCOPE("rmt_rx_process");
         const rmt_symbol_word_t *syms = evt.received_symbols;
         for (size_t i = 0; i < evt.num_symbols; i++)
         {
             float t0_us = syms[i].duration0 / 10.0f;
             float t1_us = syms[i].duration1 / 10.0f;
-            ESP_LOGI(TAG, "lvl0=%d t0=%.1fus | lvl1=%d t1=%.1fus",
-                     syms[i].level0, t0_us, syms[i].level1, t1_us);
+            DLOGI(TAG, "lvl0=%d t0=%.1fus | lvl1=%d t1=%.1fus",
+                  syms[i].level0, t0_us, syms[i].level1, t1_us);
         }
+#if !CONFIG_FLORALINK_AUTO_LIGHT_SLEEP
         // Re-arm RMT for next event
         rmt_receive(g_rx_chan, g_rx_buf, g_rx_buf_sz, &g_rx_cfg);
+#endif
     }
 }
 
+void monitor_capture_begin(void)
+{
+#if CONFIG_FLORALINK_AUTO_LIGHT_SLEEP
+    if (g_rx_chan && rmt_enable(g_rx_chan) == ESP_OK)
+        rmt_receive(g_rx_chan, g_rx_buf, g_rx_buf_sz, &g_rx_cfg);
+#endif
+}
+
+void monitor_capture_end(void)
+{
+#if CONFIG_FLORALINK_AUTO_LIGHT_SLEEP
+    if (g_rx_chan)
+        rmt_disable(g_rx_chan);
+#endif
+}
+
 /**
  * @brief Initialize the RMT monitor module.
  *
@@ -217,9 +249,12 @@ void monitor_init(void)
     g_rx_cfg.signal_range_min_ns = 1000;    // Filter out pulses < 1 us
     g_rx_cfg.signal_range_max_ns = 2000000; // Max pulse 2 ms
     g_rx_cfg.flags.en_partial_rx = 0;
-    // 7. Enable and arm RMT
+    // 7. Enable and arm RMT. With automatic light sleep the enabled channel holds an APB lock
+    //    that would forbid it, so it is only enabled around each ping (monitor_capture_begin/end)
+#if !CONFIG_FLORALINK_AUTO_LIGHT_SLEEP
     rmt_enable(g_rx_chan);
     rmt_receive(g_rx_chan, g_rx_buf, g_rx_buf_sz, &g_rx_cfg);
+#endif
     // 8. Create event queue (task is created in tasks.c)
     s_rmt_evt_q = xQueueCreate(10, sizeof(rmt_rx_done_event_data_t));
 }
@@ -35,6 +35,18 @@ void monitor_init(void);
 
 void monitor_update_cpu_load(void);
 
+// Last CPU load estimate (0.0 to 1.0) without refreshing it
+float monitor_get_cpu_load(void);
+
+/**
+ * @brief Open/close an RMT capture window around a ping.
+ *
+ * With CONFIG_FLORALINK_AUTO_LIGHT_SLEEP the RX channel (and the APB lock it holds) is
+ * enabled only between these calls, so light sleep is possible between pings. No-ops otherwise.
+ */
+void monitor_capture_begin(void);
+void monitor_capture_end(void);
+
 void vApplicationIdleHook(void);
 
 #endif // MONITOR_H
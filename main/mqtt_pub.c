@@ -0,0 +1,312 @@
+/**
+ * @file mqtt_pub.c
+ * @brief Sample bus subscriber publishing batches through esp-mqtt.
+ *
+ * The publisher task owns the batch: it reads the bus until the batch is full or its oldest
+ * sample is due, then publishes when the broker is connected and the outbox has room. While
+ * the outbox is full it stops reading, so the readings stay in the bus (and are counted as
+ * lost if the stall outlasts the bus depth). While disconnected, batches go to the flash
+ * spool if enabled (replayed on <topic>/replay), otherwise they wait in the bus as well.
+ * The replay also runs in the publisher task, between live batches, so its flash reads and
+ * publish calls have the publisher's stack and never block the scheduler task.
+ * The client runs its own task; the event handler only updates the connection state and
+ * wakes the publisher.
+ */
+
+#include "sdkconfig.h"
+
+#if CONFIG_FLORALINK_MQTT
+
+#include "mqtt_pub.h"
+#include <stdio.h>
+#include <string.h>
+#include <esp_log.h>
+#include <mqtt_client.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "sample_bus.h"
+#include "sample_codec.h"
+#include "wifi_setup.h"
+#include "spool.h"
+
+#define MQTT_BATCH_MAX CONFIG_FLORALINK_MQTT_BATCH_SIZE
+#define MQTT_LATENCY_US ((int64_t)CONFIG_FLORALINK_MQTT_MAX_LATENCY_MS * 1000)
+#define MQTT_RETRY_MS 1000 // Re-check period while disconnected or the outbox is full
+
+#define MQTT_BIN_MAGIC 0xF1
+#define MQTT_BIN_VERSION 1
+#define MQTT_BIN_HEADER 16
+#define MQTT_JSON_HEADER 64 // {"seq":..,"t_ms":..,"s":[ ... ]}
+#define MQTT_JSON_RECORD 32 // [dt_ms,distance_cm,err],
+
+#if CONFIG_FLORALINK_MQTT_BINARY
+#define MQTT_PAYLOAD_MAX (MQTT_BIN_HEADER + MQTT_BATCH_MAX * SAMPLE_RECORD_SIZE)
+#define MQTT_PAYLOAD_KIND "binary"
+#else
+#define MQTT_PAYLOAD_MAX (MQTT_JSON_HEADER + MQTT_BATCH_MAX * MQTT_JSON_RECORD)
+#define MQTT_PAYLOAD_KIND "JSON"
+#endif
+
+static const char *TAG = "MqttPub";
+
+static esp_mqtt_client_handle_t s_client = NULL;
+static bool s_started = false;
+// Serialises the client start: the link event handler and mqtt_pub_init() may race to start
+static SemaphoreHandle_t s_start_lock = NULL;
+static volatile bool s_connected = false;
+static TaskHandle_t s_task = NULL;
+static sample_sub_t s_sub = SAMPLE_SUB_INIT("mqtt");
+static sample_t s_batch[MQTT_BATCH_MAX];
+static uint32_t s_batch_len = 0;
+static uint8_t s_payload[MQTT_PAYLOAD_MAX];
+static mqtt_pub_stats_t s_stats = {0};
+
+static void mqtt_wake_publisher(void)
+{
+    if (s_task)
+        xTaskNotifyGive(s_task);
+}
+
+// Runs in the MQTT client task
+static void mqtt_event_handler(void *arg, esp_event_base_t base, int32_t id, void *data)
+{
+    switch ((esp_mqtt_event_id_t)id)
+    {
+    case MQTT_EVENT_CONNECTED:
+        ESP_LOGI(TAG, "Connected to %s", CONFIG_FLORALINK_MQTT_BROKER_URI);
+        s_connected = true;
+        s_stats.connects++;
+        mqtt_wake_publisher();
+        break;
+    case MQTT_EVENT_DISCONNECTED:
+        ESP_LOGW(TAG, "Disconnected");
+        s_connected = false;
+        break;
+    case MQTT_EVENT_PUBLISHED:
+        // A QoS 1/2 message was acknowledged and left the outbox
+        mqtt_wake_publisher();
+        break;
+    default:
+        break;
+    }
+}
+
+// Start the client once; later calls connect now rather than after its own reconnect timeout
+static void mqtt_client_connect(void)
+{
+    xSemaphoreTake(s_start_lock, portMAX_DELAY);
+    if (!s_started)
+        s_started = esp_mqtt_client_start(s_client) == ESP_OK;
+    else
+        esp_mqtt_client_reconnect(s_client);
+    xSemaphoreGive(s_start_lock);
+}
+
+// Runs in the default event loop task
+static void mqtt_link_handler(void *arg, esp_event_base_t base, int32_t id, void *data)
+{
+    if (id == LINK_EVENT_UP)
+    {
+        mqtt_client_connect();
+    }
+    else if (id == LINK_EVENT_DOWN)
+    {
+        s_connected = false;
+    }
+}
+
+#if CONFIG_FLORALINK_SPOOL
+#define MQTT_REPLAY_MAX (16 + SPOOL_BATCH * 24) // {"replay":[[t_s,cm],...]}
+static char s_replay_payload[MQTT_REPLAY_MAX];
+
+// Replay only while live traffic leaves the outbox at least half empty
+static bool mqtt_replay_ready(void)
+{
+    return s_connected && esp_mqtt_client_get_outbox_size(s_client) < CONFIG_FLORALINK_MQTT_OUTBOX_LIMIT / 2;
+}
+
+// Runs in the publisher task (spool_replay()); published on <topic>/replay as
+// {"replay":[[t_s,distance_cm],...]}, [uptime_s,distance_cm,1] for readings without clock time
+static esp_err_t mqtt_replay_deliver(const spool_record_t *records, uint32_t n)
+{
+    size_t len = snprintf(s_replay_payload, sizeof(s_replay_payload), "{\"replay\":[");
+    for (uint32_t i = 0; i < n && len < sizeof(s_replay_payload); i++)
+    {
+        long cm = records[i].distance_cm == SPOOL_ERROR ? -1 : (long)records[i].distance_cm;
+        bool uptime = records[i].t_s & SPOOL_T_UPTIME;
+        len += snprintf(s_replay_payload + len, sizeof(s_replay_payload) - len, "%s[%lu,%ld%s]", i ? "," : "",
+                        (unsigned long)(records[i].t_s & ~SPOOL_T_UPTIME), cm, uptime ? ",1" : "");
+    }
+    if (len < sizeof(s_replay_payload))
+        len += snprintf(s_replay_payload + len, sizeof(s_replay_payload) - len, "]}");
+    if (len >= sizeof(s_replay_payload))
+        return ESP_ERR_INVALID_SIZE;
+    int msg_id = esp_mqtt_client_publish(s_client, CONFIG_FLORALINK_MQTT_TOPIC "/replay", s_replay_payload, (int)len,
+                                         CONFIG_FLORALINK_MQTT_QOS, 0);
+    return msg_id < 0 ? ESP_FAIL : ESP_OK;
+}
+
+static const spool_sink_t s_spool_sink = {
+    .ready = mqtt_replay_ready,
+    .deliver = mqtt_replay_deliver,
+};
+#endif
+
+esp_err_t mqtt_pub_init(void)
+{
+    s_start_lock = xSemaphoreCreateMutex();
+    if (!s_start_lock)
+        return ESP_ERR_NO_MEM;
+    esp_mqtt_client_config_t cfg = {
+        .broker.address.uri = CONFIG_FLORALINK_MQTT_BROKER_URI,
+        .outbox.limit = CONFIG_FLORALINK_MQTT_OUTBOX_LIMIT,
+    };
+    s_client = esp_mqtt_client_init(&cfg);
+    if (!s_client)
+    {
+        ESP_LOGE(TAG, "Failed to create the MQTT client");
+        return ESP_FAIL;
+    }
+    esp_mqtt_client_register_event(s_client, MQTT_EVENT_ANY, mqtt_event_handler, NULL);
+    esp_err_t err = esp_event_handler_register(LINK_EVENT, ESP_EVENT_ANY_ID, mqtt_link_handler, NULL);
+    if (err != ESP_OK)
+        return err;
+    // The link may have come up before the handler was registered
+    if (wifi_is_connected())
+        mqtt_client_connect();
+#if CONFIG_FLORALINK_SPOOL
+    spool_set_sink(&s_spool_sink);
+#endif
+    ESP_LOGI(TAG, "Publishing to %s, %d samples or %d ms per message, QoS %d, " MQTT_PAYLOAD_KIND " payload",
+             CONFIG_FLORALINK_MQTT_TOPIC, MQTT_BATCH_MAX, CONFIG_FLORALINK_MQTT_MAX_LATENCY_MS,
+             CONFIG_FLORALINK_MQTT_QOS);
+    return ESP_OK;
+}
+
+#if CONFIG_FLORALINK_MQTT_BINARY
+static size_t mqtt_encode(void)
+{
+    uint8_t *p = s_payload;
+    p[0] = MQTT_BIN_MAGIC;
+    p[1] = MQTT_BIN_VERSION;
+    sample_put_le(p + 2, s_batch_len, 2);
+    sample_put_le(p + 4, s_batch[0].seq, 4);
+    sample_put_le(p + 8, (uint64_t)s_batch[0].ts_us, 8);
+    return MQTT_BIN_HEADER + sample_encode_records(s_batch, s_batch_len, p + MQTT_BIN_HEADER);
+}
+#else
+static size_t mqtt_encode(void)
+{
+    char *out = (char *)s_payload;
+    size_t n = snprintf(out, MQTT_PAYLOAD_MAX, "{\"seq\":%lu,\"t_ms\":%lld,\"s\":[",
+                        (unsigned long)s_batch[0].seq, (long long)(s_batch[0].ts_us / 1000));
+    for (uint32_t i = 0; i < s_batch_len && n < MQTT_PAYLOAD_MAX; i++)
+    {
+        n += snprintf(out + n, MQTT_PAYLOAD_MAX - n, "%s[%lu,%lu,%ld]", i ? "," : "",
+                      (unsigned long)sample_dt_ms(s_batch, i), (unsigned long)s_batch[i].distance_cm,
+                      (long)s_batch[i].err);
+    }
+    if (n < MQTT_PAYLOAD_MAX)
+        n += snprintf(out + n, MQTT_PAYLOAD_MAX - n, "]}");
+    return n < MQTT_PAYLOAD_MAX ? n : MQTT_PAYLOAD_MAX - 1;
+}
+#endif
+
+// Publish the batch: ESP_ERR_INVALID_STATE if not connected, ESP_ERR_NO_MEM if the outbox is full
+static esp_err_t mqtt_publish_batch(void)
+{
+    if (!s_connected)
+        return ESP_ERR_INVALID_STATE;
+    size_t len = mqtt_encode();
+    int outbox = esp_mqtt_client_get_outbox_size(s_client);
+    if (outbox > (int)s_stats.outbox_max)
+        s_stats.outbox_max = (uint32_t)outbox;
+    if (outbox + len > CONFIG_FLORALINK_MQTT_OUTBOX_LIMIT)
+        return ESP_ERR_NO_MEM;
+
+    int msg_id = esp_mqtt_client_publish(s_client, CONFIG_FLORALINK_MQTT_TOPIC, (const char *)s_payload, (int)len,
+                                         CONFIG_FLORALINK_MQTT_QOS, 0);
+    if (msg_id < 0)
+    {
+        s_stats.failures++;
+        return ESP_FAIL;
+    }
+    s_stats.messages++;
+    s_stats.samples += s_batch_len;
+    s_stats.bytes += len;
+    s_batch_len = 0;
+    return ESP_OK;
+}
+
+
+#if CONFIG_FLORALINK_SPOOL
+static bool s_replay_pending = true; // The spool may hold records of an earlier boot
+
+// Wait for the first sample of a batch, waking up at the replay pace while the spool has records
+static TickType_t mqtt_ticks_idle(void)
+{
+    return s_replay_pending && s_connected ? pdMS_TO_TICKS(CONFIG_FLORALINK_SPOOL_REPLAY_MS) : portMAX_DELAY;
+}
+#else
+static TickType_t mqtt_ticks_idle(void)
+{
+    return portMAX_DELAY;
+}
+#endif
+
+void mqtt_pub_run(void)
+{
+    s_task = xTaskGetCurrentTaskHandle();
+    // With backlog: readings taken before the broker was reachable are sent too
+    sample_bus_subscribe(&s_sub, true, true);
+    for (;;)
+    {
+        // 1. Fill the batch until it is full or its oldest sample is due
+        s_batch_len = sample_batch_fill(&s_sub, s_batch, s_batch_len, MQTT_BATCH_MAX, MQTT_LATENCY_US, mqtt_ticks_idle());
+        s_stats.lost = s_sub.lost;
+#if CONFIG_FLORALINK_SPOOL
+        if (s_connected)
+            s_replay_pending = spool_replay();
+#endif
+        if (!s_batch_len)
+            continue;
+
+        // 2. Publish, or wait for the connection / outbox room and retry
+        esp_err_t err = mqtt_publish_batch();
+#if CONFIG_FLORALINK_SPOOL
+        if (err == ESP_ERR_INVALID_STATE)
+        {
+            // Offline: keep the batch in flash and go on reading; replayed once connected
+            spool_append(s_batch, s_batch_len);
+            s_batch_len = 0;
+            s_replay_pending = true;
+            continue;
+        }
+#endif
+        if (err != ESP_OK)
+            ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(MQTT_RETRY_MS));
+    }
+}
+
+void mqtt_pub_get_stats(mqtt_pub_stats_t *stats)
+{
+    *stats = s_stats;
+}
+
+esp_err_t mqtt_pub_export_json(trace_write_fn_t write, void *ctx)
+{
+    mqtt_pub_stats_t st;
+    mqtt_pub_get_stats(&st);
+    char buf[224];
+    int n = snprintf(buf, sizeof(buf),
+                     "{\"connected\":%s,\"messages\":%lu,\"samples\":%lu,\"bytes\":%lu,\"samples_per_message\":%.1f,"
+                     "\"failures\":%lu,\"connects\":%lu,\"outbox_max\":%lu,\"lost\":%lu}",
+                     s_connected ? "true" : "false", (unsigned long)st.messages, (unsigned long)st.samples,
+                     (unsigned long)st.bytes, st.messages ? (double)st.samples / st.messages : 0.0,
+                     (unsigned long)st.failures, (unsigned long)st.connects, (unsigned long)st.outbox_max,
+                     (unsigned long)st.lost);
+    return write(ctx, buf, n);
+}
+
+#endif // CONFIG_FLORALINK_MQTT
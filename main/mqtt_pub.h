@@ -0,0 +1,73 @@
+/**
+ * @file mqtt_pub.h
+ * @brief Batched MQTT publisher of the distance samples.
+ *
+ * With CONFIG_FLORALINK_MQTT a sample bus subscriber collects readings and publishes them
+ * CONFIG_FLORALINK_MQTT_BATCH_SIZE at a time to CONFIG_FLORALINK_MQTT_TOPIC, or earlier once
+ * the oldest reading in the batch is CONFIG_FLORALINK_MQTT_MAX_LATENCY_MS old. Fewer, larger
+ * messages mean fewer radio wake-ups and less per-message protocol overhead.
+ *
+ * Memory is bounded: one batch is assembled at a time, and no new message is handed to the
+ * MQTT client while its outbox (messages waiting for a QoS 1/2 acknowledgement) holds more
+ * than CONFIG_FLORALINK_MQTT_OUTBOX_LIMIT bytes; readings then wait in the sample bus.
+ *
+ * Payloads (all integers little-endian in the binary form):
+ * - JSON: {"seq":<first seq>,"t_ms":<uptime of first>,"s":[[dt_ms,distance_cm,err],...]}
+ * - Binary (CONFIG_FLORALINK_MQTT_BINARY): 16-byte header
+ *   {u8 magic 0xF1, u8 version 1, u16 count, u32 first seq, i64 uptime of first in us}
+ *   followed by count records {u16 dt_ms, u16 distance_cm (0xFFFF: error), u16 seq delta}
+ *   (sample_codec.h).
+ * dt_ms and the seq delta are relative to the previous sample of the batch (0 for the first);
+ * a seq delta above 1 tells that samples were lost before they could be published.
+ *
+ * With CONFIG_FLORALINK_SPOOL, batches that cannot be sent while the broker is unreachable
+ * are kept in flash (spool.h) and replayed later on <topic>/replay as
+ * {"replay":[[t_s,distance_cm],...]}, t_s being Unix time (SNTP, timesync.h) and -1 marking
+ * an error. Readings taken before the clock was set are sent as [uptime_s,distance_cm,1],
+ * uptime_s counting from the boot they were taken in.
+ */
+
+#ifndef MQTT_PUB_H
+#define MQTT_PUB_H
+
+#include <stdint.h>
+#include "esp_err.h"
+#include "trace.h"
+
+typedef struct
+{
+    uint32_t messages;    ///< Batches handed to the client
+    uint32_t samples;     ///< Samples in those batches
+    uint32_t bytes;       ///< Payload bytes
+    uint32_t failures;    ///< Publish calls rejected by the client (batch kept and retried)
+    uint32_t connects;    ///< Broker connections
+    uint32_t outbox_max;  ///< Largest outbox size seen, in bytes
+    uint32_t lost;        ///< Samples overwritten in the bus before they were read
+} mqtt_pub_stats_t;
+
+/**
+ * @brief Create the MQTT client; it connects once the Wi-Fi link is up and follows LINK_EVENT.
+ *        Call after wifi_setup().
+ */
+esp_err_t mqtt_pub_init(void);
+
+/**
+ * @brief Body of the publisher task: subscribe to the sample bus and publish batches. Never returns.
+ */
+void mqtt_pub_run(void);
+
+/**
+ * @brief Copy what was published so far and how the broker connection fared.
+ */
+void mqtt_pub_get_stats(mqtt_pub_stats_t *stats);
+
+/**
+ * @brief Stream the "mqtt" object of /stats: the connection state, the counters of
+ *        mqtt_pub_stats_t and the average samples per message.
+ * @param write Output callback, see trace_write_fn_t
+ * @param ctx Opaque pointer passed to @p write
+ * @return ESP_OK on success, or the error returned by @p write.
+ */
+esp_err_t mqtt_pub_export_json(trace_write_fn_t write, void *ctx);
+
+#endif // MQTT_PUB_H
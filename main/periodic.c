@@ -0,0 +1,116 @@
+/**
+ * @file periodic.c
+ * @brief esp_timer backed absolute-deadline scheduling for periodic tasks.
+ *
+ * Each periodic_t owns a one-shot esp_timer armed for the next deadline. The timer callback
+ * and periodic_set_period() both wake the owner with a task notification; the owner then
+ * checks the clock, so a wake-up that is not yet due (a reconfiguration) just re-arms.
+ * Deadlines advance by whole periods from the first release, so lateness never accumulates.
+ */
+
+#include "periodic.h"
+#include "esp_log.h"
+
+static const char *TAG = "periodic";
+
+static void periodic_timer_cb(void *arg)
+{
+    periodic_t *p = arg;
+    xTaskNotifyGive(p->owner);
+}
+
+static inline int hist_bucket(uint32_t us)
+{
+    int b = us ? 32 - __builtin_clz(us) : 0;
+    return b < PERIODIC_HIST_BUCKETS ? b : PERIODIC_HIST_BUCKETS - 1;
+}
+
+esp_err_t periodic_init(periodic_t *p, uint32_t period_ms)
+{
+    periodic_bind(p, xTaskGetCurrentTaskHandle(), period_ms);
+    const esp_timer_create_args_t args = {
+        .callback = periodic_timer_cb,
+        .arg = p,
+        .name = "periodic"};
+    esp_err_t err = esp_timer_create(&args, &p->timer);
+    if (err != ESP_OK)
+        ESP_LOGE(TAG, "esp_timer_create failed (%s)", esp_err_to_name(err));
+    return err;
+}
+
+void periodic_bind(periodic_t *p, TaskHandle_t owner, uint32_t period_ms)
+{
+    p->owner = owner;
+    p->timer = NULL;
+    p->period_us = period_ms * 1000U;
+    p->next_us = esp_timer_get_time();
+    p->last_release_us = 0;
+    p->reconfigured = false;
+}
+
+void periodic_reanchor(periodic_t *p, int64_t now)
+{
+    // Re-anchor on the last release with the new period; release now if that passed
+    p->reconfigured = false;
+    if (p->last_release_us)
+        p->next_us = p->last_release_us + p->period_us;
+    if (p->next_us < now)
+        p->next_us = now;
+}
+
+void periodic_release(periodic_t *p, int64_t now)
+{
+    uint32_t period_us = p->period_us;
+    uint32_t late = (uint32_t)(now - p->next_us);
+    periodic_stats_t *st = &p->stats;
+    st->releases++;
+    if (late > st->late_max_us)
+        st->late_max_us = late;
+    st->late_hist[hist_bucket(late)]++;
+    if (p->last_release_us)
+    {
+        int64_t actual = now - p->last_release_us;
+        uint32_t dev = (uint32_t)(actual > period_us ? actual - period_us : period_us - actual);
+        if (dev > st->jitter_max_us)
+            st->jitter_max_us = dev;
+        st->jitter_hist[hist_bucket(dev)]++;
+    }
+    p->last_release_us = now;
+
+    // Next point on the grid; skip whole periods that were overrun instead of bursting
+    p->next_us += period_us;
+    if (p->next_us <= now)
+    {
+        int64_t behind = (now - p->next_us) / period_us + 1;
+        st->missed += (uint32_t)behind;
+        p->next_us += behind * period_us;
+    }
+}
+
+void periodic_wait(periodic_t *p)
+{
+    int64_t now = esp_timer_get_time();
+    while (now < p->next_us)
+    {
+        esp_timer_stop(p->timer);
+        esp_timer_start_once(p->timer, (uint64_t)(p->next_us - now));
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        now = esp_timer_get_time();
+        if (p->reconfigured)
+            periodic_reanchor(p, now);
+    }
+    periodic_release(p, now);
+}
+
+void periodic_set_period(periodic_t *p, uint32_t period_ms)
+{
+    p->period_us = period_ms * 1000U;
+    p->reconfigured = true;
+    if (p->owner)
+        xTaskNotifyGive(p->owner);
+}
+
+uint32_t periodic_get_period_ms(const periodic_t *p)
+{
+    return p->period_us / 1000U;
+}
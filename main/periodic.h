@@ -0,0 +1,103 @@
+/**
+ * @file periodic.h
+ * @brief Absolute-deadline periodic releases with jitter statistics.
+ *
+ * A periodic_t releases its owner task on a fixed grid of esp_timer deadlines
+ * (start + n * period), so the time spent working inside the loop no longer stretches the
+ * period. periodic_set_period() may be called from any task; it re-arms the deadline and
+ * wakes the owner through a task notification, so a new period applies immediately instead
+ * of after the old delay expires.
+ *
+ * Every release records its lateness (release time - deadline) and the deviation of the
+ * actual period from the nominal one in log2 histograms.
+ *
+ * Usage Example:
+ * @code
+ *   static periodic_t s_timing;
+ *   periodic_init(&s_timing, 500);
+ *   while (1) {
+ *       periodic_wait(&s_timing);
+ *       sample();
+ *   }
+ * @endcode
+ */
+
+#ifndef PERIODIC_H
+#define PERIODIC_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#define PERIODIC_HIST_BUCKETS 16 // Bucket 0: 0 us, bucket b: [2^(b-1), 2^b) us, last bucket open-ended
+
+typedef struct
+{
+    uint32_t releases;
+    uint32_t missed;                         ///< Deadlines skipped because a release ran over a full period
+    uint32_t late_max_us;
+    uint32_t jitter_max_us;                  ///< Largest |actual period - nominal period|
+    uint32_t late_hist[PERIODIC_HIST_BUCKETS];
+    uint32_t jitter_hist[PERIODIC_HIST_BUCKETS];
+} periodic_stats_t;
+
+typedef struct
+{
+    TaskHandle_t owner;
+    esp_timer_handle_t timer;
+    volatile uint32_t period_us;
+    int64_t next_us;                         ///< Absolute deadline of the next release
+    int64_t last_release_us;
+    volatile bool reconfigured;
+    periodic_stats_t stats;
+} periodic_t;
+
+/**
+ * @brief Bind a periodic release to the calling task. The first release is immediate.
+ * @param p Periodic state (static storage)
+ * @param period_ms Period in milliseconds
+ * @return ESP_OK on success, error from esp_timer_create() otherwise.
+ */
+esp_err_t periodic_init(periodic_t *p, uint32_t period_ms);
+
+/**
+ * @brief Block until the next deadline and record its lateness and period deviation.
+ *
+ * If the period is changed meanwhile, the wait is re-armed against the new period.
+ */
+void periodic_wait(periodic_t *p);
+
+/**
+ * @brief Initialise a periodic_t without its own timer, for executors that multiplex several.
+ *
+ * The executor waits itself and calls periodic_reanchor()/periodic_release(); @p owner is
+ * the task notified by periodic_set_period(). The first release is immediate.
+ */
+void periodic_bind(periodic_t *p, TaskHandle_t owner, uint32_t period_ms);
+
+/**
+ * @brief Record a release at time @p now (lateness, period deviation) and advance the deadline.
+ */
+void periodic_release(periodic_t *p, int64_t now);
+
+/**
+ * @brief Apply a pending period change: next deadline = last release + period, not before @p now.
+ */
+void periodic_reanchor(periodic_t *p, int64_t now);
+
+/**
+ * @brief Change the period from any task and wake the owner to apply it now.
+ *
+ * The next deadline becomes last release + new period (or now, if that already passed).
+ */
+void periodic_set_period(periodic_t *p, uint32_t period_ms);
+
+/**
+ * @brief Current nominal period in milliseconds.
+ */
+uint32_t periodic_get_period_ms(const periodic_t *p);
+
+#endif // PERIODIC_H
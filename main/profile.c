@@ -0,0 +1,117 @@
+/**
+ * @file profile.c
+ * @brief Registry and statistics for cycle-counter profiling probes.
+ *
+ * Probes are statically allocated by PROF_SCOPE and linked into a global list the first time
+ * they record a sample. Statistics are updated under a short spinlock so probes shared by
+ * several tasks (e.g. both cores) stay consistent. Samples where the task migrated to the
+ * other core between begin and end are discarded, since cycle counters are per core.
+ */
+
+#include "profile.h"
+
+#if CONFIG_FLORALINK_PROFILE
+
+#include <stdio.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "esp_cpu.h"
+#include "esp_rom_sys.h"
+#include "esp_app_desc.h"
+
+static portMUX_TYPE s_prof_lock = portMUX_INITIALIZER_UNLOCKED;
+static prof_probe_t *s_probes = NULL;
+
+prof_scope_t prof_scope_begin(prof_probe_t *probe)
+{
+    prof_scope_t scope = {
+        .probe = probe,
+        .core = esp_cpu_get_core_id(),
+        .start = esp_cpu_get_cycle_count()};
+    return scope;
+}
+
+void prof_scope_end(prof_scope_t *scope)
+{
+    uint32_t end = esp_cpu_get_cycle_count();
+    if (esp_cpu_get_core_id() != scope->core)
+        return;
+    prof_probe_add(scope->probe, end - scope->start);
+}
+
+static inline void probe_clear(prof_probe_t *probe)
+{
+    probe->count = 0;
+    probe->total = 0;
+    probe->min = UINT32_MAX;
+    probe->max = 0;
+    memset(probe->hist, 0, sizeof(probe->hist));
+}
+
+void prof_probe_add(prof_probe_t *probe, uint32_t cycles)
+{
+    int bucket = cycles ? 31 - __builtin_clz(cycles) : 0;
+    portENTER_CRITICAL_SAFE(&s_prof_lock);
+    if (!probe->registered)
+    {
+        probe->registered = true;
+        probe->next = s_probes;
+        s_probes = probe;
+    }
+    probe->count++;
+    probe->total += cycles;
+    if (cycles < probe->min)
+        probe->min = cycles;
+    if (cycles > probe->max)
+        probe->max = cycles;
+    probe->hist[bucket]++;
+    portEXIT_CRITICAL_SAFE(&s_prof_lock);
+}
+
+void prof_reset(void)
+{
+    portENTER_CRITICAL(&s_prof_lock);
+    for (prof_probe_t *p = s_probes; p; p = p->next)
+        probe_clear(p);
+    portEXIT_CRITICAL(&s_prof_lock);
+}
+
+esp_err_t prof_export_json(trace_write_fn_t write, void *ctx, bool reset)
+{
+    char buf[512];
+    int n = snprintf(buf, sizeof(buf), "{\"version\":\"%s\",\"cpu_mhz\":%lu,\"probes\":[",
+                     esp_app_get_description()->version, (unsigned long)esp_rom_get_cpu_ticks_per_us());
+    esp_err_t err = write(ctx, buf, n);
+
+    // The list only grows at the head, so walking it without the lock is safe;
+    // each probe is copied (and cleared) under the lock to get a consistent snapshot.
+    bool first = true;
+    for (prof_probe_t *p = s_probes; p && err == ESP_OK; p = p->next, first = false)
+    {
+        prof_probe_t snap;
+        portENTER_CRITICAL(&s_prof_lock);
+        snap = *p;
+        if (reset)
+            probe_clear(p);
+        portEXIT_CRITICAL(&s_prof_lock);
+
+        n = snprintf(buf, sizeof(buf),
+                     "%s{\"name\":\"%s\",\"count\":%lu,\"total\":%llu,\"min\":%lu,\"max\":%lu,\"mean\":%lu,\"hist\":[",
+                     first ? "" : ",", snap.name, (unsigned long)snap.count,
+                     (unsigned long long)snap.total, (unsigned long)(snap.count ? snap.min : 0),
+                     (unsigned long)snap.max, (unsigned long)(snap.count ? snap.total / snap.count : 0));
+        // Trailing empty buckets are omitted
+        int last = PROF_HIST_BUCKETS - 1;
+        while (last >= 0 && snap.hist[last] == 0)
+            last--;
+        for (int b = 0; b <= last && n < (int)sizeof(buf) - 16; b++)
+            n += snprintf(buf + n, sizeof(buf) - n, "%s%lu", b ? "," : "", (unsigned long)snap.hist[b]);
+        n += snprintf(buf + n, sizeof(buf) - n, "]}");
+        err = write(ctx, buf, n);
+    }
+    if (err == ESP_OK)
+        err = write(ctx, "]}\n", strlen("]}\n"));
+    return err;
+}
+
+#endif // CONFIG_FLORALINK_PROFILE
@@ -0,0 +1,95 @@
+/**
+ * @file profile.h
+ * @brief Cycle-counter profiling probes for hot paths.
+ *
+ * A probe accumulates call count, total/min/max CPU cycles and a log2 histogram of the
+ * cycles spent in a scope. Probes register themselves on first use, can be dumped as JSON
+ * at runtime (GET /profile) and reset, so builds can be compared on real hardware.
+ *
+ * The PROF_SCOPE macro compiles to nothing unless CONFIG_FLORALINK_PROFILE is enabled.
+ *
+ * Usage Example:
+ * @code
+ *   void blink_toggle(void) {
+ *       PROF_SCOPE("blink_toggle");
+ *       ...
+ *   }
+ * @endcode
+ */
+
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "sdkconfig.h"
+#include "trace.h"
+
+#define PROF_HIST_BUCKETS 32 // Bucket i counts samples of [2^i, 2^(i+1)) cycles
+
+typedef struct prof_probe
+{
+    const char *name;
+    uint32_t count;
+    uint64_t total;
+    uint32_t min;
+    uint32_t max;
+    uint32_t hist[PROF_HIST_BUCKETS];
+    struct prof_probe *next;
+    bool registered;
+} prof_probe_t;
+
+#if CONFIG_FLORALINK_PROFILE
+
+typedef struct
+{
+    prof_probe_t *probe;
+    uint32_t start;
+    int core;
+} prof_scope_t;
+
+prof_scope_t prof_scope_begin(prof_probe_t *probe);
+void prof_scope_end(prof_scope_t *scope);
+
+/**
+ * @brief Add one sample of @p cycles to a probe (registers the probe on first use).
+ */
+void prof_probe_add(prof_probe_t *probe, uint32_t cycles);
+
+/**
+ * @brief Clear the statistics of every registered probe.
+ */
+void prof_reset(void);
+
+/**
+ * @brief Stream all registered probes as JSON, including the firmware version.
+ * @param write Output callback (same contract as trace_export_json())
+ * @param ctx Opaque pointer passed to @p write
+ * @param reset Clear each probe as it is read, under the same lock, so no sample recorded
+ *              while the export runs is lost (unlike a prof_reset() call afterwards)
+ * @return ESP_OK on success, or the first error returned by @p write.
+ */
+esp_err_t prof_export_json(trace_write_fn_t write, void *ctx, bool reset);
+
+#define PROF_CONCAT_(a, b) a##b
+#define PROF_CONCAT(a, b) PROF_CONCAT_(a, b)
+#define PROF_PROBE_INIT(probe_name) {.name = (probe_name), .min = UINT32_MAX}
+
+// Time the rest of the enclosing block against a static probe named @p probe_name
+#define PROF_SCOPE(probe_name)                                                                    \
+    static prof_probe_t PROF_CONCAT(__prof_probe_, __LINE__) = PROF_PROBE_INIT(probe_name);       \
+    prof_scope_t PROF_CONCAT(__prof_scope_, __LINE__) __attribute__((cleanup(prof_scope_end))) = \
+        prof_scope_begin(&PROF_CONCAT(__prof_probe_, __LINE__))
+
+#else
+
+#define PROF_SCOPE(probe_name) \
+    do                         \
+    {                          \
+    } while (0)
+
+#endif // CONFIG_FLORALINK_PROFILE
+
+#endif // PROFILE_H
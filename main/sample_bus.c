@@ -0,0 +1,140 @@
+/**
+ * @file sample_bus.c
+ * @brief Lock-free sample ring with per-subscriber cursors.
+ *
+ * Slot i holds the sample whose sequence number is congruent to i modulo the ring length.
+ * The producer clears the slot's stamp, writes the sample and stores the new sequence
+ * number as stamp (a per-slot seqlock); then it advances the head. A reader copies a slot
+ * and accepts the copy only if the stamp equals the expected sequence number both before
+ * and after the copy, otherwise the slot was recycled underneath it and it skips ahead.
+ */
+
+#include "sample_bus.h"
+#include <stdatomic.h>
+#include "esp_timer.h"
+#include "sdkconfig.h"
+
+#define SAMPLE_BUS_DEPTH CONFIG_FLORALINK_SAMPLE_BUS_DEPTH
+#define SAMPLE_BUS_MASK (SAMPLE_BUS_DEPTH - 1)
+
+_Static_assert((SAMPLE_BUS_DEPTH & SAMPLE_BUS_MASK) == 0, "CONFIG_FLORALINK_SAMPLE_BUS_DEPTH must be a power of two");
+
+typedef struct
+{
+    atomic_uint stamp; // Sequence number of the sample held, 0 while it is rewritten
+    sample_t sample;
+} bus_slot_t;
+
+static bus_slot_t s_ring[SAMPLE_BUS_DEPTH];
+static atomic_uint s_head; // Sequence number of the newest sample, 0 before the first
+static int64_t s_first_us = -1;
+static sample_sub_t *s_subs = NULL;
+static portMUX_TYPE s_subs_lock = portMUX_INITIALIZER_UNLOCKED;
+
+void sample_bus_publish(uint32_t distance_cm, esp_err_t err)
+{
+    uint32_t seq = atomic_load_explicit(&s_head, memory_order_relaxed) + 1;
+    bus_slot_t *slot = &s_ring[seq & SAMPLE_BUS_MASK];
+
+    atomic_store_explicit(&slot->stamp, 0, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    slot->sample.ts_us = esp_timer_get_time();
+    slot->sample.seq = seq;
+    slot->sample.distance_cm = err == ESP_OK ? distance_cm : 0;
+    slot->sample.err = (int32_t)err;
+    atomic_store_explicit(&slot->stamp, seq, memory_order_release);
+    atomic_store_explicit(&s_head, seq, memory_order_release);
+    if (seq == 1)
+        s_first_us = slot->sample.ts_us;
+
+    for (sample_sub_t *sub = s_subs; sub; sub = sub->next)
+    {
+        if (sub->notify)
+            xTaskNotifyGive(sub->notify);
+        if (sub->wake)
+            sub->wake(sub);
+    }
+}
+
+// Copy sample @p seq; false if its slot does not (or no longer) hold it
+static bool bus_copy(uint32_t seq, sample_t *out)
+{
+    bus_slot_t *slot = &s_ring[seq & SAMPLE_BUS_MASK];
+    if (atomic_load_explicit(&slot->stamp, memory_order_acquire) != seq)
+        return false;
+    *out = slot->sample;
+    atomic_thread_fence(memory_order_acquire);
+    return atomic_load_explicit(&slot->stamp, memory_order_relaxed) == seq;
+}
+
+esp_err_t sample_bus_latest(sample_t *out)
+{
+    for (;;)
+    {
+        uint32_t head = atomic_load_explicit(&s_head, memory_order_acquire);
+        if (head == 0)
+            return ESP_ERR_NOT_FOUND;
+        if (bus_copy(head, out))
+            return ESP_OK;
+    }
+}
+
+void sample_bus_subscribe(sample_sub_t *sub, bool notify, bool backlog)
+{
+    uint32_t head = atomic_load(&s_head);
+    // A backlog cursor starts at (or before) the oldest sample; the first read clamps it
+    sub->cursor = backlog ? (head >= SAMPLE_BUS_DEPTH ? head - SAMPLE_BUS_DEPTH + 1 : 1) : head + 1;
+    sub->lost = 0;
+    sub->notify = notify ? xTaskGetCurrentTaskHandle() : NULL;
+    portENTER_CRITICAL(&s_subs_lock);
+    sub->next = s_subs;
+    s_subs = sub;
+    portEXIT_CRITICAL(&s_subs_lock);
+}
+
+esp_err_t sample_bus_read(sample_sub_t *sub, sample_t *out)
+{
+    for (;;)
+    {
+        uint32_t head = atomic_load_explicit(&s_head, memory_order_acquire);
+        if ((int32_t)(sub->cursor - head) > 0)
+            return ESP_ERR_NOT_FOUND;
+        uint32_t oldest = head >= SAMPLE_BUS_DEPTH ? head - SAMPLE_BUS_DEPTH + 1 : 1;
+        if ((int32_t)(sub->cursor - oldest) < 0)
+        {
+            sub->lost += oldest - sub->cursor;
+            sub->cursor = oldest;
+        }
+        if (bus_copy(sub->cursor, out))
+        {
+            sub->cursor++;
+            return ESP_OK;
+        }
+        // Recycled while copying: recompute the oldest available sample
+    }
+}
+
+esp_err_t sample_bus_wait(sample_sub_t *sub, sample_t *out, TickType_t wait)
+{
+    TickType_t start = xTaskGetTickCount();
+    for (;;)
+    {
+        if (sample_bus_read(sub, out) == ESP_OK)
+            return ESP_OK;
+        TickType_t elapsed = xTaskGetTickCount() - start;
+        if (wait != portMAX_DELAY && elapsed >= wait)
+            return ESP_ERR_TIMEOUT;
+        // The notification may come from another source (e.g. a timer); just re-check
+        ulTaskNotifyTake(pdTRUE, wait == portMAX_DELAY ? portMAX_DELAY : wait - elapsed);
+    }
+}
+
+const sample_sub_t *sample_bus_get_subs(void)
+{
+    return s_subs;
+}
+
+int64_t sample_bus_first_us(void)
+{
+    return s_first_us;
+}
@@ -0,0 +1,105 @@
+/**
+ * @file sample_bus.h
+ * @brief Single-producer, multi-subscriber ring of distance samples.
+ *
+ * The sampling task publishes every measurement (or its error) once into a shared ring.
+ * Consumers either peek at the newest sample or subscribe with their own cursor and read
+ * every sample at their own pace. Nothing is copied per subscriber and no lock is taken:
+ * each slot carries a sequence stamp that readers check before and after copying it out,
+ * so a reader that fell more than a ring length behind detects the overrun, counts the lost
+ * samples and resumes at the oldest sample still available. Publishing costs the same
+ * however many subscribers there are, apart from an optional task notification each.
+ *
+ * Configuration:
+ * - CONFIG_FLORALINK_SAMPLE_BUS_DEPTH: ring length in samples (power of two).
+ *
+ * Usage Example:
+ * @code
+ *   static sample_sub_t s_sub = SAMPLE_SUB_INIT("logger");
+ *   sample_bus_subscribe(&s_sub, true, false);
+ *   sample_t s;
+ *   while (sample_bus_wait(&s_sub, &s, portMAX_DELAY) == ESP_OK) {
+ *       printf("%lu cm\n", s.distance_cm);
+ *   }
+ * @endcode
+ */
+
+#ifndef SAMPLE_BUS_H
+#define SAMPLE_BUS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+typedef struct
+{
+    int64_t ts_us;        ///< esp_timer time of the measurement
+    uint32_t seq;         ///< Publication number, starting at 1
+    uint32_t distance_cm; ///< 0 when err != ESP_OK
+    int32_t err;          ///< ESP_OK or the measurement error
+} sample_t;
+
+typedef struct sample_sub
+{
+    const char *name;
+    uint32_t cursor;      ///< Sequence number of the next sample to read
+    uint32_t lost;        ///< Samples overwritten before this subscriber read them
+    TaskHandle_t notify;  ///< Task notified on every publication, or NULL
+    /** Called by the sampling task on every publication, or NULL. Must be short and not block
+     *  (e.g. signal an eventfd the subscriber select()s on). Set before subscribing. */
+    void (*wake)(struct sample_sub *sub);
+    struct sample_sub *next;
+} sample_sub_t;
+
+#define SAMPLE_SUB_INIT(sub_name) {.name = (sub_name)}
+
+/**
+ * @brief Publish one measurement. Only the sampling task may call this.
+ * @param distance_cm Measured distance, ignored unless @p err is ESP_OK
+ * @param err Result of the measurement
+ */
+void sample_bus_publish(uint32_t distance_cm, esp_err_t err);
+
+/**
+ * @brief Copy the newest sample.
+ * @return ESP_OK, or ESP_ERR_NOT_FOUND if nothing was published yet.
+ */
+esp_err_t sample_bus_latest(sample_t *out);
+
+/**
+ * @brief Attach a subscriber.
+ * @param sub Subscriber (static storage). Subscribers are never detached.
+ * @param notify Notify the calling task (xTaskNotifyGive) on every publication
+ * @param backlog Also deliver the samples still in the ring, e.g. those taken before the
+ *        network came up; otherwise only samples published from now on
+ */
+void sample_bus_subscribe(sample_sub_t *sub, bool notify, bool backlog);
+
+/**
+ * @brief Read the next unread sample of @p sub without blocking.
+ *
+ * After an overrun the cursor jumps to the oldest sample still in the ring and sub->lost
+ * is increased by the number of samples skipped.
+ * @return ESP_OK, or ESP_ERR_NOT_FOUND if the subscriber is up to date.
+ */
+esp_err_t sample_bus_read(sample_sub_t *sub, sample_t *out);
+
+/**
+ * @brief Like sample_bus_read(), but wait up to @p wait for a sample (notify subscribers).
+ * @return ESP_OK, or ESP_ERR_TIMEOUT.
+ */
+esp_err_t sample_bus_wait(sample_sub_t *sub, sample_t *out, TickType_t wait);
+
+/**
+ * @brief esp_timer time of the first sample since boot (time-to-first-sample), -1 if none yet.
+ */
+int64_t sample_bus_first_us(void);
+
+/**
+ * @brief First subscriber (newest first); walk with ->next.
+ */
+const sample_sub_t *sample_bus_get_subs(void);
+
+#endif // SAMPLE_BUS_H
@@ -0,0 +1,53 @@
+/**
+ * @file sample_codec.c
+ * @brief Record encoder and batching shared by the publishers.
+ */
+
+#include "sample_codec.h"
+#include <esp_timer.h>
+
+void sample_put_le(uint8_t *p, uint64_t v, int bytes)
+{
+    for (int i = 0; i < bytes; i++)
+        p[i] = (uint8_t)(v >> (8 * i));
+}
+
+uint32_t sample_dt_ms(const sample_t *samples, uint32_t i)
+{
+    int64_t dt = i ? (samples[i].ts_us - samples[i - 1].ts_us) / 1000 : 0;
+    return dt > 0xFFFF ? 0xFFFF : (uint32_t)dt;
+}
+
+size_t sample_encode_records(const sample_t *samples, uint32_t n, uint8_t *out)
+{
+    uint8_t *p = out;
+    for (uint32_t i = 0; i < n; i++, p += SAMPLE_RECORD_SIZE)
+    {
+        uint32_t cm = samples[i].err == ESP_OK ? samples[i].distance_cm : SAMPLE_RECORD_ERROR;
+        uint32_t dseq = i ? samples[i].seq - samples[i - 1].seq : 0;
+        sample_put_le(p, sample_dt_ms(samples, i), 2);
+        sample_put_le(p + 2, cm > SAMPLE_RECORD_ERROR ? SAMPLE_RECORD_ERROR : cm, 2);
+        sample_put_le(p + 4, dseq > 0xFFFF ? 0xFFFF : dseq, 2);
+    }
+    return (size_t)(p - out);
+}
+
+// Ticks until the oldest sample of the batch is due, 0 if it already is
+static TickType_t sample_ticks_until_due(const sample_t *batch, int64_t latency_us)
+{
+    int64_t left_us = batch[0].ts_us + latency_us - esp_timer_get_time();
+    return left_us > 0 ? pdMS_TO_TICKS(left_us / 1000) + 1 : 0;
+}
+
+uint32_t sample_batch_fill(sample_sub_t *sub, sample_t *batch, uint32_t len, uint32_t max, int64_t latency_us,
+                           TickType_t idle_wait)
+{
+    while (len < max)
+    {
+        TickType_t wait = len ? sample_ticks_until_due(batch, latency_us) : idle_wait;
+        if (sample_bus_wait(sub, &batch[len], wait) != ESP_OK)
+            break;
+        len++;
+    }
+    return len;
+}
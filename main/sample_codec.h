@@ -0,0 +1,50 @@
+/**
+ * @file sample_codec.h
+ * @brief Compact binary records of sample bus readings.
+ *
+ * The binary MQTT payload (mqtt_pub.h) and the UDP datagrams (udp_pub.h) carry their readings
+ * in the same 6-byte record, all integers little-endian:
+ *   {u16 dt_ms, u16 distance_cm (0xFFFF: error), u16 seq delta}
+ * dt_ms and the seq delta are relative to the previous sample of the batch (0 for the first)
+ * and saturate at 0xFFFF. Each publisher writes its own header in front of the records.
+ *
+ * Both publishers also collect their batches the same way, with sample_batch_fill().
+ */
+
+#ifndef SAMPLE_CODEC_H
+#define SAMPLE_CODEC_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "sample_bus.h"
+
+#define SAMPLE_RECORD_SIZE 6
+#define SAMPLE_RECORD_ERROR 0xFFFF ///< distance_cm of a failed measurement
+
+/**
+ * @brief Store the @p bytes low bytes of @p v at @p p, little-endian.
+ */
+void sample_put_le(uint8_t *p, uint64_t v, int bytes);
+
+/**
+ * @brief Milliseconds between @p samples[i - 1] and @p samples[i], 0 for i = 0, saturated at 0xFFFF.
+ */
+uint32_t sample_dt_ms(const sample_t *samples, uint32_t i);
+
+/**
+ * @brief Encode @p n samples as records into @p out (n * SAMPLE_RECORD_SIZE bytes).
+ * @return Bytes written.
+ */
+size_t sample_encode_records(const sample_t *samples, uint32_t n, uint8_t *out);
+
+/**
+ * @brief Read samples from @p sub into @p batch until it holds @p max, or its oldest sample is
+ *        @p latency_us old.
+ * @param len Samples already in the batch
+ * @param idle_wait Ticks to wait for the first sample while the batch is empty
+ * @return The new batch length; unchanged if no sample came in time.
+ */
+uint32_t sample_batch_fill(sample_sub_t *sub, sample_t *batch, uint32_t len, uint32_t max, int64_t latency_us,
+                           TickType_t idle_wait);
+
+#endif // SAMPLE_CODEC_H
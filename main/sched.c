@@ -0,0 +1,120 @@
+/**
+ * @file sched.c
+ * @brief Single-task executor multiplexing the periodic jobs.
+ *
+ * The executor keeps one one-shot esp_timer armed for the earliest job deadline and sleeps
+ * on its task notification in between. On every wake-up it applies pending period changes,
+ * runs each job whose deadline passed (oldest registration last) and records the release
+ * with periodic_release(), so a job's deadlines stay on its own grid whatever the others do.
+ * A job overrunning into its next period skips the lost releases (counted as missed) instead
+ * of bursting.
+ */
+
+#include "sched.h"
+#include "trace.h"
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+static const char *TAG = "sched";
+
+static sched_job_t *s_jobs = NULL;
+static TaskHandle_t s_executor = NULL;
+static portMUX_TYPE s_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static void sched_timer_cb(void *arg)
+{
+    xTaskNotifyGive((TaskHandle_t)arg);
+}
+
+esp_err_t sched_add(sched_job_t *job, uint32_t period_ms)
+{
+    if (!job || !job->fn || period_ms == 0)
+        return ESP_ERR_INVALID_ARG;
+    portENTER_CRITICAL(&s_lock);
+    periodic_bind(&job->timing, s_executor, period_ms);
+    job->next = s_jobs;
+    s_jobs = job;
+    TaskHandle_t executor = s_executor;
+    portEXIT_CRITICAL(&s_lock);
+    if (executor)
+        xTaskNotifyGive(executor);
+    return ESP_OK;
+}
+
+void sched_set_period(sched_job_t *job, uint32_t period_ms)
+{
+    periodic_set_period(&job->timing, period_ms);
+}
+
+const sched_job_t *sched_get_jobs(void)
+{
+    return s_jobs;
+}
+
+// Run @p job once and account its run time
+static void sched_run_job(sched_job_t *job)
+{
+    TRACE_BEGIN(job->name);
+    int64_t start = esp_timer_get_time();
+    job->fn(job->arg);
+    uint32_t run_us = (uint32_t)(esp_timer_get_time() - start);
+    TRACE_END(job->name);
+    job->runs++;
+    job->run_total_us += run_us;
+    if (run_us > job->run_max_us)
+        job->run_max_us = run_us;
+}
+
+void sched_run(void)
+{
+    esp_timer_handle_t timer = NULL;
+    TaskHandle_t self = xTaskGetCurrentTaskHandle();
+    const esp_timer_create_args_t args = {
+        .callback = sched_timer_cb,
+        .arg = self,
+        .name = "sched"};
+    if (esp_timer_create(&args, &timer) != ESP_OK)
+    {
+        ESP_LOGE(TAG, "esp_timer_create failed");
+        vTaskDelete(NULL);
+    }
+
+    // Jobs registered before the executor existed get it as their owner now
+    portENTER_CRITICAL(&s_lock);
+    s_executor = self;
+    for (sched_job_t *job = s_jobs; job; job = job->next)
+        job->timing.owner = self;
+    portEXIT_CRITICAL(&s_lock);
+    ESP_LOGI(TAG, "Executor started, on core %d", xPortGetCoreID());
+
+    while (1)
+    {
+        int64_t now = esp_timer_get_time();
+        int64_t earliest = INT64_MAX;
+        for (sched_job_t *job = s_jobs; job; job = job->next)
+        {
+            if (job->timing.reconfigured)
+            {
+                periodic_reanchor(&job->timing, now);
+                if (job->timing.period_us == 0) // Parked
+                    job->timing.next_us = INT64_MAX;
+            }
+            if (now >= job->timing.next_us)
+            {
+                periodic_release(&job->timing, now);
+                sched_run_job(job);
+                now = esp_timer_get_time();
+            }
+            if (job->timing.next_us < earliest)
+                earliest = job->timing.next_us;
+        }
+        // A job may already be due again after the others ran; rescan before sleeping
+        if (earliest <= now)
+            continue;
+        esp_timer_stop(timer);
+        if (earliest != INT64_MAX)
+            esp_timer_start_once(timer, (uint64_t)(earliest - now));
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    }
+}
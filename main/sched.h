@@ -0,0 +1,73 @@
+/**
+ * @file sched.h
+ * @brief Cooperative executor for short periodic jobs.
+ *
+ * Instead of one FreeRTOS task (and stack) per periodic activity, short non-blocking jobs
+ * are registered with the scheduler and run one after the other by a single executor task.
+ * Each job keeps its own absolute-deadline grid (periodic_t), so lateness and jitter are
+ * recorded exactly as for a dedicated task, plus the time spent running it.
+ *
+ * Jobs must not block: anything that waits on hardware (e.g. the ultrasonic ping) keeps its
+ * own task.
+ *
+ * Usage Example:
+ * @code
+ *   static void heartbeat(void *arg) { ... }
+ *   static sched_job_t s_heartbeat = SCHED_JOB_INIT("heartbeat", heartbeat, NULL);
+ *   sched_add(&s_heartbeat, 1000);
+ * @endcode
+ */
+
+#ifndef SCHED_H
+#define SCHED_H
+
+#include <stdint.h>
+#include "esp_err.h"
+#include "periodic.h"
+
+typedef void (*sched_fn_t)(void *arg);
+
+typedef struct sched_job
+{
+    const char *name;
+    sched_fn_t fn;
+    void *arg;
+    periodic_t timing;        ///< Deadline grid and release statistics
+    uint32_t runs;
+    uint32_t run_max_us;
+    uint64_t run_total_us;
+    struct sched_job *next;
+} sched_job_t;
+
+#define SCHED_JOB_INIT(job_name, job_fn, job_arg) {.name = (job_name), .fn = (job_fn), .arg = (job_arg)}
+
+/**
+ * @brief Register a job; it is first released immediately, then every @p period_ms.
+ *
+ * May be called before or after the executor started. Jobs are never removed.
+ * @param job Job (static storage)
+ * @param period_ms Period in milliseconds
+ * @return ESP_OK, or ESP_ERR_INVALID_ARG for a NULL job/function or zero period.
+ */
+esp_err_t sched_add(sched_job_t *job, uint32_t period_ms);
+
+/**
+ * @brief Change a job's period; applies immediately (see periodic_set_period()).
+ *
+ * A zero period parks the job until its period is set again.
+ */
+void sched_set_period(sched_job_t *job, uint32_t period_ms);
+
+/**
+ * @brief First registered job (newest first); walk with ->next.
+ */
+const sched_job_t *sched_get_jobs(void);
+
+/**
+ * @brief Executor loop: runs due jobs and sleeps until the earliest deadline. Never returns.
+ *
+ * Called from the body of the executor task.
+ */
+void sched_run(void);
+
+#endif // SCHED_H
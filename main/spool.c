@@ -0,0 +1,415 @@
+/**
+ * @file spool.c
+ * @brief Circular record log on raw partition sectors.
+ *
+ * Every 4 KiB sector starts with a header {magic, seq, ~seq} written right after the sector
+ * is erased; seq grows by one per sector used, so the sector with the highest seq is the
+ * head and the log order survives a reboot. Records are 8 bytes and fill the rest of the
+ * sector. Flash writes only ever clear bits: a record is programmed once (state
+ * SPOOL_PENDING) and marked as delivered by programming its state byte to SPOOL_SENT, so no
+ * cursor has to be stored and no sector is erased except when the head wraps onto it. The
+ * log therefore wears every sector evenly, once per lap.
+ *
+ * A torn header (power loss during the erase or the header write) makes the sector count as
+ * free; a torn record fails its CRC and is skipped.
+ */
+
+#include "sdkconfig.h"
+
+#if CONFIG_FLORALINK_SPOOL
+
+#include "spool.h"
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <esp_log.h>
+#include <esp_partition.h>
+#include <esp_timer.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "timesync.h"
+
+#define SPOOL_SECTOR 4096
+#define SPOOL_MAGIC 0x314C5053 // "SPL1"
+#define SPOOL_HEADER 16        // Sector header, padded to a record boundary
+#define SPOOL_SLOTS ((SPOOL_SECTOR - SPOOL_HEADER) / sizeof(spool_record_t))
+#define SPOOL_REPLAY_CHUNKS 8 // Chunks of already delivered records skipped per job run
+
+_Static_assert(sizeof(spool_record_t) == 8, "spool_record_t must stay 8 bytes");
+
+typedef struct
+{
+    uint32_t magic;
+    uint32_t seq;
+    uint32_t seq_inv; // ~seq: a torn header does not validate
+    uint32_t reserved;
+} spool_header_t;
+
+static const char *TAG = "Spool";
+
+static const esp_partition_t *s_part = NULL;
+static uint32_t s_sectors = 0;
+static SemaphoreHandle_t s_lock = NULL;
+static const spool_sink_t *s_sink = NULL;
+
+// Next free slot, and the sequence number of its sector
+static uint32_t s_head_sector = 0;
+static uint32_t s_head_slot = 0;
+static uint32_t s_head_seq = 0;
+// Next record to consider for replay
+static uint32_t s_tail_sector = 0;
+static uint32_t s_tail_slot = 0;
+
+static spool_record_t s_page[SPOOL_BATCH]; // Appended records not written yet
+static uint32_t s_page_len = 0;
+static spool_stats_t s_stats = {0};
+static int64_t s_next_replay_us = 0;
+
+static uint8_t spool_crc8(const spool_record_t *r)
+{
+    const uint8_t *p = (const uint8_t *)r;
+    uint8_t crc = 0x5A; // Non-zero seed: an all-0xFF (erased) slot never validates
+    for (size_t i = 0; i < offsetof(spool_record_t, crc); i++)
+    {
+        crc ^= p[i];
+        for (int b = 0; b < 8; b++)
+            crc = (crc & 0x80) ? (uint8_t)((crc << 1) ^ 0x07) : (uint8_t)(crc << 1);
+    }
+    return crc;
+}
+
+static bool spool_is_erased(const spool_record_t *r)
+{
+    static const spool_record_t erased = {0xFFFFFFFF, 0xFFFF, 0xFF, 0xFF};
+    return memcmp(r, &erased, sizeof(*r)) == 0;
+}
+
+static bool spool_is_pending(const spool_record_t *r)
+{
+    return r->state == SPOOL_PENDING && !spool_is_erased(r) && r->crc == spool_crc8(r);
+}
+
+static size_t spool_offset(uint32_t sector, uint32_t slot)
+{
+    return (size_t)sector * SPOOL_SECTOR + SPOOL_HEADER + slot * sizeof(spool_record_t);
+}
+
+static bool spool_read_header(uint32_t sector, uint32_t *seq)
+{
+    spool_header_t h;
+    if (esp_partition_read(s_part, (size_t)sector * SPOOL_SECTOR, &h, sizeof(h)) != ESP_OK)
+        return false;
+    if (h.magic != SPOOL_MAGIC || h.seq != ~h.seq_inv)
+        return false;
+    *seq = h.seq;
+    return true;
+}
+
+static esp_err_t spool_format_sector(uint32_t sector, uint32_t seq)
+{
+    spool_header_t h = {SPOOL_MAGIC, seq, ~seq, 0xFFFFFFFF};
+    esp_err_t err = esp_partition_erase_range(s_part, (size_t)sector * SPOOL_SECTOR, SPOOL_SECTOR);
+    if (err == ESP_OK)
+        err = esp_partition_write(s_part, (size_t)sector * SPOOL_SECTOR, &h, sizeof(h));
+    s_stats.erases++;
+    return err;
+}
+
+// Count the pending records of @p sector from @p slot on; *first is set to the first one
+static uint32_t spool_scan_sector(uint32_t sector, uint32_t slot, uint32_t *first, uint32_t *free_slot)
+{
+    spool_record_t chunk[SPOOL_BATCH];
+    uint32_t pending = 0;
+    *first = SPOOL_SLOTS;
+    *free_slot = SPOOL_SLOTS;
+    for (; slot < SPOOL_SLOTS; slot += SPOOL_BATCH)
+    {
+        uint32_t n = SPOOL_SLOTS - slot < SPOOL_BATCH ? SPOOL_SLOTS - slot : SPOOL_BATCH;
+        if (esp_partition_read(s_part, spool_offset(sector, slot), chunk, n * sizeof(spool_record_t)) != ESP_OK)
+            break;
+        for (uint32_t i = 0; i < n; i++)
+        {
+            if (spool_is_erased(&chunk[i]))
+            {
+                // Records are appended in order: the first erased slot ends the sector
+                *free_slot = slot + i;
+                return pending;
+            }
+            if (spool_is_pending(&chunk[i]))
+            {
+                if (!pending)
+                    *first = slot + i;
+                pending++;
+            }
+        }
+    }
+    return pending;
+}
+
+// Caller holds s_lock. Move the head to the next sector, dropping what is left unsent there.
+static esp_err_t spool_advance_head(void)
+{
+    uint32_t next = (s_head_sector + 1) % s_sectors;
+    if (s_tail_sector == next)
+    {
+        uint32_t first, free_slot;
+        uint32_t lost = spool_scan_sector(next, s_tail_slot, &first, &free_slot);
+        s_stats.dropped += lost;
+        s_stats.pending -= lost;
+        s_tail_sector = (next + 1) % s_sectors;
+        s_tail_slot = 0;
+        ESP_LOGW(TAG, "Log full, dropped %lu undelivered records", (unsigned long)lost);
+    }
+    s_head_sector = next;
+    esp_err_t err = spool_format_sector(next, ++s_head_seq);
+    // A sector that could not be formatted is left behind by the next write
+    s_head_slot = err == ESP_OK ? 0 : SPOOL_SLOTS;
+    return err;
+}
+
+// Caller holds s_lock. Program the RAM page into the head sector(s). On a failure the records not
+// written stay in the page and are written to the same slots by the next call: programming the
+// same bytes again over a partly programmed range gives the same records.
+static esp_err_t spool_write_page(void)
+{
+    uint32_t done = 0;
+    esp_err_t err = ESP_OK;
+    while (done < s_page_len && err == ESP_OK)
+    {
+        if (s_head_slot >= SPOOL_SLOTS)
+        {
+            err = spool_advance_head();
+            continue;
+        }
+        uint32_t n = s_page_len - done;
+        if (n > SPOOL_SLOTS - s_head_slot)
+            n = SPOOL_SLOTS - s_head_slot;
+        err = esp_partition_write(s_part, spool_offset(s_head_sector, s_head_slot), &s_page[done],
+                                  n * sizeof(spool_record_t));
+        s_stats.page_writes++;
+        if (err != ESP_OK)
+            break;
+        s_head_slot += n;
+        done += n;
+    }
+    s_page_len -= done;
+    memmove(s_page, &s_page[done], s_page_len * sizeof(spool_record_t));
+    if (err != ESP_OK)
+        ESP_LOGE(TAG, "Write failed (%s), %lu records kept in RAM", esp_err_to_name(err), (unsigned long)s_page_len);
+    return err;
+}
+
+esp_err_t spool_init(void)
+{
+    s_part = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, "spool");
+    if (!s_part || s_part->size < 2 * SPOOL_SECTOR)
+    {
+        ESP_LOGE(TAG, "No usable \"spool\" partition");
+        s_part = NULL;
+        return ESP_ERR_NOT_FOUND;
+    }
+    s_sectors = s_part->size / SPOOL_SECTOR;
+    s_lock = xSemaphoreCreateMutex();
+
+    // Head: highest sequence number. Oldest: lowest one.
+    bool any = false;
+    uint32_t oldest = 0, oldest_seq = 0;
+    for (uint32_t i = 0; i < s_sectors; i++)
+    {
+        uint32_t seq;
+        if (!spool_read_header(i, &seq))
+            continue;
+        if (!any || seq > s_head_seq)
+        {
+            s_head_seq = seq;
+            s_head_sector = i;
+        }
+        if (!any || seq < oldest_seq)
+        {
+            oldest_seq = seq;
+            oldest = i;
+        }
+        any = true;
+    }
+    if (!any)
+    {
+        ESP_LOGI(TAG, "New log in %lu sectors", (unsigned long)s_sectors);
+        s_head_seq = 1;
+        s_head_sector = s_tail_sector = 0;
+        esp_err_t err = spool_format_sector(0, s_head_seq);
+        if (err != ESP_OK)
+        {
+            s_part = NULL;
+            return err;
+        }
+        return ESP_OK;
+    }
+
+    // Replay cursor: first pending record from the oldest sector on
+    uint32_t first, free_slot;
+    bool tail_found = false;
+    s_tail_sector = s_head_sector;
+    s_tail_slot = 0;
+    for (uint32_t k = 0; k < s_sectors; k++)
+    {
+        uint32_t sector = (oldest + k) % s_sectors;
+        uint32_t seq;
+        if (!spool_read_header(sector, &seq))
+            continue;
+        uint32_t pending = spool_scan_sector(sector, 0, &first, &free_slot);
+        if (pending && !tail_found)
+        {
+            s_tail_sector = sector;
+            s_tail_slot = first;
+            tail_found = true;
+        }
+        s_stats.pending += pending;
+        if (sector == s_head_sector)
+        {
+            s_head_slot = free_slot;
+            break;
+        }
+    }
+    if (!tail_found)
+        s_tail_slot = s_head_slot;
+    ESP_LOGI(TAG, "%lu records to replay, head sector %lu slot %lu", (unsigned long)s_stats.pending,
+             (unsigned long)s_head_sector, (unsigned long)s_head_slot);
+    return ESP_OK;
+}
+
+void spool_set_sink(const spool_sink_t *sink)
+{
+    s_sink = sink;
+}
+
+void spool_append(const sample_t *samples, uint32_t n)
+{
+    if (!s_part)
+        return;
+    int64_t now_us = esp_timer_get_time();
+    bool clock_set = timesync_is_set();
+    uint32_t now_s = (uint32_t)time(NULL);
+    uint32_t stored = 0;
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    for (uint32_t i = 0; i < n; i++)
+    {
+        if (s_page_len == SPOOL_BATCH)
+        {
+            // The page could not be written and is still full: the reading is lost
+            s_stats.dropped++;
+            continue;
+        }
+        spool_record_t *r = &s_page[s_page_len++];
+        uint32_t cm = samples[i].distance_cm;
+        if (clock_set)
+            r->t_s = now_s - (uint32_t)((now_us - samples[i].ts_us) / 1000000);
+        else
+            r->t_s = SPOOL_T_UPTIME | (uint32_t)(samples[i].ts_us / 1000000);
+        r->distance_cm = samples[i].err != ESP_OK || cm >= SPOOL_ERROR ? SPOOL_ERROR : (uint16_t)cm;
+        r->crc = spool_crc8(r);
+        r->state = SPOOL_PENDING;
+        stored++;
+        if (s_page_len == SPOOL_BATCH)
+            spool_write_page();
+    }
+    s_stats.appended += n;
+    s_stats.pending += stored;
+    xSemaphoreGive(s_lock);
+}
+
+esp_err_t spool_flush(void)
+{
+    if (!s_part)
+        return ESP_ERR_INVALID_STATE;
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    esp_err_t err = s_page_len ? spool_write_page() : ESP_OK;
+    xSemaphoreGive(s_lock);
+    return err;
+}
+
+// Caller holds s_lock. Deliver the next chunk holding pending records; false when done for now.
+static bool spool_replay_chunk(void)
+{
+    if (s_tail_sector == s_head_sector && s_tail_slot >= s_head_slot)
+        return false;
+    if (s_tail_slot >= SPOOL_SLOTS)
+    {
+        s_tail_sector = (s_tail_sector + 1) % s_sectors;
+        s_tail_slot = 0;
+        return true;
+    }
+
+    spool_record_t chunk[SPOOL_BATCH];
+    spool_record_t out[SPOOL_BATCH];
+    uint32_t end = s_tail_sector == s_head_sector ? s_head_slot : SPOOL_SLOTS;
+    uint32_t n = end - s_tail_slot < SPOOL_BATCH ? end - s_tail_slot : SPOOL_BATCH;
+    size_t offset = spool_offset(s_tail_sector, s_tail_slot);
+    if (esp_partition_read(s_part, offset, chunk, n * sizeof(spool_record_t)) != ESP_OK)
+        return false;
+
+    uint32_t count = 0;
+    for (uint32_t i = 0; i < n; i++)
+    {
+        if (spool_is_pending(&chunk[i]))
+        {
+            out[count++] = chunk[i];
+            chunk[i].state = SPOOL_SENT;
+        }
+        else if (chunk[i].state == SPOOL_PENDING && !spool_is_erased(&chunk[i]))
+        {
+            s_stats.corrupt++;
+        }
+    }
+    if (count)
+    {
+        if (s_sink->deliver(out, count) != ESP_OK)
+            return false;
+        // Only clears the state bytes; the other bits are programmed to what they already are
+        esp_partition_write(s_part, offset, chunk, n * sizeof(spool_record_t));
+        s_stats.replayed += count;
+        s_stats.pending -= count;
+    }
+    s_tail_slot += n;
+    return count == 0; // One delivered batch per run: that is the rate limit
+}
+
+bool spool_replay(void)
+{
+    if (!s_part || !s_stats.pending)
+        return false;
+    int64_t now = esp_timer_get_time();
+    if (!s_sink || now < s_next_replay_us || !s_sink->ready())
+        return true;
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    if (s_page_len)
+        spool_write_page(); // Keep the replay in order with what is still in RAM
+    for (int i = 0; i < SPOOL_REPLAY_CHUNKS && spool_replay_chunk(); i++)
+    {
+    }
+    bool more = s_stats.pending && !(s_tail_sector == s_head_sector && s_tail_slot >= s_head_slot);
+    xSemaphoreGive(s_lock);
+    s_next_replay_us = now + (int64_t)CONFIG_FLORALINK_SPOOL_REPLAY_MS * 1000;
+    return more;
+}
+
+void spool_get_stats(spool_stats_t *stats)
+{
+    *stats = s_stats;
+}
+
+esp_err_t spool_export_json(trace_write_fn_t write, void *ctx)
+{
+    spool_stats_t st;
+    spool_get_stats(&st);
+    char buf[192];
+    int n = snprintf(buf, sizeof(buf),
+                     "{\"appended\":%lu,\"replayed\":%lu,\"pending\":%lu,\"dropped\":%lu,\"corrupt\":%lu,"
+                     "\"page_writes\":%lu,\"erases\":%lu}",
+                     (unsigned long)st.appended, (unsigned long)st.replayed, (unsigned long)st.pending,
+                     (unsigned long)st.dropped, (unsigned long)st.corrupt, (unsigned long)st.page_writes,
+                     (unsigned long)st.erases);
+    return write(ctx, buf, n);
+}
+
+#endif // CONFIG_FLORALINK_SPOOL
@@ -0,0 +1,110 @@
+/**
+ * @file spool.h
+ * @brief Store-and-forward spool of readings in a dedicated flash partition.
+ *
+ * A publisher that cannot deliver (broker or network down) hands its samples to the spool
+ * instead of dropping them. They are appended to a circular log in the "spool" data
+ * partition, collected in RAM and programmed one flash page at a time. Once the publisher
+ * reports it is ready again, it calls spool_replay() from its own task, which replays the log
+ * oldest first, at most one batch per CONFIG_FLORALINK_SPOOL_REPLAY_MS, so a long outage does
+ * not flood the link when it returns.
+ *
+ * The log survives reboots and power loss: on boot the partition is scanned to find the
+ * newest sector and the oldest undelivered record. Delivery is at least once; a record may
+ * be replayed twice if power fails between delivery and marking it as sent.
+ *
+ * Records are stamped with wall-clock time when the clock is set (timesync.h). Readings taken
+ * before that, e.g. after a power loss with the network down, keep the seconds since their
+ * boot instead, marked with SPOOL_T_UPTIME.
+ *
+ * Configuration:
+ * - CONFIG_FLORALINK_SPOOL: enable the spool (needs the "spool" partition of partitions.csv).
+ * - CONFIG_FLORALINK_SPOOL_REPLAY_MS: pause between two replayed batches.
+ */
+
+#ifndef SPOOL_H
+#define SPOOL_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "sample_bus.h"
+#include "trace.h"
+
+#define SPOOL_BATCH 32 ///< Records per flash page write and per replayed batch
+
+/** One reading as kept in flash (8 bytes). */
+typedef struct
+{
+    uint32_t t_s;         ///< Unix time of the reading, or seconds since boot with SPOOL_T_UPTIME
+    uint16_t distance_cm; ///< SPOOL_ERROR if the measurement failed
+    uint8_t crc;          ///< CRC-8 of the fields above; detects torn writes
+    uint8_t state;        ///< SPOOL_PENDING until delivered, then SPOOL_SENT
+} spool_record_t;
+
+#define SPOOL_T_UPTIME 0x80000000u ///< t_s flag: the clock was not set, t_s is seconds since boot
+#define SPOOL_ERROR 0xFFFF
+#define SPOOL_PENDING 0xFF
+#define SPOOL_SENT 0x00
+
+typedef struct
+{
+    /** True while the publisher can take replayed records. */
+    bool (*ready)(void);
+    /** Deliver @p n records, oldest first; ESP_OK marks them as sent. Runs in spool_replay(). */
+    esp_err_t (*deliver)(const spool_record_t *records, uint32_t n);
+} spool_sink_t;
+
+typedef struct
+{
+    uint32_t appended;    ///< Records handed to the spool
+    uint32_t replayed;    ///< Records delivered from the spool
+    uint32_t pending;     ///< Records in flash or RAM not delivered yet
+    uint32_t dropped;     ///< Records overwritten because the log was full, or lost while the flash failed
+    uint32_t corrupt;     ///< Records skipped for a bad CRC
+    uint32_t page_writes; ///< Flash writes of appended records
+    uint32_t erases;      ///< Sectors erased
+} spool_stats_t;
+
+/**
+ * @brief Mount the spool partition (scan for the head and the replay cursor).
+ * @return ESP_OK, ESP_ERR_NOT_FOUND without a "spool" partition.
+ */
+esp_err_t spool_init(void);
+
+/**
+ * @brief Register the publisher records are replayed to (one sink).
+ */
+void spool_set_sink(const spool_sink_t *sink);
+
+/**
+ * @brief Append samples that could not be delivered. Written to flash in page-sized batches.
+ */
+void spool_append(const sample_t *samples, uint32_t n);
+
+/**
+ * @brief Replay one batch to the sink if it is ready and the replay pace allows it. Reads and
+ *        programs flash and runs the sink's deliver(), so call it from the publisher's task.
+ * @return True while records are left to replay.
+ */
+bool spool_replay(void);
+
+/**
+ * @brief Write the records still buffered in RAM, e.g. before deep sleep.
+ */
+esp_err_t spool_flush(void);
+
+/**
+ * @brief Copy the record counts and the flash wear counters.
+ */
+void spool_get_stats(spool_stats_t *stats);
+
+/**
+ * @brief Stream the spool_stats_t fields as the "spool" object of /stats.
+ * @param write Output callback (same contract as trace_export_json())
+ * @param ctx Opaque pointer passed to @p write
+ * @return ESP_OK on success, or the error returned by @p write.
+ */
+esp_err_t spool_export_json(trace_write_fn_t write, void *ctx);
+
+#endif // SPOOL_H
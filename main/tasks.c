@@ -3,27 +3,51 @@
  * @brief Main application task management for the ESP32 project.
  *
  * This file defines and launches the FreeRTOS tasks that make up the application:
- * - LED blinking
  * - Ultrasonic distance measurement
  * - RMT monitoring (via monitor module)
+ * - The job scheduler running LED blinking and the CPU load update
  *
  * Each task is responsible for a specific function and runs independently under FreeRTOS.
  * The init task performs system initialization and launches the other tasks.
  *
  * Task Overview:
- * - led_task: Toggles the LED at a configurable interval.
  * - distance_task: Periodically measures distance and logs the result.
  * - monitor_task: (see monitor.c) Handles RMT event logging.
+ * - sched_task: (see sched.c) Runs the short periodic jobs "led" (toggles the LED at a
+ *   configurable interval, parked while the RMT loop blinks it) and "cpu_load", sharing one
+ *   stack.
  *
  * FreeRTOS Integration:
- * - Tasks are created with xTaskCreate or xTaskCreatePinnedToCore.
- * - vTaskDelay is used for periodic scheduling.
- * - All initialization is performed in init_task, which deletes itself after setup.
+ * - Every task is a row of s_tasks (priority, stack, core, period), tunable via Kconfig.
+ * - Rows are created with xTaskCreatePinnedToCore; a core that does not exist on the
+ *   target (e.g. core 1 on the esp32c3) falls back to no affinity.
+ * - Periodic tasks are released on absolute esp_timer deadlines (periodic.c), so the time
+ *   spent measuring does not stretch the period, and record their jitter.
+ * - Jobs that never block are scheduler jobs rather than tasks; the ultrasonic ping blocks
+ *   for up to the echo timeout, so distance_task keeps its own task.
+ * - All initialization is performed in init_task, which deletes itself after setup. Sensing
+ *   starts before the network: init_task starts the tasks first and then connects Wi-Fi and
+ *   starts the web server, so a slow or failing connection never delays or stops sampling.
  */
 
 #include "blink.h"
 #include "distance.h"
 #include "monitor.h"
+#include "trace.h"
+#include "dlog.h"
+#include "sched.h"
+#include "sample_bus.h"
+#include "modemanager.h"
+#include "dutycycle.h"
+#include "energy.h"
+#include "config_store.h"
+#include "mqtt_pub.h"
+#include "spool.h"
+#include "timesync.h"
+#include "tsdb.h"
+#include "udp_pub.h"
+#include "coap_server.h"
+#include "tasks.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "esp_log.h"
@@ -36,116 +60,361 @@
 
 static const char *TAG = "FloraLink";
 
+#define SAMPLE_LOG_PERIOD_MS 1000 // Overruns of the log subscription are reported, not fatal
+
+static periodic_t s_distance_timing;
+
 /**
- * @brief Task to periodically toggle the LED.
- *
- * Uses blink_toggle() to change the LED state at the interval specified by CONFIG_BLINK_PERIOD.
- * Runs indefinitely.
- * @param pvParameters Unused
+ * @brief Job toggling the LED; its period follows blink_get_period_ms().
+ * @param arg Unused
  */
-static void led_task(void *pvParameters)
+static void led_job(void *arg)
 {
-    ESP_LOGI(TAG, "LED task started, on core %d", xPortGetCoreID());
-    while (1)
-    {
-        blink_toggle();
-        vTaskDelay(blink_get_period_ms() / portTICK_PERIOD_MS);
-    }
+    blink_toggle();
+}
+
+/**
+ * @brief Job refreshing the CPU load estimate, even if no RMT event arrived, and the power
+ *        state residency that depends on it.
+ * @param arg Unused
+ */
+static void cpu_load_job(void *arg)
+{
+    monitor_update_cpu_load();
+    energy_update();
+}
+
+/**
+ * @brief Job draining the logger's sample bus subscription.
+ * @param arg Unused
+ */
+static void sample_log_job(void *arg)
+{
+    distance_log_samples();
 }
 
+static sched_job_t s_led_job = SCHED_JOB_INIT("led_toggle", led_job, NULL);
+static sched_job_t s_cpu_load_job = SCHED_JOB_INIT("cpu_load", cpu_load_job, NULL);
+static sched_job_t s_sample_log_job = SCHED_JOB_INIT("sample_log", sample_log_job, NULL);
+
+// Apply a new blink period immediately instead of after the current (up to 10 s) wait: the
+// hardware loop is reprogrammed, and the job parked while it runs
+static void led_period_changed(uint32_t period_ms)
+{
+    sched_set_period(&s_led_job, blink_start_hw(period_ms) ? 0 : period_ms);
+}
+
+// Apply a new sampling interval at once; the distance task re-arms its deadline
+static void sample_period_changed(cfg_key_t key, uint32_t value, void *arg)
+{
+    periodic_set_period(&s_distance_timing, value);
+}
+
+static cfg_sub_t s_sample_period_sub = CFG_SUB_INIT(sample_period_changed, NULL, CFG_BIT(CFG_SAMPLE_PERIOD_MS));
+
 /**
  * @brief Task to periodically measure distance and log the result.
  *
- * Uses distance_measure() to read the ultrasonic sensor every 2 seconds.
+ * Uses distance_measure() to read the ultrasonic sensor every CFG_SAMPLE_PERIOD_MS (the
+ * configuration store; CONFIG_FLORALINK_DISTANCE_PERIOD_MS until changed) and median-filters
+ * the valid readings.
  * Also generates a test pulse on GPIO 4 for RMT monitoring.
- * @param pvParameters Unused
+ * @param pvParameters Task table row
  */
 static void distance_task(void *pvParameters)
 {
+    const task_def_t *def = pvParameters;
     ESP_LOGI(TAG, "Distance task started, on core %d", xPortGetCoreID());
+    periodic_init(def->timing, config_get(CFG_SAMPLE_PERIOD_MS));
     while (1)
     {
-        uint32_t distance = 0;
-        esp_err_t measure_result = distance_measure(400, &distance);
-        if (measure_result == ESP_OK)
+        periodic_wait(def->timing);
         {
-            // distance_publish(PUB_LOG, distance);
-            distance_publish(PUB_WEBSERVER, distance);
-        }
-        else
-        {
-            distance_publish_err(PUB_LOG, measure_result);
-            distance_publish_err(PUB_WEBSERVER, measure_result);
+            TRACE_SCOPE("distance_sample");
+            uint32_t distance = 0;
+            monitor_capture_begin();
+            esp_err_t measure_result = distance_measure(config_get(CFG_FILTER_MAX_CM), &distance);
+            monitor_capture_end();
+            if (measure_result == ESP_OK)
+                distance = distance_filter(distance);
+            // Sinks (web, log, ...) read the bus at their own pace
+            sample_bus_publish(distance, measure_result);
         }
         // Generate a test pulse for RMT monitor (4us low, 10us high)
         // misc_test_function();
-        vTaskDelay(500 / portTICK_PERIOD_MS);
     }
 }
 
-void monitor_task_1s(void *arg)
+static void monitor_task_rmt(void *arg)
 {
-    ESP_LOGI(TAG, "monitor_task_1s started, on core %d", xPortGetCoreID());
+    ESP_LOGI(TAG, "monitor_task_rmt started, on core %d", xPortGetCoreID());
     while (1)
     {
-        // Update CPU load even if no RMT event
-        monitor_update_cpu_load();
-        vTaskDelay(1000 / portTICK_PERIOD_MS);
+        monitor_process_rmt_rx();
     }
 }
 
-void monitor_task_rmt(void *arg)
+/**
+ * @brief Executor of the scheduler jobs.
+ * @param pvParameters Task table row
+ */
+static void sched_task(void *pvParameters)
+{
+    sched_run();
+}
+
+#if CONFIG_FLORALINK_DLOG
+/**
+ * @brief Low-priority task that formats deferred log records to the console.
+ * @param pvParameters Unused
+ */
+static void dlog_task(void *pvParameters)
 {
-    ESP_LOGI(TAG, "monitor_task_rmt started, on core %d", xPortGetCoreID());
     while (1)
     {
-        monitor_process_rmt_rx();
+        dlog_process(portMAX_DELAY);
+    }
+}
+#endif
+
+/**
+ * @brief Commits the changed settings to NVS.
+ * @param pvParameters Unused
+ */
+static void config_task(void *pvParameters)
+{
+    config_run();
+}
+
+#if CONFIG_FLORALINK_TSDB
+/**
+ * @brief Stores the samples in the flash history.
+ * @param pvParameters Unused
+ */
+static void tsdb_task(void *pvParameters)
+{
+    tsdb_run();
+}
+#endif
+
+#if CONFIG_FLORALINK_MQTT
+/**
+ * @brief Batches the samples and publishes them over MQTT.
+ * @param pvParameters Unused
+ */
+static void mqtt_task(void *pvParameters)
+{
+    mqtt_pub_run();
+}
+#endif
+
+#if CONFIG_FLORALINK_UDP
+/**
+ * @brief Streams the samples as UDP datagrams.
+ * @param pvParameters Unused
+ */
+static void udp_task(void *pvParameters)
+{
+    udp_pub_run();
+}
+#endif
+
+#if CONFIG_FLORALINK_COAP
+/**
+ * @brief Serves CoAP requests and notifies the observers of /distance.
+ * @param pvParameters Unused
+ */
+static void coap_task(void *pvParameters)
+{
+    coap_server_run();
+}
+#endif
+
+// Sampling outranks the UI and network work; see the "Task configuration" Kconfig menu
+static task_def_t s_tasks[] = {
+    {.name = "distance_task",
+     .fn = distance_task,
+     .stack = CONFIG_FLORALINK_TASK_DISTANCE_STACK,
+     .priority = CONFIG_FLORALINK_TASK_DISTANCE_PRIO,
+     .core = CONFIG_FLORALINK_TASK_DISTANCE_CORE,
+     .period_ms = 0, // CFG_SAMPLE_PERIOD_MS; the live period is reported by its timing
+     .timing = &s_distance_timing},
+    {.name = "monitor_task_rmt",
+     .fn = monitor_task_rmt,
+     .stack = CONFIG_FLORALINK_TASK_MONITOR_RMT_STACK,
+     .priority = CONFIG_FLORALINK_TASK_MONITOR_RMT_PRIO,
+     .core = CONFIG_FLORALINK_TASK_MONITOR_RMT_CORE,
+     .period_ms = 0},
+    {.name = "sched_task",
+     .fn = sched_task,
+     .stack = CONFIG_FLORALINK_TASK_SCHED_STACK,
+     .priority = CONFIG_FLORALINK_TASK_SCHED_PRIO,
+     .core = CONFIG_FLORALINK_TASK_SCHED_CORE,
+     .period_ms = 0},
+#if CONFIG_FLORALINK_DLOG
+    {.name = "dlog_task",
+     .fn = dlog_task,
+     .stack = CONFIG_FLORALINK_TASK_DLOG_STACK,
+     .priority = CONFIG_FLORALINK_TASK_DLOG_PRIO,
+     .core = TASK_CORE_ANY,
+     .period_ms = 0},
+#endif
+    {.name = "config_task",
+     .fn = config_task,
+     .stack = CONFIG_FLORALINK_TASK_CONFIG_STACK,
+     .priority = CONFIG_FLORALINK_TASK_CONFIG_PRIO,
+     .core = TASK_CORE_ANY,
+     .period_ms = 0},
+#if CONFIG_FLORALINK_TSDB
+    {.name = "tsdb_task",
+     .fn = tsdb_task,
+     .stack = CONFIG_FLORALINK_TASK_TSDB_STACK,
+     .priority = CONFIG_FLORALINK_TASK_TSDB_PRIO,
+     .core = TASK_CORE_ANY,
+     .period_ms = 0},
+#endif
+#if CONFIG_FLORALINK_MQTT
+    {.name = "mqtt_task",
+     .fn = mqtt_task,
+     .stack = CONFIG_FLORALINK_TASK_MQTT_STACK,
+     .priority = CONFIG_FLORALINK_TASK_MQTT_PRIO,
+     .core = TASK_CORE_ANY,
+     .period_ms = 0},
+#endif
+#if CONFIG_FLORALINK_UDP
+    {.name = "udp_task",
+     .fn = udp_task,
+     .stack = CONFIG_FLORALINK_TASK_UDP_STACK,
+     .priority = CONFIG_FLORALINK_TASK_UDP_PRIO,
+     .core = TASK_CORE_ANY,
+     .period_ms = 0},
+#endif
+#if CONFIG_FLORALINK_COAP
+    {.name = "coap_task",
+     .fn = coap_task,
+     .stack = CONFIG_FLORALINK_TASK_COAP_STACK,
+     .priority = CONFIG_FLORALINK_TASK_COAP_PRIO,
+     .core = TASK_CORE_ANY,
+     .period_ms = 0},
+#endif
+};
+
+const task_def_t *tasks_get_table(size_t *count)
+{
+    if (count)
+        *count = sizeof(s_tasks) / sizeof(s_tasks[0]);
+    return s_tasks;
+}
+
+/**
+ * @brief Create every task of the table with its configured priority, stack and core.
+ */
+static void tasks_start(void)
+{
+    for (size_t i = 0; i < sizeof(s_tasks) / sizeof(s_tasks[0]); i++)
+    {
+        task_def_t *def = &s_tasks[i];
+        BaseType_t core = (def->core >= 0 && def->core < portNUM_PROCESSORS) ? def->core : tskNO_AFFINITY;
+        if (xTaskCreatePinnedToCore(def->fn, def->name, def->stack, def, def->priority, &def->handle, core) != pdPASS)
+        {
+            ESP_LOGE(TAG, "Failed to create %s", def->name);
+        }
     }
 }
 
 /**
  * @brief Initialization task for the application.
  *
- * Initializes all modules (distance, blink, monitor) and launches the main tasks.
- * Deletes itself after setup is complete.
+ * Initializes the sensing modules (distance, blink, monitor) and launches the main tasks,
+ * then brings up Wi-Fi and the web server. Deletes itself after setup is complete.
  * @param pvParameters Unused
  */
 static void init_task(void *pvParameters)
 {
     ESP_LOGI(TAG, "Init task started on core %d", xPortGetCoreID());
     // ESP_LOGI(TAG, "Number of cores: %d", esp_cpu_get_core_count());
+    trace_init();
+    // Settings first: NVS is needed by the modules below and by Wi-Fi
+    config_init();
+#if CONFIG_FLORALINK_SPOOL
+    // Mounted before the publisher runs, so an early outage is spooled too
+    spool_init();
+#endif
+#if CONFIG_FLORALINK_TSDB
+    // Mounted before its task starts in tasks_start()
+    tsdb_init();
+#endif
+    modemanager_pm_init();
+#if CONFIG_FLORALINK_DUTY_CYCLE
+    // Armed before Wi-Fi so the node goes back to sleep even if the network never comes up
+    dutycycle_online();
+#endif
 
-    if (wifi_setup() != ESP_OK)
-    {
-        ESP_LOGE(TAG, "Failed to connect to Wi-Fi");
-        vTaskDelete(NULL);
-    }
+    // 1. Sensing first: nothing here waits for the network
     if (distance_init() != ESP_OK)
     {
+        // Keep going: the sampling task publishes the errors and the rest still works
         ESP_LOGE(TAG, "Failed to initialize distance sensor");
+    }
+    blink_init();
+    monitor_init();
+    sched_add(&s_led_job, blink_get_period_ms());
+    sched_add(&s_cpu_load_job, CONFIG_FLORALINK_CPU_LOAD_PERIOD_MS);
+    sched_add(&s_sample_log_job, SAMPLE_LOG_PERIOD_MS);
+    led_period_changed(blink_get_period_ms());
+    blink_set_period_listener(led_period_changed);
+    tasks_start();
+    config_subscribe(&s_sample_period_sub);
+
+    // 2. Network bring-up, in parallel with sampling; samples wait in the sample bus meanwhile.
+    //    The connection is made in the background and the web server follows the link state.
+    if (wifi_setup() != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Failed to start Wi-Fi, running offline");
         vTaskDelete(NULL);
     }
+#if CONFIG_FLORALINK_SNTP
+    timesync_init();
+#endif
     if (webserver_init() != ESP_OK)
     {
         ESP_LOGE(TAG, "Failed to start webserver");
-        vTaskDelete(NULL);
     }
-    blink_init();
-    monitor_init();
-    xTaskCreate(led_task, "led_task", 2048, NULL, 5, NULL);
-    xTaskCreate(distance_task, "distance_task", 8192, NULL, 5, NULL);
-    xTaskCreate(monitor_task_1s, "monitor_task_1s", 2048, NULL, 5, NULL);
-    xTaskCreate(monitor_task_rmt, "monitor_task_rmt", 4096, NULL, 5, NULL);
+#if CONFIG_FLORALINK_MQTT
+    if (mqtt_pub_init() != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Failed to start MQTT publisher");
+    }
+#endif
+#if CONFIG_FLORALINK_UDP
+    if (udp_pub_init() != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Failed to start UDP stream");
+    }
+#endif
+#if CONFIG_FLORALINK_COAP
+    if (coap_server_init() != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Failed to start CoAP server");
+    }
+#endif
     vTaskDelete(NULL);
 }
 
 /**
  * @brief Main entry point for the application.
  *
- * Launches the init_task, which sets up all other tasks and modules.
+ * Launches the init_task, which sets up all other tasks and modules. In duty-cycled mode
+ * (CONFIG_FLORALINK_DUTY_CYCLE) a timer wake from deep sleep only gets this far when the
+ * sample batch has to be uploaded.
  */
 void app_main(void)
 {
+    energy_init();
+#if CONFIG_FLORALINK_DUTY_CYCLE
+    // Minimal wake path: measure and go back to sleep unless the network is needed
+    dutycycle_wake();
+#endif
     ESP_LOGI(TAG, "app_main started");
     xTaskCreate(init_task, "init_task", 4096, NULL, 10, NULL);
 }
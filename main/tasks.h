@@ -0,0 +1,40 @@
+/**
+ * @file tasks.h
+ * @brief Declarative table of the application's FreeRTOS tasks.
+ *
+ * Every long-running task is described by one task_def_t row (priority, stack, core pinning
+ * and nominal period). Defaults come from the "Task configuration" Kconfig menu; the table
+ * is exposed read-only for the /tasks introspection endpoint.
+ */
+
+#ifndef TASKS_H
+#define TASKS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "periodic.h"
+
+#define TASK_CORE_ANY (-1) ///< No core affinity
+
+typedef struct
+{
+    const char *name;
+    TaskFunction_t fn;
+    uint32_t stack;       ///< Stack size in bytes
+    UBaseType_t priority;
+    int core;             ///< Core to pin to, or TASK_CORE_ANY
+    uint32_t period_ms;   ///< Nominal period, 0 for event-driven or dynamic tasks
+    periodic_t *timing;   ///< Release timing and jitter statistics of periodic tasks, else NULL
+    TaskHandle_t handle;  ///< Set once the task is created
+} task_def_t;
+
+/**
+ * @brief Get the task table.
+ * @param count Receives the number of rows
+ * @return Pointer to the first row.
+ */
+const task_def_t *tasks_get_table(size_t *count);
+
+#endif // TASKS_H
@@ -0,0 +1,49 @@
+/**
+ * @file timesync.c
+ * @brief SNTP client setup and the "clock is set" test.
+ *
+ * Whether the clock is set is judged from the time itself: an unset RTC counts from 0 at
+ * power-on, so anything before TIMESYNC_MIN_EPOCH cannot be wall-clock time. This also holds
+ * after a deep sleep, when the RTC kept the time of an earlier sync, without keeping a flag.
+ */
+
+#include "timesync.h"
+#include <time.h>
+#include <sys/time.h>
+#include <esp_log.h>
+#include "sdkconfig.h"
+
+#if CONFIG_FLORALINK_SNTP
+#include "esp_netif_sntp.h"
+#endif
+
+#define TIMESYNC_MIN_EPOCH 1735689600 // 2025-01-01T00:00:00Z
+
+static const char *TAG = "TimeSync";
+
+#if CONFIG_FLORALINK_SNTP
+// Runs in the lwIP task
+static void timesync_cb(struct timeval *tv)
+{
+    ESP_LOGI(TAG, "Clock set, %lld", (long long)tv->tv_sec);
+}
+#endif
+
+esp_err_t timesync_init(void)
+{
+#if CONFIG_FLORALINK_SNTP
+    esp_sntp_config_t config = ESP_NETIF_SNTP_DEFAULT_CONFIG(CONFIG_FLORALINK_SNTP_SERVER);
+    config.sync_cb = timesync_cb;
+    esp_err_t err = esp_netif_sntp_init(&config);
+    if (err != ESP_OK)
+        ESP_LOGE(TAG, "Failed to start SNTP (%s)", esp_err_to_name(err));
+    return err;
+#else
+    return ESP_ERR_NOT_SUPPORTED;
+#endif
+}
+
+bool timesync_is_set(void)
+{
+    return time(NULL) >= TIMESYNC_MIN_EPOCH;
+}
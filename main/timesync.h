@@ -0,0 +1,28 @@
+/**
+ * @file timesync.h
+ * @brief Wall-clock time from SNTP.
+ *
+ * With CONFIG_FLORALINK_SNTP the system clock is set from CONFIG_FLORALINK_SNTP_SERVER once
+ * the link is up, and kept in step afterwards. The RTC keeps the time across deep sleep but
+ * not across a power loss, after which the clock restarts at 0 until the next sync.
+ * Modules that store timestamps check timesync_is_set() instead of trusting time(NULL).
+ */
+
+#ifndef TIMESYNC_H
+#define TIMESYNC_H
+
+#include <stdbool.h>
+#include "esp_err.h"
+
+/**
+ * @brief Start SNTP. Call after wifi_setup(); the first sync follows the link coming up.
+ * @return ESP_OK, or ESP_ERR_NOT_SUPPORTED without CONFIG_FLORALINK_SNTP.
+ */
+esp_err_t timesync_init(void);
+
+/**
+ * @brief True once time(NULL) is wall-clock time (synced in this boot or before a deep sleep).
+ */
+bool timesync_is_set(void);
+
+#endif // TIMESYNC_H
@@ -0,0 +1,275 @@
+/**
+ * @file trace.c
+ * @brief Per-core trace-event ring and Chrome Trace Event JSON exporter.
+ *
+ * Events are 16 bytes: a 32-bit CPU cycle stamp, the event name pointer, the task handle
+ * (0 for ISRs) and the phase. Recording masks interrupts on the local core only, so task and
+ * ISR writers on the same core cannot interleave and the two cores never share a ring.
+ *
+ * Cycle counters are per core, wrap every few tens of seconds and scale with the CPU clock.
+ * A 1 s esp_timer therefore drops a sync event (cycle stamp + esp_timer microseconds) into
+ * every core's ring; the exporter interpolates event times between neighbouring syncs, which
+ * puts both cores on the same timeline and tolerates frequency scaling.
+ *
+ * Configuration:
+ * - CONFIG_FLORALINK_TRACE enables the module (otherwise the TRACE_* macros are empty).
+ * - CONFIG_FLORALINK_TRACE_EVENTS sets the ring depth per core (power of two).
+ */
+
+#include "trace.h"
+
+#if CONFIG_FLORALINK_TRACE
+
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_attr.h"
+#include "esp_cpu.h"
+#include "esp_timer.h"
+#include "esp_rom_sys.h"
+#include "esp_log.h"
+#if !CONFIG_FREERTOS_UNICORE
+#include "esp_ipc.h"
+#endif
+
+#define TRACE_RING_SIZE CONFIG_FLORALINK_TRACE_EVENTS
+#define TRACE_RING_MASK (TRACE_RING_SIZE - 1)
+#define TRACE_PH_SYNC 'S'          // Internal: name/tid carry the esp_timer time in us
+#define TRACE_SYNC_PERIOD_US 1000000
+#define TRACE_JSON_CHUNK 512
+
+_Static_assert((TRACE_RING_SIZE & TRACE_RING_MASK) == 0, "CONFIG_FLORALINK_TRACE_EVENTS must be a power of two");
+
+typedef struct
+{
+    uint32_t cycles;
+    const char *name;
+    uint32_t tid;
+    uint8_t phase;
+} trace_event_t;
+
+static const char *TAG = "trace";
+static trace_event_t s_events[portNUM_PROCESSORS][TRACE_RING_SIZE];
+static uint32_t s_head[portNUM_PROCESSORS];
+static volatile bool s_enabled = false;
+static esp_timer_handle_t s_sync_timer = NULL;
+
+static inline void IRAM_ATTR trace_push(uint32_t cycles, const char *name, uint32_t tid, uint8_t phase)
+{
+    int core = esp_cpu_get_core_id();
+    trace_event_t *ev = &s_events[core][s_head[core]++ & TRACE_RING_MASK];
+    ev->cycles = cycles;
+    ev->name = name;
+    ev->tid = tid;
+    ev->phase = phase;
+}
+
+void IRAM_ATTR trace_record(const char *name, trace_phase_t phase)
+{
+    if (!s_enabled)
+        return;
+    uint32_t tid = xPortInIsrContext() ? 0 : (uint32_t)(uintptr_t)xTaskGetCurrentTaskHandle();
+    UBaseType_t irq = portSET_INTERRUPT_MASK_FROM_ISR();
+    trace_push(esp_cpu_get_cycle_count(), name, tid, phase);
+    portCLEAR_INTERRUPT_MASK_FROM_ISR(irq);
+}
+
+// Record a cycle/microsecond pair on the calling core
+static void trace_sync_local(void *arg)
+{
+    UBaseType_t irq = portSET_INTERRUPT_MASK_FROM_ISR();
+    uint64_t now_us = (uint64_t)esp_timer_get_time();
+    trace_push(esp_cpu_get_cycle_count(), (const char *)(uintptr_t)(uint32_t)now_us,
+               (uint32_t)(now_us >> 32), TRACE_PH_SYNC);
+    portCLEAR_INTERRUPT_MASK_FROM_ISR(irq);
+}
+
+static void trace_sync_timer_cb(void *arg)
+{
+    if (!s_enabled)
+        return;
+    trace_sync_local(NULL);
+#if !CONFIG_FREERTOS_UNICORE
+    for (int core = 0; core < portNUM_PROCESSORS; core++)
+    {
+        if (core != esp_cpu_get_core_id())
+            esp_ipc_call_nonblocking(core, trace_sync_local, NULL);
+    }
+#endif
+}
+
+/**
+ * @brief Start recording and the periodic clock sync.
+ */
+void trace_init(void)
+{
+    const esp_timer_create_args_t args = {
+        .callback = trace_sync_timer_cb,
+        .name = "trace_sync"};
+    if (esp_timer_create(&args, &s_sync_timer) != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Failed to create sync timer");
+        return;
+    }
+    s_enabled = true;
+    trace_sync_timer_cb(NULL);
+    esp_timer_start_periodic(s_sync_timer, TRACE_SYNC_PERIOD_US);
+    ESP_LOGI(TAG, "Tracing %d events per core", TRACE_RING_SIZE);
+}
+
+// --- Export ---
+
+typedef struct
+{
+    trace_write_fn_t write;
+    void *ctx;
+    char buf[TRACE_JSON_CHUNK];
+    size_t len;
+    bool first;
+    esp_err_t err;
+} trace_out_t;
+
+static void out_flush(trace_out_t *out)
+{
+    if (out->len && out->err == ESP_OK)
+        out->err = out->write(out->ctx, out->buf, out->len);
+    out->len = 0;
+}
+
+// Append one JSON object (without separator); flushes first if the chunk would overflow
+static void out_event(trace_out_t *out, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+static void out_event(trace_out_t *out, const char *fmt, ...)
+{
+    char tmp[160];
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vsnprintf(tmp, sizeof(tmp), fmt, ap);
+    va_end(ap);
+    if (n < 0)
+        return;
+    if (n >= (int)sizeof(tmp))
+        n = sizeof(tmp) - 1;
+    if (out->len + n + 2 > sizeof(out->buf))
+        out_flush(out);
+    if (!out->first)
+        out->buf[out->len++] = ',';
+    out->first = false;
+    memcpy(out->buf + out->len, tmp, n);
+    out->len += n;
+}
+
+static inline uint64_t sync_us(const trace_event_t *ev)
+{
+    return ((uint64_t)ev->tid << 32) | (uint32_t)(uintptr_t)ev->name;
+}
+
+// Find the next sync event at or after ring position *pos; *pos is left just past it
+static const trace_event_t *find_sync(const trace_event_t *ring, uint32_t *pos, uint32_t head)
+{
+    for (; *pos != head; (*pos)++)
+    {
+        const trace_event_t *ev = &ring[*pos & TRACE_RING_MASK];
+        if (ev->phase == TRACE_PH_SYNC)
+        {
+            (*pos)++;
+            return ev;
+        }
+    }
+    return NULL;
+}
+
+static void export_core(trace_out_t *out, int core)
+{
+    uint32_t head = s_head[core];
+    uint32_t count = head > TRACE_RING_SIZE ? TRACE_RING_SIZE : head;
+    uint32_t start = head - count;
+    const trace_event_t *ring = s_events[core];
+    const float nominal = (float)esp_rom_get_cpu_ticks_per_us();
+
+    // Events are placed between the surrounding pair of syncs; those before the first
+    // sync are extrapolated backwards from it
+    uint32_t scan = start;
+    const trace_event_t *sync = find_sync(ring, &scan, head);
+    const trace_event_t *next = find_sync(ring, &scan, head);
+
+    for (uint32_t i = start; i != head && out->err == ESP_OK; i++)
+    {
+        const trace_event_t *ev = &ring[i & TRACE_RING_MASK];
+        if (ev->phase == TRACE_PH_SYNC)
+        {
+            if (ev == next)
+            {
+                sync = next;
+                next = find_sync(ring, &scan, head);
+            }
+            continue;
+        }
+        float rate = nominal;
+        if (sync && next && sync_us(next) > sync_us(sync))
+            rate = (float)(uint32_t)(next->cycles - sync->cycles) / (float)(sync_us(next) - sync_us(sync));
+        double ts = sync ? (double)sync_us(sync) + (double)(int32_t)(ev->cycles - sync->cycles) / rate
+                         : (double)(uint32_t)(ev->cycles - ring[start & TRACE_RING_MASK].cycles) / rate;
+        if (ev->phase == TRACE_PH_INSTANT)
+            out_event(out, "{\"name\":\"%s\",\"ph\":\"i\",\"s\":\"t\",\"ts\":%.3f,\"pid\":%d,\"tid\":%lu}",
+                      ev->name, ts, core, (unsigned long)ev->tid);
+        else
+            out_event(out, "{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%.3f,\"pid\":%d,\"tid\":%lu}",
+                      ev->name, ev->phase, ts, core, (unsigned long)ev->tid);
+    }
+}
+
+static void export_metadata(trace_out_t *out)
+{
+    for (int core = 0; core < portNUM_PROCESSORS; core++)
+    {
+        out_event(out, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"args\":{\"name\":\"core%d\"}}", core, core);
+        out_event(out, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":0,\"args\":{\"name\":\"ISR\"}}", core);
+    }
+#if CONFIG_FREERTOS_USE_TRACE_FACILITY
+    // Name the tasks that are still alive; handles of deleted tasks stay numeric
+    UBaseType_t n = uxTaskGetNumberOfTasks();
+    TaskStatus_t *tasks = malloc(n * sizeof(TaskStatus_t));
+    if (!tasks)
+        return;
+    n = uxTaskGetSystemState(tasks, n, NULL);
+    for (UBaseType_t t = 0; t < n; t++)
+        for (int core = 0; core < portNUM_PROCESSORS; core++)
+            out_event(out, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%lu,\"args\":{\"name\":\"%s\"}}",
+                      core, (unsigned long)(uintptr_t)tasks[t].xHandle, tasks[t].pcTaskName);
+    free(tasks);
+#endif
+}
+
+esp_err_t trace_export_json(trace_write_fn_t write, void *ctx)
+{
+    trace_out_t *out = malloc(sizeof(trace_out_t));
+    if (!out)
+        return ESP_ERR_NO_MEM;
+    out->write = write;
+    out->ctx = ctx;
+    out->len = 0;
+    out->err = ESP_OK;
+
+    bool was_enabled = s_enabled;
+    s_enabled = false;
+    static const char prologue[] = "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+    out->err = write(ctx, prologue, sizeof(prologue) - 1);
+    out->first = true;
+    export_metadata(out);
+    for (int core = 0; core < portNUM_PROCESSORS && out->err == ESP_OK; core++)
+        export_core(out, core);
+    out_flush(out);
+    s_enabled = was_enabled;
+
+    esp_err_t err = out->err;
+    if (err == ESP_OK)
+        err = write(ctx, "]}\n", strlen("]}\n"));
+    free(out);
+    return err;
+}
+
+#endif // CONFIG_FLORALINK_TRACE
@@ -0,0 +1,107 @@
+/**
+ * @file trace.h
+ * @brief Lightweight trace-event recorder with Chrome Trace Event export.
+ *
+ * Each CPU core owns a ring of compact begin/end/instant events stamped with the CPU cycle
+ * counter. Recording only masks interrupts on the local core for a handful of instructions,
+ * so it is safe from tasks and ISRs alike and never contends with the other core.
+ *
+ * The TRACE_* macros compile to nothing unless CONFIG_FLORALINK_TRACE is enabled.
+ *
+ * Usage Example:
+ * @code
+ *   void work(void) {
+ *       TRACE_SCOPE("work");   // begin now, end when the enclosing block exits
+ *       ...
+ *       TRACE_INSTANT("marker");
+ *   }
+ * @endcode
+ */
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "sdkconfig.h"
+
+typedef enum
+{
+    TRACE_PH_BEGIN = 'B',
+    TRACE_PH_END = 'E',
+    TRACE_PH_INSTANT = 'i'
+} trace_phase_t;
+
+/**
+ * @brief Output callback of the *_export_json() functions (trace, profile, energy, ...).
+ *
+ * Called with successive fragments of one JSON document, in order; @p buf is not
+ * NUL-terminated and only valid during the call. The exporter passes its ctx through.
+ * @return ESP_OK to continue, any other value aborts the export and is returned by it.
+ */
+typedef esp_err_t (*trace_write_fn_t)(void *ctx, const char *buf, size_t len);
+
+#if CONFIG_FLORALINK_TRACE
+
+/**
+ * @brief Start recording and the periodic per-core clock sync. Call once at startup.
+ */
+void trace_init(void);
+
+/**
+ * @brief Record a single event on the calling core's ring (task or ISR context).
+ * @param name Static string naming the event (the pointer is stored, not the contents)
+ * @param phase Begin, end or instant
+ */
+void trace_record(const char *name, trace_phase_t phase);
+
+/**
+ * @brief Stream the recorded events as Chrome Trace Event JSON.
+ *
+ * Recording is paused for the duration of the export so the snapshot is consistent.
+ * @param write Output callback, called with successive JSON fragments
+ * @param ctx Opaque pointer passed to @p write
+ * @return ESP_OK on success, or the first error returned by @p write.
+ */
+esp_err_t trace_export_json(trace_write_fn_t write, void *ctx);
+
+typedef const char *trace_scope_t;
+
+static inline trace_scope_t trace_scope_begin(const char *name)
+{
+    trace_record(name, TRACE_PH_BEGIN);
+    return name;
+}
+
+static inline void trace_scope_end(trace_scope_t *scope)
+{
+    trace_record(*scope, TRACE_PH_END);
+}
+
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+
+// Begin an event now and end it automatically when the enclosing block is left
+#define TRACE_SCOPE(name)                                                        \
+    trace_scope_t TRACE_CONCAT(__trace_scope_, __LINE__)                         \
+        __attribute__((cleanup(trace_scope_end), unused)) = trace_scope_begin(name)
+#define TRACE_BEGIN(name) trace_record((name), TRACE_PH_BEGIN)
+#define TRACE_END(name) trace_record((name), TRACE_PH_END)
+#define TRACE_INSTANT(name) trace_record((name), TRACE_PH_INSTANT)
+
+#else
+
+static inline void trace_init(void) {}
+
+#define TRACE_SCOPE(name) \
+    do                    \
+    {                     \
+    } while (0)
+#define TRACE_BEGIN(name) ((void)0)
+#define TRACE_END(name) ((void)0)
+#define TRACE_INSTANT(name) ((void)0)
+
+#endif // CONFIG_FLORALINK_TRACE
+
+#endif // TRACE_H
@@ -0,0 +1,559 @@
+/**
+ * @file tsdb.c
+ * @brief Tiered time-series store on raw partition blocks.
+ *
+ * The partition is split into one region of whole sectors per tier, and each region into
+ * 512-byte blocks used as a circular log: the block after the newest is the oldest, and a
+ * sector is erased when the head enters it, dropping the oldest blocks of that tier only.
+ *
+ * A block starts with a header {magic, tier, seq, t0, ~seq} written when it is opened;
+ * points are appended after it as records {len, payload, check}. The payload holds zigzag
+ * varints: the delta-of-delta of the timestamp, then for every value the change from the
+ * previous point (the codec state is reset at every block, so blocks decode on their own).
+ * A regular 500 ms reading therefore costs 4 bytes: len, a 0 timestamp byte, usually one
+ * value byte, and the check. An erased len byte (0xFF) ends the block; a record failing its
+ * check (torn write) ends it too and the next point opens a new block.
+ *
+ * Flash writes only program erased bytes, so records are appended in place. Raw points are
+ * collected in RAM and written at most TSDB_PENDING bytes at a time, and at least on every
+ * minute rollup; rollup points are written as soon as their bucket closes. The open rollup
+ * buckets are kept in RTC memory and survive deep sleep.
+ *
+ * Ingest runs in a task of its own (tsdb_run()), so sector erases never hold up the
+ * scheduler jobs. A query holds s_lock only while it copies one block to its own buffer;
+ * the points are decoded and handed to the caller with the lock released.
+ */
+
+#include "sdkconfig.h"
+
+#if CONFIG_FLORALINK_TSDB
+
+#include "tsdb.h"
+#include <stdbool.h>
+#include <string.h>
+#include <sys/time.h>
+#include <esp_attr.h>
+#include <esp_log.h>
+#include <esp_partition.h>
+#include <esp_timer.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include "sample_bus.h"
+#include "timesync.h"
+
+#define TSDB_SECTOR 4096
+#define TSDB_BLOCK 512
+#define TSDB_BLOCKS_PER_SECTOR (TSDB_SECTOR / TSDB_BLOCK)
+#define TSDB_MAGIC 0x4254 // "TB"
+#define TSDB_VERSION 1
+#define TSDB_VALUES 4      // min, max, mean_x10, count; the raw tier uses the first one
+#define TSDB_MAX_RECORD 32 // len + 10-byte timestamp varint + 4 x 5-byte value varints + check
+#define TSDB_PENDING 64    // Raw bytes collected in RAM before a flash write
+#define TSDB_END 0xFF      // Erased len byte: end of the block
+#define TSDB_RTC_MAGIC 0x54534442
+
+typedef struct
+{
+    uint16_t magic;
+    uint8_t tier;
+    uint8_t version;
+    uint32_t seq;
+    int64_t t0_ms;    // Time of the first point
+    uint32_t seq_inv; // ~seq: a torn header does not validate
+    uint32_t reserved;
+} tsdb_header_t;
+
+_Static_assert(sizeof(tsdb_header_t) == 24, "tsdb_header_t must stay 24 bytes");
+
+typedef struct
+{
+    int64_t t;
+    int64_t delta;
+    int32_t v[TSDB_VALUES];
+} tsdb_codec_t;
+
+// Open rollup bucket
+typedef struct
+{
+    int64_t bucket; // Bucket number (t / resolution), valid while count > 0
+    int32_t min;
+    int32_t max;
+    int64_t sum;
+    uint32_t count;
+} tsdb_acc_t;
+
+typedef struct
+{
+    const char *name;
+    uint32_t res_s;  // Bucket length, 0 for raw
+    uint8_t nvals;   // Values per point
+    uint8_t share;   // Share of the partition, in twentieths
+    uint32_t first;  // First block slot of the region
+    uint32_t blocks; // Block slots in the region
+    bool found;      // At least one block written
+    bool open;       // Head block can take more points
+    uint32_t head;   // Newest block slot
+    uint32_t seq;    // Its sequence number
+    uint32_t used;   // Bytes programmed in it, header included
+    tsdb_codec_t codec;
+    uint8_t pend[TSDB_PENDING];
+    uint32_t pend_len;
+} tsdb_tier_t;
+
+typedef struct
+{
+    uint32_t magic;
+    tsdb_acc_t acc[TSDB_TIER_COUNT];
+} tsdb_rtc_t;
+
+static const char *TAG = "TSDB";
+
+// Raw ~ 4 h at 2 Hz, minute ~ 10 days, hour ~ 8 months, day ~ 5 years in the default 320 KiB
+static tsdb_tier_t s_tiers[TSDB_TIER_COUNT] = {
+    [TSDB_TIER_RAW] = {.name = "raw", .res_s = 0, .nvals = 1, .share = 8},
+    [TSDB_TIER_MINUTE] = {.name = "minute", .res_s = 60, .nvals = TSDB_VALUES, .share = 8},
+    [TSDB_TIER_HOUR] = {.name = "hour", .res_s = 3600, .nvals = TSDB_VALUES, .share = 3},
+    [TSDB_TIER_DAY] = {.name = "day", .res_s = 86400, .nvals = TSDB_VALUES, .share = 1},
+};
+
+static const esp_partition_t *s_part = NULL;
+static SemaphoreHandle_t s_lock = NULL;
+static SemaphoreHandle_t s_query_lock = NULL; // One query at a time: they share s_qbuf
+static uint8_t s_buf[TSDB_BLOCK];  // Block being mounted
+static uint8_t s_qbuf[TSDB_BLOCK]; // Block being queried; caller holds s_query_lock
+static sample_sub_t s_sub = SAMPLE_SUB_INIT("tsdb");
+static bool s_clock_warned = false;
+static RTC_DATA_ATTR tsdb_rtc_t s_rtc;
+
+static size_t tsdb_put_varint(uint8_t *p, uint64_t v)
+{
+    size_t n = 0;
+    while (v >= 0x80)
+    {
+        p[n++] = (uint8_t)(v | 0x80);
+        v >>= 7;
+    }
+    p[n++] = (uint8_t)v;
+    return n;
+}
+
+static size_t tsdb_get_varint(const uint8_t *p, size_t avail, uint64_t *v)
+{
+    *v = 0;
+    for (size_t n = 0; n < avail && n < 10; n++)
+    {
+        *v |= (uint64_t)(p[n] & 0x7F) << (7 * n);
+        if (!(p[n] & 0x80))
+            return n + 1;
+    }
+    return 0;
+}
+
+static uint64_t tsdb_zigzag(int64_t v)
+{
+    return ((uint64_t)v << 1) ^ (uint64_t)(v >> 63);
+}
+
+static int64_t tsdb_unzigzag(uint64_t v)
+{
+    return (int64_t)(v >> 1) ^ -(int64_t)(v & 1);
+}
+
+static uint8_t tsdb_check(const uint8_t *payload, uint8_t len)
+{
+    uint8_t c = 0xA5 ^ len; // An erased (all 0xFF) record never validates
+    for (uint8_t i = 0; i < len; i++)
+        c = (uint8_t)((c << 1) | (c >> 7)) ^ payload[i];
+    return c;
+}
+
+// Encode one point as a record into @p out; advances @p codec. Returns the record size.
+static size_t tsdb_encode(tsdb_codec_t *codec, uint8_t nvals, int64_t t, const int32_t *v, uint8_t *out)
+{
+    int64_t delta = t - codec->t;
+    size_t n = 1;
+    n += tsdb_put_varint(&out[n], tsdb_zigzag(delta - codec->delta));
+    for (uint8_t i = 0; i < nvals; i++)
+    {
+        n += tsdb_put_varint(&out[n], tsdb_zigzag((int64_t)v[i] - codec->v[i]));
+        codec->v[i] = v[i];
+    }
+    codec->t = t;
+    codec->delta = delta;
+    out[0] = (uint8_t)(n - 1);
+    out[n] = tsdb_check(&out[1], out[0]);
+    return n + 1;
+}
+
+/**
+ * @brief Decode the records of a block held in @p buf, from the header up to @p limit.
+ * @param fn Called for the points within [from_ms, to_ms], or NULL to only walk the block
+ * @param end Set to the offset after the last valid record
+ * @param torn Set when decoding stopped at a record failing its check
+ */
+static esp_err_t tsdb_decode(const tsdb_tier_t *tier, const tsdb_header_t *h, const uint8_t *buf, uint32_t limit,
+                             int64_t from_ms, int64_t to_ms, tsdb_point_fn_t fn, void *ctx, uint32_t *end,
+                             bool *torn, tsdb_codec_t *codec)
+{
+    memset(codec, 0, sizeof(*codec));
+    codec->t = h->t0_ms;
+    uint32_t pos = sizeof(tsdb_header_t);
+    *torn = false;
+    while (pos < limit && buf[pos] != TSDB_END)
+    {
+        uint8_t len = buf[pos];
+        if (len > TSDB_MAX_RECORD || pos + len + 2 > limit || tsdb_check(&buf[pos + 1], len) != buf[pos + 1 + len])
+        {
+            *torn = true;
+            break;
+        }
+        const uint8_t *p = &buf[pos + 1];
+        uint64_t raw;
+        size_t k = tsdb_get_varint(p, len, &raw);
+        codec->delta += tsdb_unzigzag(raw);
+        codec->t += codec->delta;
+        for (uint8_t i = 0; i < tier->nvals && k; i++)
+        {
+            size_t m = tsdb_get_varint(p + k, len - k, &raw);
+            codec->v[i] += (int32_t)tsdb_unzigzag(raw);
+            k = m ? k + m : 0;
+        }
+        if (!k)
+        {
+            *torn = true;
+            break;
+        }
+        pos += len + 2;
+        if (fn && codec->t >= from_ms && codec->t <= to_ms)
+        {
+            tsdb_point_t pt = {.t_ms = codec->t, .min = codec->v[0], .max = codec->v[0],
+                               .mean_x10 = codec->v[0] * 10, .count = 1};
+            if (tier->nvals == TSDB_VALUES)
+            {
+                pt.max = codec->v[1];
+                pt.mean_x10 = codec->v[2];
+                pt.count = codec->v[3];
+            }
+            esp_err_t err = fn(&pt, ctx);
+            if (err != ESP_OK)
+            {
+                *end = pos;
+                return err;
+            }
+        }
+    }
+    *end = pos;
+    return ESP_OK;
+}
+
+static size_t tsdb_offset(const tsdb_tier_t *tier, uint32_t slot)
+{
+    return (size_t)(tier->first + slot) * TSDB_BLOCK;
+}
+
+static bool tsdb_read_header(const tsdb_tier_t *tier, uint32_t slot, tsdb_header_t *h)
+{
+    if (esp_partition_read(s_part, tsdb_offset(tier, slot), h, sizeof(*h)) != ESP_OK)
+        return false;
+    return h->magic == TSDB_MAGIC && h->tier == (uint8_t)(tier - s_tiers) && h->version == TSDB_VERSION &&
+           h->seq == ~h->seq_inv;
+}
+
+// Caller holds s_lock. Program the points collected in RAM into the head block.
+static esp_err_t tsdb_write_pending(tsdb_tier_t *tier)
+{
+    if (!tier->pend_len)
+        return ESP_OK;
+    esp_err_t err = esp_partition_write(s_part, tsdb_offset(tier, tier->head) + tier->used, tier->pend,
+                                        tier->pend_len);
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(TAG, "%s: write failed (%s)", tier->name, esp_err_to_name(err));
+        tier->open = false; // Do not append after a hole
+    }
+    tier->used += tier->pend_len;
+    tier->pend_len = 0;
+    return err;
+}
+
+// Caller holds s_lock. Start a new head block whose first point is at @p t0_ms.
+static esp_err_t tsdb_open_block(tsdb_tier_t *tier, int64_t t0_ms)
+{
+    tsdb_write_pending(tier);
+    uint32_t slot = tier->found ? (tier->head + 1) % tier->blocks : 0;
+    esp_err_t err = ESP_OK;
+    if (slot % TSDB_BLOCKS_PER_SECTOR == 0)
+        err = esp_partition_erase_range(s_part, tsdb_offset(tier, slot), TSDB_SECTOR);
+    tsdb_header_t h = {.magic = TSDB_MAGIC, .tier = (uint8_t)(tier - s_tiers), .version = TSDB_VERSION,
+                       .seq = tier->seq + 1, .t0_ms = t0_ms, .seq_inv = ~(tier->seq + 1), .reserved = 0xFFFFFFFF};
+    if (err == ESP_OK)
+        err = esp_partition_write(s_part, tsdb_offset(tier, slot), &h, sizeof(h));
+    // The slot is used even on failure: the next attempt moves on instead of retrying it
+    tier->found = true;
+    tier->head = slot;
+    tier->seq++;
+    tier->used = sizeof(h);
+    tier->open = err == ESP_OK;
+    memset(&tier->codec, 0, sizeof(tier->codec));
+    tier->codec.t = t0_ms;
+    if (err != ESP_OK)
+        ESP_LOGE(TAG, "%s: cannot open block %lu (%s)", tier->name, (unsigned long)slot, esp_err_to_name(err));
+    return err;
+}
+
+// Caller holds s_lock
+static esp_err_t tsdb_append(tsdb_tier_t *tier, int64_t t_ms, const int32_t *v)
+{
+    uint8_t rec[TSDB_MAX_RECORD + 2];
+    tsdb_codec_t codec = tier->codec;
+    size_t n = tier->open ? tsdb_encode(&codec, tier->nvals, t_ms, v, rec) : 0;
+    if (!tier->open || tier->used + tier->pend_len + n > TSDB_BLOCK)
+    {
+        esp_err_t err = tsdb_open_block(tier, t_ms);
+        if (err != ESP_OK)
+            return err;
+        codec = tier->codec;
+        n = tsdb_encode(&codec, tier->nvals, t_ms, v, rec);
+    }
+    if (tier->pend_len + n > TSDB_PENDING)
+        tsdb_write_pending(tier);
+    memcpy(&tier->pend[tier->pend_len], rec, n);
+    tier->pend_len += n;
+    tier->codec = codec;
+    return ESP_OK;
+}
+
+// Caller holds s_lock. Fold one reading into the open buckets; write those it closes.
+static void tsdb_rollup(int64_t t_ms, int32_t cm)
+{
+    for (int i = TSDB_TIER_MINUTE; i < TSDB_TIER_COUNT; i++)
+    {
+        tsdb_tier_t *tier = &s_tiers[i];
+        tsdb_acc_t *acc = &s_rtc.acc[i];
+        int64_t bucket = t_ms / ((int64_t)tier->res_s * 1000);
+        if (acc->count && bucket != acc->bucket)
+        {
+            int32_t v[TSDB_VALUES] = {acc->min, acc->max, (int32_t)(acc->sum * 10 / acc->count),
+                                      (int32_t)acc->count};
+            tsdb_append(tier, acc->bucket * tier->res_s * 1000, v);
+            tsdb_write_pending(tier);
+            if (i == TSDB_TIER_MINUTE)
+                tsdb_write_pending(&s_tiers[TSDB_TIER_RAW]); // Bounds the raw points lost on a reset
+            acc->count = 0;
+        }
+        if (!acc->count)
+        {
+            acc->bucket = bucket;
+            acc->min = acc->max = cm;
+            acc->sum = 0;
+        }
+        acc->min = cm < acc->min ? cm : acc->min;
+        acc->max = cm > acc->max ? cm : acc->max;
+        acc->sum += cm;
+        acc->count++;
+    }
+}
+
+// Caller holds s_lock. Store one reading, stamped with the wall clock.
+static void tsdb_ingest(const sample_t *s, int64_t now_ms, int64_t now_us)
+{
+    if (s->err != ESP_OK)
+        return;
+    int64_t t_ms = now_ms - (now_us - s->ts_us) / 1000;
+    int32_t cm = (int32_t)s->distance_cm;
+    tsdb_append(&s_tiers[TSDB_TIER_RAW], t_ms, &cm);
+    tsdb_rollup(t_ms, cm);
+}
+
+void tsdb_run(void)
+{
+    if (!s_part)
+        vTaskDelete(NULL);
+    // With backlog: the readings taken before the task started are kept too
+    sample_bus_subscribe(&s_sub, true, true);
+    sample_t s;
+    for (;;)
+    {
+        if (sample_bus_wait(&s_sub, &s, portMAX_DELAY) != ESP_OK)
+            continue;
+        if (!timesync_is_set())
+        {
+            // Without wall-clock time the points of different boots would collide
+            if (!s_clock_warned)
+                ESP_LOGW(TAG, "Clock not set, readings are not recorded until it is");
+            s_clock_warned = true;
+            continue;
+        }
+        struct timeval tv;
+        gettimeofday(&tv, NULL);
+        int64_t now_ms = (int64_t)tv.tv_sec * 1000 + tv.tv_usec / 1000;
+        int64_t now_us = esp_timer_get_time();
+        xSemaphoreTake(s_lock, portMAX_DELAY);
+        do
+        {
+            tsdb_ingest(&s, now_ms, now_us);
+        } while (sample_bus_read(&s_sub, &s) == ESP_OK);
+        xSemaphoreGive(s_lock);
+    }
+}
+
+// Find the head block of @p tier and restore its codec state
+static void tsdb_mount_tier(tsdb_tier_t *tier)
+{
+    tsdb_header_t h;
+    for (uint32_t slot = 0; slot < tier->blocks; slot++)
+    {
+        if (tsdb_read_header(tier, slot, &h) && (!tier->found || h.seq > tier->seq))
+        {
+            tier->found = true;
+            tier->head = slot;
+            tier->seq = h.seq;
+        }
+    }
+    if (!tier->found)
+        return;
+    tsdb_read_header(tier, tier->head, &h);
+    bool torn;
+    if (esp_partition_read(s_part, tsdb_offset(tier, tier->head), s_buf, TSDB_BLOCK) != ESP_OK ||
+        tsdb_decode(tier, &h, s_buf, TSDB_BLOCK, 0, 0, NULL, NULL, &tier->used, &torn, &tier->codec) != ESP_OK)
+        return;
+    tier->open = !torn; // Never append behind a torn record
+}
+
+esp_err_t tsdb_init(void)
+{
+    s_part = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, "tsdb");
+    uint32_t sectors = s_part ? s_part->size / TSDB_SECTOR : 0;
+    if (sectors < 20)
+    {
+        ESP_LOGE(TAG, "No usable \"tsdb\" partition (20 sectors or more)");
+        s_part = NULL;
+        return ESP_ERR_NOT_FOUND;
+    }
+    s_lock = xSemaphoreCreateMutex();
+    s_query_lock = xSemaphoreCreateMutex();
+    if (!s_lock || !s_query_lock)
+    {
+        s_part = NULL;
+        return ESP_ERR_NO_MEM;
+    }
+
+    uint32_t first = 0;
+    for (int i = 0; i < TSDB_TIER_COUNT; i++)
+    {
+        tsdb_tier_t *tier = &s_tiers[i];
+        uint32_t n = i == TSDB_TIER_COUNT - 1 ? sectors - first : sectors * tier->share / 20;
+        tier->first = first * TSDB_BLOCKS_PER_SECTOR;
+        tier->blocks = n * TSDB_BLOCKS_PER_SECTOR;
+        first += n;
+        tsdb_mount_tier(tier);
+        ESP_LOGI(TAG, "%s: %lu blocks, head %lu", tier->name, (unsigned long)tier->blocks,
+                 (unsigned long)(tier->found ? tier->head : 0));
+    }
+    if (s_rtc.magic != TSDB_RTC_MAGIC)
+    {
+        memset(&s_rtc, 0, sizeof(s_rtc));
+        s_rtc.magic = TSDB_RTC_MAGIC;
+    }
+
+    return ESP_OK;
+}
+
+esp_err_t tsdb_flush(void)
+{
+    if (!s_part)
+        return ESP_ERR_INVALID_STATE;
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    esp_err_t err = ESP_OK;
+    for (int i = 0; i < TSDB_TIER_COUNT; i++)
+    {
+        esp_err_t e = tsdb_write_pending(&s_tiers[i]);
+        err = err == ESP_OK ? e : err;
+    }
+    xSemaphoreGive(s_lock);
+    return err;
+}
+
+tsdb_tier_id_t tsdb_pick_tier(uint32_t step_s)
+{
+    tsdb_tier_id_t best = TSDB_TIER_RAW;
+    for (int i = TSDB_TIER_MINUTE; i < TSDB_TIER_COUNT; i++)
+    {
+        if (s_tiers[i].res_s <= step_s)
+            best = (tsdb_tier_id_t)i;
+    }
+    return best;
+}
+
+const char *tsdb_tier_name(tsdb_tier_id_t tier, uint32_t *resolution_s)
+{
+    if (resolution_s)
+        *resolution_s = s_tiers[tier].res_s;
+    return s_tiers[tier].name;
+}
+
+// Caller holds s_query_lock. Decode one block, with the head's unwritten points overlaid from
+// RAM. s_lock is only held to copy the block, not while @p fn runs.
+static esp_err_t tsdb_query_block(const tsdb_tier_t *tier, uint32_t slot, const tsdb_header_t *h,
+                                  int64_t from_ms, int64_t to_ms, tsdb_point_fn_t fn, void *ctx)
+{
+    uint32_t limit = TSDB_BLOCK;
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    esp_err_t err = esp_partition_read(s_part, tsdb_offset(tier, slot), s_qbuf, TSDB_BLOCK);
+    if (err == ESP_OK && slot == tier->head)
+    {
+        memcpy(&s_qbuf[tier->used], tier->pend, tier->pend_len);
+        limit = tier->used + tier->pend_len;
+    }
+    xSemaphoreGive(s_lock);
+    // Skip a block that is unreadable or was reused since its header was read
+    if (err != ESP_OK || memcmp(s_qbuf, h, sizeof(*h)) != 0)
+        return ESP_OK;
+    uint32_t end;
+    bool torn;
+    tsdb_codec_t codec;
+    return tsdb_decode(tier, h, s_qbuf, limit, from_ms, to_ms, fn, ctx, &end, &torn, &codec);
+}
+
+esp_err_t tsdb_query(tsdb_tier_id_t id, int64_t from_s, int64_t to_s, tsdb_point_fn_t fn, void *ctx)
+{
+    if (!s_part)
+        return ESP_ERR_INVALID_STATE;
+    if (id >= TSDB_TIER_COUNT)
+        return ESP_ERR_INVALID_ARG;
+    const tsdb_tier_t *tier = &s_tiers[id];
+    int64_t from_ms = from_s * 1000;
+    int64_t to_ms = to_s * 1000 + 999;
+    esp_err_t err = ESP_OK;
+
+    xSemaphoreTake(s_query_lock, portMAX_DELAY);
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    bool found = tier->found;
+    uint32_t head = tier->head;
+    xSemaphoreGive(s_lock);
+    // Oldest to newest: the slot after the head around to the head. Only headers are read
+    // to skip blocks out of range; a block ends where the next one starts, unless the clock
+    // went back, in which case it is decoded to be safe. Blocks opened meanwhile are newer
+    // than the query and may be skipped.
+    bool have = false;
+    uint32_t prev_slot = 0;
+    tsdb_header_t prev, h;
+    for (uint32_t k = 1; found && k <= tier->blocks && err == ESP_OK; k++)
+    {
+        uint32_t slot = (head + k) % tier->blocks;
+        if (!tsdb_read_header(tier, slot, &h))
+            continue;
+        if (have && prev.t0_ms <= to_ms && (h.t0_ms >= from_ms || h.t0_ms < prev.t0_ms))
+            err = tsdb_query_block(tier, prev_slot, &prev, from_ms, to_ms, fn, ctx);
+        prev = h;
+        prev_slot = slot;
+        have = true;
+    }
+    if (have && err == ESP_OK && prev.t0_ms <= to_ms)
+        err = tsdb_query_block(tier, prev_slot, &prev, from_ms, to_ms, fn, ctx);
+    xSemaphoreGive(s_query_lock);
+    return err;
+}
+
+#endif // CONFIG_FLORALINK_TSDB
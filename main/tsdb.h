@@ -0,0 +1,88 @@
+/**
+ * @file tsdb.h
+ * @brief Tiered, compressed time-series history of the distance readings in flash.
+ *
+ * Four tiers share the "tsdb" partition, each a circular log of its own:
+ * - raw: every valid reading, for a few hours;
+ * - minute, hour, day: min/max/mean/count rollups, for days, months and years.
+ * The rollups are accumulated as readings arrive and written when their bucket closes, so
+ * nothing is ever recomputed from the raw tier. Points are compressed in 512-byte blocks:
+ * timestamps as zigzag varints of their delta-of-delta (one byte for a regular interval),
+ * values as zigzag varints of the change from the previous point.
+ *
+ * A query names a time range and the resolution it needs; it is served from the coarsest
+ * tier that is at least that fine, so a month-long graph reads a few hundred hour points
+ * instead of millions of readings.
+ *
+ * Timestamps are Unix time from the clock set by SNTP (timesync.h). Readings taken while the
+ * clock is not set, e.g. after a power loss before the network is back, are not recorded:
+ * they could not be told apart from the readings of an earlier boot.
+ *
+ * Configuration:
+ * - CONFIG_FLORALINK_TSDB: enable the store (needs the "tsdb" partition of partitions.csv
+ *   and CONFIG_FLORALINK_SNTP).
+ */
+
+#ifndef TSDB_H
+#define TSDB_H
+
+#include <stdint.h>
+#include "esp_err.h"
+
+typedef enum
+{
+    TSDB_TIER_RAW,
+    TSDB_TIER_MINUTE,
+    TSDB_TIER_HOUR,
+    TSDB_TIER_DAY,
+    TSDB_TIER_COUNT
+} tsdb_tier_id_t;
+
+typedef struct
+{
+    int64_t t_ms;      ///< Reading time, or bucket start for rollups
+    int32_t min;       ///< Raw tier: the reading (cm); all four fields hold it
+    int32_t max;
+    int32_t mean_x10;  ///< Mean in tenths of a cm
+    int32_t count;     ///< Readings in the bucket (1 for raw points)
+} tsdb_point_t;
+
+/**
+ * @brief Called for every point of a query, oldest first.
+ * @return ESP_OK to continue, anything else stops the query and is returned by tsdb_query().
+ */
+typedef esp_err_t (*tsdb_point_fn_t)(const tsdb_point_t *point, void *ctx);
+
+/**
+ * @brief Mount the partition and restore the head block of every tier.
+ * @return ESP_OK, ESP_ERR_NOT_FOUND without a usable "tsdb" partition.
+ */
+esp_err_t tsdb_init(void);
+
+/**
+ * @brief Body of the ingest task: subscribe to the sample bus and store the readings. Never
+ *        returns; deletes the task if tsdb_init() failed.
+ */
+void tsdb_run(void);
+
+/**
+ * @brief Write the raw points still collected in RAM, e.g. before deep sleep.
+ */
+esp_err_t tsdb_flush(void);
+
+/**
+ * @brief Tier serving a query of resolution @p step_s: the coarsest one not coarser than it.
+ */
+tsdb_tier_id_t tsdb_pick_tier(uint32_t step_s);
+
+/**
+ * @brief Name ("raw", "minute", "hour", "day") and bucket length in seconds (0 for raw).
+ */
+const char *tsdb_tier_name(tsdb_tier_id_t tier, uint32_t *resolution_s);
+
+/**
+ * @brief Stream the points of @p tier between @p from_s and @p to_s (inclusive, Unix seconds).
+ */
+esp_err_t tsdb_query(tsdb_tier_id_t tier, int64_t from_s, int64_t to_s, tsdb_point_fn_t fn, void *ctx);
+
+#endif // TSDB_H
@@ -0,0 +1,193 @@
+/**
+ * @file udp_pub.c
+ * @brief Sample bus subscriber sending datagrams to a multicast group or broadcast address.
+ *
+ * The sender task owns the socket: it is opened on the first datagram after the link comes
+ * up and closed when the link goes down or a send fails, so a new IP address is picked up
+ * without any event handling beyond a flag. sendto() on a UDP socket does not wait for
+ * the network, and one datagram is assembled at a time in a static buffer.
+ */
+
+#include "sdkconfig.h"
+
+#if CONFIG_FLORALINK_UDP
+
+#include "udp_pub.h"
+#include <errno.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <esp_log.h>
+#include <esp_mac.h>
+#include "lwip/sockets.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "sample_bus.h"
+#include "sample_codec.h"
+#include "wifi_setup.h"
+
+#define UDP_BATCH_MAX CONFIG_FLORALINK_UDP_BATCH
+#define UDP_LATENCY_US ((int64_t)CONFIG_FLORALINK_UDP_MAX_LATENCY_MS * 1000)
+#define UDP_MAGIC 0xF2
+#define UDP_VERSION 1
+#define UDP_HEADER 24
+
+static const char *TAG = "UdpPub";
+
+static struct sockaddr_in s_dest;
+static bool s_multicast = false;
+static uint32_t s_device_id = 0;
+static volatile bool s_link_up = false;
+static int s_sock = -1;
+static uint32_t s_seq = 0;
+static sample_sub_t s_sub = SAMPLE_SUB_INIT("udp");
+static sample_t s_batch[UDP_BATCH_MAX];
+static uint32_t s_batch_len = 0;
+static uint8_t s_datagram[UDP_HEADER + UDP_BATCH_MAX * SAMPLE_RECORD_SIZE];
+static udp_pub_stats_t s_stats = {0};
+
+// Runs in the default event loop task
+static void udp_link_handler(void *arg, esp_event_base_t base, int32_t id, void *data)
+{
+    s_link_up = id == LINK_EVENT_UP;
+}
+
+esp_err_t udp_pub_init(void)
+{
+    memset(&s_dest, 0, sizeof(s_dest));
+    s_dest.sin_family = AF_INET;
+    s_dest.sin_port = htons(CONFIG_FLORALINK_UDP_PORT);
+    if (inet_aton(CONFIG_FLORALINK_UDP_ADDR, &s_dest.sin_addr) == 0)
+    {
+        ESP_LOGE(TAG, "Invalid address %s", CONFIG_FLORALINK_UDP_ADDR);
+        return ESP_ERR_INVALID_ARG;
+    }
+    s_multicast = (ntohl(s_dest.sin_addr.s_addr) >> 28) == 0xE; // 224.0.0.0/4
+
+    uint8_t mac[6] = {0};
+    esp_read_mac(mac, ESP_MAC_WIFI_STA);
+    s_device_id = (uint32_t)mac[2] | (uint32_t)mac[3] << 8 | (uint32_t)mac[4] << 16 | (uint32_t)mac[5] << 24;
+
+    esp_err_t err = esp_event_handler_register(LINK_EVENT, ESP_EVENT_ANY_ID, udp_link_handler, NULL);
+    if (err != ESP_OK)
+        return err;
+    s_link_up = wifi_is_connected();
+    ESP_LOGI(TAG, "Streaming to %s %s:%d, %d samples or %d ms per datagram", s_multicast ? "group" : "address",
+             CONFIG_FLORALINK_UDP_ADDR, CONFIG_FLORALINK_UDP_PORT, UDP_BATCH_MAX, CONFIG_FLORALINK_UDP_MAX_LATENCY_MS);
+    return ESP_OK;
+}
+
+static void udp_close(void)
+{
+    if (s_sock >= 0)
+    {
+        close(s_sock);
+        s_sock = -1;
+    }
+}
+
+static bool udp_open(void)
+{
+    if (s_sock >= 0)
+        return true;
+    s_sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_IP);
+    if (s_sock < 0)
+    {
+        ESP_LOGE(TAG, "socket() failed (errno %d)", errno);
+        return false;
+    }
+    int err;
+    if (s_multicast)
+    {
+        uint8_t ttl = CONFIG_FLORALINK_UDP_TTL;
+        err = setsockopt(s_sock, IPPROTO_IP, IP_MULTICAST_TTL, &ttl, sizeof(ttl));
+    }
+    else
+    {
+        int on = 1;
+        err = setsockopt(s_sock, SOL_SOCKET, SO_BROADCAST, &on, sizeof(on));
+    }
+    if (err < 0)
+        ESP_LOGW(TAG, "setsockopt() failed (errno %d)", errno);
+    return true;
+}
+
+static size_t udp_encode(void)
+{
+    uint8_t *p = s_datagram;
+    p[0] = UDP_MAGIC;
+    p[1] = UDP_VERSION;
+    sample_put_le(p + 2, s_batch_len, 2);
+    sample_put_le(p + 4, s_seq, 4);
+    sample_put_le(p + 8, s_batch[0].seq, 4);
+    sample_put_le(p + 12, s_device_id, 4);
+    sample_put_le(p + 16, (uint64_t)s_batch[0].ts_us, 8);
+    return UDP_HEADER + sample_encode_records(s_batch, s_batch_len, p + UDP_HEADER);
+}
+
+// Send the batch, or drop it while the link is down; the batch is consumed either way
+static void udp_send_batch(void)
+{
+    if (!s_link_up)
+    {
+        udp_close();
+        s_stats.skipped += s_batch_len;
+        s_batch_len = 0;
+        return;
+    }
+    if (!udp_open())
+    {
+        s_stats.failures++;
+        s_batch_len = 0;
+        return;
+    }
+    size_t len = udp_encode();
+    if (sendto(s_sock, s_datagram, len, 0, (struct sockaddr *)&s_dest, sizeof(s_dest)) < 0)
+    {
+        // E.g. ENOMEM while the Wi-Fi TX queue is full; reopen in case the interface changed
+        ESP_LOGD(TAG, "sendto() failed (errno %d)", errno);
+        s_stats.failures++;
+        udp_close();
+    }
+    else
+    {
+        s_stats.datagrams++;
+        s_stats.samples += s_batch_len;
+        s_stats.bytes += len;
+    }
+    s_seq++; // Also on failure: the listeners see the gap
+    s_batch_len = 0;
+}
+
+void udp_pub_run(void)
+{
+    // Live stream: no backlog
+    sample_bus_subscribe(&s_sub, true, false);
+    for (;;)
+    {
+        s_batch_len = sample_batch_fill(&s_sub, s_batch, s_batch_len, UDP_BATCH_MAX, UDP_LATENCY_US, portMAX_DELAY);
+        s_stats.lost = s_sub.lost;
+        udp_send_batch();
+    }
+}
+
+void udp_pub_get_stats(udp_pub_stats_t *stats)
+{
+    *stats = s_stats;
+}
+
+esp_err_t udp_pub_export_json(trace_write_fn_t write, void *ctx)
+{
+    udp_pub_stats_t st;
+    udp_pub_get_stats(&st);
+    char buf[192];
+    int n = snprintf(buf, sizeof(buf),
+                     "{\"datagrams\":%lu,\"samples\":%lu,\"bytes\":%lu,\"failures\":%lu,\"skipped\":%lu,"
+                     "\"lost\":%lu,\"seq\":%lu}",
+                     (unsigned long)st.datagrams, (unsigned long)st.samples, (unsigned long)st.bytes,
+                     (unsigned long)st.failures, (unsigned long)st.skipped, (unsigned long)st.lost,
+                     (unsigned long)s_seq);
+    return write(ctx, buf, n);
+}
+
+#endif // CONFIG_FLORALINK_UDP
@@ -0,0 +1,63 @@
+/**
+ * @file udp_pub.h
+ * @brief Live sample stream over UDP multicast or broadcast.
+ *
+ * With CONFIG_FLORALINK_UDP a sample bus subscriber sends the readings as small fixed-format
+ * datagrams to CONFIG_FLORALINK_UDP_ADDR:CONFIG_FLORALINK_UDP_PORT, a multicast group or a
+ * broadcast address. Any number of listeners on the LAN receive the same datagram, at no
+ * extra cost to the device. Delivery is best effort: nothing is retransmitted, and readings
+ * taken while the link is down are skipped rather than queued.
+ *
+ * A datagram carries CONFIG_FLORALINK_UDP_BATCH readings (one by default), or fewer once the
+ * oldest is CONFIG_FLORALINK_UDP_MAX_LATENCY_MS old. Layout, all integers little-endian:
+ * - 24-byte header {u8 magic 0xF2, u8 version 1, u16 count, u32 datagram seq,
+ *   u32 first sample seq, u32 device id (last 4 bytes of the station MAC),
+ *   i64 uptime of the first sample in us}
+ * - count records {u16 dt_ms, u16 distance_cm (0xFFFF: error), u16 seq delta}, encoded by
+ *   sample_codec.h as in the binary MQTT payload (mqtt_pub.h).
+ * A gap in the datagram seq is a datagram lost on the network. A seq delta above 1, or a
+ * gap between the sample seqs of consecutive datagrams, is readings the device did not send.
+ */
+
+#ifndef UDP_PUB_H
+#define UDP_PUB_H
+
+#include <stdint.h>
+#include "esp_err.h"
+#include "trace.h"
+
+typedef struct
+{
+    uint32_t datagrams; ///< Datagrams sent
+    uint32_t samples;   ///< Readings in those datagrams
+    uint32_t bytes;     ///< Payload bytes
+    uint32_t failures;  ///< sendto() errors (datagram dropped)
+    uint32_t skipped;   ///< Readings dropped while the link was down
+    uint32_t lost;      ///< Readings overwritten in the sample bus before they were read
+} udp_pub_stats_t;
+
+/**
+ * @brief Resolve the destination and follow LINK_EVENT. Call after wifi_setup().
+ * @return ESP_OK, ESP_ERR_INVALID_ARG if CONFIG_FLORALINK_UDP_ADDR is not an IPv4 address.
+ */
+esp_err_t udp_pub_init(void);
+
+/**
+ * @brief Body of the sender task: subscribe to the sample bus and send datagrams. Never returns.
+ */
+void udp_pub_run(void);
+
+/**
+ * @brief Copy the datagram counters; the receiver compares them with the gaps it sees.
+ */
+void udp_pub_get_stats(udp_pub_stats_t *stats);
+
+/**
+ * @brief Stream the "udp" object of /stats, including the seq of the next datagram.
+ * @param write Output callback, see trace_write_fn_t
+ * @param ctx Opaque pointer passed to @p write
+ * @return ESP_OK on success, or the error returned by @p write.
+ */
+esp_err_t udp_pub_export_json(trace_write_fn_t write, void *ctx);
+
+#endif // UDP_PUB_H
@@ -1,28 +1,116 @@
 #include "modemanager.h"
-#include "blink_config.h"
 
 #include "webserver.h"
 #include "wifi_setup.h"
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <esp_log.h>
 #include <esp_http_server.h>
+#include <esp_timer.h>
 #include "monitor.h"
+#include "trace.h"
+#include "profile.h"
+#include "dlog.h"
+#include "tasks.h"
+#include "sched.h"
+#include "sample_bus.h"
+#include "dutycycle.h"
+#include "energy.h"
+#include "config_store.h"
+#include "mqtt_pub.h"
+#include "spool.h"
+#include "tsdb.h"
+#include "udp_pub.h"
+#include "coap_server.h"
+#include <time.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+// Keeps the CPU at full speed and out of light sleep while a request is handled
+static pm_lock_t s_http_pm_lock = NULL;
+
+// Output callback for the JSON exporters (trace, profile, energy, ...): one HTTP chunk per fragment
+static esp_err_t trace_write_chunk(void *ctx, const char *buf, size_t len)
+{
+    return httpd_resp_send_chunk((httpd_req_t *)ctx, buf, len);
+}
+
 // HTTP GET handler for /stats
 static esp_err_t stats_get_handler(httpd_req_t *req)
 {
+    TRACE_SCOPE("http_stats_get");
+    PROF_SCOPE("http_stats_get");
+    PM_LOCK_SCOPE(s_http_pm_lock);
     device_stats_t stats;
     monitor_get_device_stats(&stats);
-    char resp[192];
+    pm_sleep_stats_t sleep;
+    modemanager_get_sleep_stats(&sleep);
+    wifi_connect_stats_t wifi;
+    wifi_get_connect_stats(&wifi);
+    cfg_stats_t cfg;
+    config_get_stats(&cfg);
+    char resp[576];
     snprintf(resp, sizeof(resp),
-             "{\"free_heap\":%u,\"min_free_heap\":%u,\"uptime_ms\":%llu,\"cpu_load\":%.2f}\n",
+             "{\"free_heap\":%u,\"min_free_heap\":%u,\"uptime_ms\":%llu,\"cpu_load\":%.2f,"
+             "\"light_sleeps\":%lu,\"slept_ms\":%llu,\"sleep_residency\":%.3f,"
+             "\"wifi_connect_ms\":%lu,\"wifi_fast\":%s,\"wifi_fast_ok\":%lu,\"wifi_fast_failures\":%lu,"
+             "\"wifi_up\":%s,\"wifi_rssi\":%d,\"wifi_rssi_avg\":%d,\"wifi_connects\":%lu,"
+             "\"wifi_disconnects\":%lu,\"wifi_retries\":%lu,\"config_sets\":%lu,\"config_commits\":%lu,"
+             "\"first_sample_us\":%lld,\"energy\":",
              (unsigned int)stats.free_heap,
              (unsigned int)stats.min_free_heap,
              (unsigned long long)stats.uptime_ms,
-             stats.cpu_load);
+             stats.cpu_load,
+             (unsigned long)sleep.light_sleeps,
+             (unsigned long long)(sleep.slept_us / 1000),
+             sleep.uptime_us ? (double)sleep.slept_us / (double)sleep.uptime_us : 0.0,
+             (unsigned long)(wifi.last_connect_us / 1000),
+             wifi.last_fast ? "true" : "false",
+             (unsigned long)wifi.fast_ok,
+             (unsigned long)wifi.fast_failures,
+             wifi.up ? "true" : "false",
+             wifi.rssi_last,
+             wifi.rssi_avg,
+             (unsigned long)wifi.connects,
+             (unsigned long)wifi.disconnects,
+             (unsigned long)wifi.retries,
+             (unsigned long)cfg.sets,
+             (unsigned long)cfg.commits,
+             (long long)sample_bus_first_us());
     httpd_resp_set_type(req, "application/json");
-    httpd_resp_send(req, resp, HTTPD_RESP_USE_STRLEN);
-    return ESP_OK;
+    esp_err_t err = httpd_resp_sendstr_chunk(req, resp);
+    if (err == ESP_OK)
+        err = energy_export_json(trace_write_chunk, req);
+#if CONFIG_FLORALINK_MQTT
+    if (err == ESP_OK)
+        err = httpd_resp_sendstr_chunk(req, ",\"mqtt\":");
+    if (err == ESP_OK)
+        err = mqtt_pub_export_json(trace_write_chunk, req);
+#endif
+#if CONFIG_FLORALINK_SPOOL
+    if (err == ESP_OK)
+        err = httpd_resp_sendstr_chunk(req, ",\"spool\":");
+    if (err == ESP_OK)
+        err = spool_export_json(trace_write_chunk, req);
+#endif
+#if CONFIG_FLORALINK_UDP
+    if (err == ESP_OK)
+        err = httpd_resp_sendstr_chunk(req, ",\"udp\":");
+    if (err == ESP_OK)
+        err = udp_pub_export_json(trace_write_chunk, req);
+#endif
+#if CONFIG_FLORALINK_COAP
+    if (err == ESP_OK)
+        err = httpd_resp_sendstr_chunk(req, ",\"coap\":");
+    if (err == ESP_OK)
+        err = coap_server_export_json(trace_write_chunk, req);
+#endif
+    if (err == ESP_OK)
+        err = httpd_resp_sendstr_chunk(req, "}\n");
+    if (err != ESP_OK)
+        return err;
+    return httpd_resp_send_chunk(req, NULL, 0);
 }
 
 // Helper macro to send a chunk and log any error; on error, return immediately
@@ -40,6 +128,9 @@ static esp_err_t stats_get_handler(httpd_req_t *req)
 /* HTTP GET handler for /configure */
 static esp_err_t configure_get_handler(httpd_req_t *req)
 {
+    TRACE_SCOPE("http_configure_get");
+    PROF_SCOPE("http_configure_get");
+    PM_LOCK_SCOPE(s_http_pm_lock);
     httpd_resp_set_type(req, "text/html");
     SEND_HTML_CHUNK("<!DOCTYPE html><html><head><title>Configure</title><meta name='viewport' content='width=device-width,initial-scale=1'>");
     SEND_HTML_CHUNK("<style>"
@@ -53,18 +144,40 @@ static esp_err_t configure_get_handler(httpd_req_t *req)
                     "h2{margin:16px 24px 0 24px;color:#2196f3;}"
                     "form{margin:24px 24px 0 24px;}"
                     "label{display:block;margin:18px 0 6px;}"
-                    "input[type=number]{width:100%%;padding:8px;font-size:1em;}"
+                    "input[type=number],select{width:100%%;padding:8px;font-size:1em;}"
                     "button{margin-top:18px;padding:8px 16px;font-size:1em;border:none;border-radius:6px;background:#2196f3;color:#fff;cursor:pointer;}"
                     "</style>");
     SEND_HTML_CHUNK("<script>function moveTabUnderline(){var nav=document.querySelector('.nav');if(!nav)return;var active=nav.querySelector('.active');var underline=nav.querySelector('.tab-underline');if(active&&underline){underline.style.left=active.offsetLeft+'px';underline.style.width=active.offsetWidth+'px';}}window.addEventListener('DOMContentLoaded',moveTabUnderline);window.addEventListener('resize',moveTabUnderline);</script>");
     SEND_HTML_CHUNK("</head><body><div class='container'>");
     SEND_HTML_CHUNK("<nav class='nav'><a href='/' >Home</a><a href='/configure' class='active'>Configure</a><div class='tab-underline'></div></nav>");
-    SEND_HTML_CHUNK("<h2>Configure LED Blink</h2>");
+    SEND_HTML_CHUNK("<h2>Settings</h2>");
     SEND_HTML_CHUNK("<form method='POST' action='/configure'>");
-    SEND_HTML_CHUNK("<label for='period'>Blink Period (ms):</label>");
-    char input[128];
-    snprintf(input, sizeof(input), "<input type='number' id='period' name='period' min='%d' max='%d' value='%lu' required>", BLINK_PERIOD_MIN, BLINK_PERIOD_MAX, blink_get_period_ms());
-    SEND_HTML_CHUNK(input);
+    char input[160];
+    for (int key = 0; key < CFG_KEY_COUNT; key++)
+    {
+        const cfg_desc_t *d = config_describe((cfg_key_t)key);
+        uint32_t value = config_get((cfg_key_t)key);
+        snprintf(input, sizeof(input), "<label for='%s'>%s:</label>", d->name, d->label);
+        SEND_HTML_CHUNK(input);
+        if (d->type == CFG_TYPE_ENUM)
+        {
+            snprintf(input, sizeof(input), "<select id='%s' name='%s'>", d->name, d->name);
+            SEND_HTML_CHUNK(input);
+            for (uint32_t v = d->min; v <= d->max; v++)
+            {
+                snprintf(input, sizeof(input), "<option value='%lu'%s>%s</option>", (unsigned long)v,
+                         v == value ? " selected" : "", d->value_name(v));
+                SEND_HTML_CHUNK(input);
+            }
+            SEND_HTML_CHUNK("</select>");
+        }
+        else
+        {
+            snprintf(input, sizeof(input), "<input type='number' id='%s' name='%s' min='%lu' max='%lu' value='%lu' required>",
+                     d->name, d->name, (unsigned long)d->min, (unsigned long)d->max, (unsigned long)value);
+            SEND_HTML_CHUNK(input);
+        }
+    }
     SEND_HTML_CHUNK("<button type='submit'>Update</button>");
     SEND_HTML_CHUNK("</form>");
     // Sleep/Deep Sleep buttons
@@ -80,7 +193,10 @@ static esp_err_t configure_get_handler(httpd_req_t *req)
 /* HTTP POST handler for /configure */
 static esp_err_t configure_post_handler(httpd_req_t *req)
 {
-    char buf[64];
+    TRACE_SCOPE("http_configure_post");
+    PROF_SCOPE("http_configure_post");
+    PM_LOCK_SCOPE(s_http_pm_lock);
+    char buf[256];
     int ret = httpd_req_recv(req, buf, sizeof(buf) - 1);
     if (ret <= 0)
     {
@@ -88,7 +204,7 @@ static esp_err_t configure_post_handler(httpd_req_t *req)
         return ESP_FAIL;
     }
     buf[ret] = '\0';
-    // Parse: look for sleep/deep sleep or period
+    // Parse: look for sleep/deep sleep or settings
     if (strstr(buf, "sleep=light"))
     {
         modemanager_light_sleep();
@@ -99,13 +215,16 @@ static esp_err_t configure_post_handler(httpd_req_t *req)
     }
     else
     {
-        char *p = strstr(buf, "period=");
-        uint32_t period = 0;
-        if (p)
+        // Unchanged values are ignored by the store; changes are committed to NVS together
+        char value[12];
+        for (int key = 0; key < CFG_KEY_COUNT; key++)
         {
-            period = (uint32_t)atoi(p + 7);
-            blink_set_period_ms(period);
+            if (httpd_query_key_value(buf, config_describe((cfg_key_t)key)->name, value, sizeof(value)) == ESP_OK)
+                config_set((cfg_key_t)key, (uint32_t)strtoul(value, NULL, 10));
         }
+        // Blink period field of the form before the store; still accepted for existing clients
+        if (httpd_query_key_value(buf, "period", value, sizeof(value)) == ESP_OK)
+            config_set(CFG_BLINK_PERIOD_MS, (uint32_t)strtoul(value, NULL, 10));
     }
     httpd_resp_set_type(req, "text/html");
     httpd_resp_sendstr(req, "<html><body><script>window.location='/configure';</script></body></html>");
@@ -114,6 +233,9 @@ static esp_err_t configure_post_handler(httpd_req_t *req)
 // HTTP GET handler for /
 static esp_err_t index_get_handler(httpd_req_t *req)
 {
+    TRACE_SCOPE("http_index_get");
+    PROF_SCOPE("http_index_get");
+    PM_LOCK_SCOPE(s_http_pm_lock);
     const char *ssid = wifi_get_ssid();
     httpd_resp_set_type(req, "text/html");
 
@@ -204,37 +326,388 @@ static esp_err_t index_get_handler(httpd_req_t *req)
 }
 
 static const char *TAG = "WebServer";
-static uint32_t latest_distance = 0;
-static int32_t latest_error = 0;
 static httpd_handle_t server = NULL;
+// Serialises start/stop: the link event handler and webserver_init() may race to start
+static SemaphoreHandle_t s_server_lock = NULL;
 
 // HTTP GET handler for /distance
 static esp_err_t distance_get_handler(httpd_req_t *req)
 {
+    TRACE_SCOPE("http_distance_get");
+    PROF_SCOPE("http_distance_get");
+    PM_LOCK_SCOPE(s_http_pm_lock);
     char resp[96];
-    snprintf(resp, sizeof(resp), "{\"distance\": %u, \"error\": %d}\n", (unsigned int)latest_distance, (int)latest_error);
+    sample_t sample = {0};
+    sample_bus_latest(&sample);
+    snprintf(resp, sizeof(resp), "{\"distance\": %u, \"error\": %d, \"seq\": %u, \"age_ms\": %lld}\n",
+             (unsigned int)sample.distance_cm, (int)sample.err, (unsigned int)sample.seq,
+             sample.seq ? (long long)((esp_timer_get_time() - sample.ts_us) / 1000) : -1LL);
     httpd_resp_set_type(req, "application/json");
     httpd_resp_send(req, resp, HTTPD_RESP_USE_STRLEN);
     return ESP_OK;
 }
 
-void webserver_publish_distance(uint32_t distance)
+#if CONFIG_FLORALINK_TRACE
+// HTTP GET handler for /trace (Chrome Trace Event JSON, open in Perfetto or chrome://tracing)
+static esp_err_t trace_get_handler(httpd_req_t *req)
+{
+    PM_LOCK_SCOPE(s_http_pm_lock);
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_set_hdr(req, "Content-Disposition", "attachment; filename=\"floralink_trace.json\"");
+    esp_err_t err = trace_export_json(trace_write_chunk, req);
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(TAG, "trace export failed (%s)", esp_err_to_name(err));
+        return err;
+    }
+    return httpd_resp_send_chunk(req, NULL, 0);
+}
+#endif
+
+#if CONFIG_FLORALINK_PROFILE
+// HTTP GET handler for /profile (append ?reset=1 to clear each probe as it is read)
+static esp_err_t profile_get_handler(httpd_req_t *req)
 {
-    latest_distance = distance;
-    latest_error = 0;
+    PM_LOCK_SCOPE(s_http_pm_lock);
+    char query[16];
+    bool reset = httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK &&
+                 strstr(query, "reset=1") != NULL;
+    httpd_resp_set_type(req, "application/json");
+    esp_err_t err = prof_export_json(trace_write_chunk, req, reset);
+    if (err != ESP_OK)
+        return err;
+    return httpd_resp_send_chunk(req, NULL, 0);
 }
+#endif
 
-void webserver_publish_error(int32_t error_code)
+#if CONFIG_FLORALINK_DLOG
+// HTTP GET handler for /logs (tail of the deferred logger output)
+static esp_err_t logs_get_handler(httpd_req_t *req)
 {
-    latest_distance = 0;
-    latest_error = error_code;
+    PM_LOCK_SCOPE(s_http_pm_lock);
+    char *buf = malloc(CONFIG_FLORALINK_DLOG_TAIL_SIZE + 64);
+    if (!buf)
+    {
+        httpd_resp_send_500(req);
+        return ESP_ERR_NO_MEM;
+    }
+    size_t n = dlog_tail(buf, CONFIG_FLORALINK_DLOG_TAIL_SIZE);
+    n += snprintf(buf + n, 64, "-- dropped: %lu\n", (unsigned long)dlog_get_dropped());
+    httpd_resp_set_type(req, "text/plain");
+    esp_err_t err = httpd_resp_send(req, buf, n);
+    free(buf);
+    return err;
 }
+#endif
 
-/* Web server initialization */
-esp_err_t webserver_init(void)
+#if CONFIG_FLORALINK_DUTY_CYCLE
+// HTTP GET handler for /batch (readings taken in deep sleep cycles; ?ack=1 drops them once sent)
+static esp_err_t batch_get_handler(httpd_req_t *req)
+{
+    PM_LOCK_SCOPE(s_http_pm_lock);
+    char query[16];
+    bool ack = httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK &&
+               strstr(query, "ack=1") != NULL;
+    httpd_resp_set_type(req, "application/json");
+    esp_err_t err = dutycycle_export_json(trace_write_chunk, req);
+    if (err != ESP_OK)
+        return err;
+    if (ack)
+        dutycycle_ack();
+    return httpd_resp_send_chunk(req, NULL, 0);
+}
+#endif
+
+#if CONFIG_FLORALINK_TSDB
+#define HISTORY_MAX_POINTS 4000 // Per response; narrow the range or raise step for more
+
+typedef struct
+{
+    httpd_req_t *req;
+    bool raw;
+    uint32_t points;
+    size_t len;
+    char buf[512];
+} history_ctx_t;
+
+// Point callback of /history: one JSON array per point, sent in chunks of up to 512 bytes
+static esp_err_t history_point(const tsdb_point_t *p, void *arg)
+{
+    history_ctx_t *c = arg;
+    if (c->points == HISTORY_MAX_POINTS)
+        return ESP_ERR_INVALID_SIZE;
+    if (c->len > sizeof(c->buf) - 80)
+    {
+        esp_err_t err = httpd_resp_send_chunk(c->req, c->buf, c->len);
+        if (err != ESP_OK)
+            return err;
+        c->len = 0;
+    }
+    const char *sep = c->points++ ? "," : "";
+    if (c->raw)
+        c->len += snprintf(&c->buf[c->len], sizeof(c->buf) - c->len, "%s[%lld,%ld]", sep,
+                           (long long)p->t_ms, (long)p->min);
+    else
+        c->len += snprintf(&c->buf[c->len], sizeof(c->buf) - c->len, "%s[%lld,%ld,%ld,%ld.%ld,%ld]", sep,
+                           (long long)p->t_ms, (long)p->min, (long)p->max, (long)(p->mean_x10 / 10),
+                           (long)(p->mean_x10 % 10), (long)p->count);
+    return ESP_OK;
+}
+
+/*
+ * HTTP GET handler for /history?from=<s>&to=<s>&step=<s> (Unix seconds; defaults: the last
+ * hour, step 0). Served from the coarsest tier whose resolution is at most step. Points are
+ * [t_ms,cm] for raw readings and [t_ms,min,max,mean,count] for rollups, t_ms being the bucket start.
+ */
+static esp_err_t history_get_handler(httpd_req_t *req)
+{
+    TRACE_SCOPE("http_history_get");
+    PROF_SCOPE("http_history_get");
+    PM_LOCK_SCOPE(s_http_pm_lock);
+    char query[96] = "";
+    char value[24];
+    int64_t to = (int64_t)time(NULL);
+    int64_t from = to - 3600;
+    uint32_t step = 0;
+    httpd_req_get_url_query_str(req, query, sizeof(query));
+    if (httpd_query_key_value(query, "to", value, sizeof(value)) == ESP_OK)
+        to = strtoll(value, NULL, 10);
+    if (httpd_query_key_value(query, "from", value, sizeof(value)) == ESP_OK)
+        from = strtoll(value, NULL, 10);
+    if (httpd_query_key_value(query, "step", value, sizeof(value)) == ESP_OK)
+        step = (uint32_t)strtoul(value, NULL, 10);
+
+    static history_ctx_t s_ctx; // One request at a time: httpd has a single worker task
+    history_ctx_t *c = &s_ctx;
+    uint32_t res;
+    tsdb_tier_id_t tier = tsdb_pick_tier(step);
+    c->req = req;
+    c->raw = tier == TSDB_TIER_RAW;
+    c->points = 0;
+    c->len = snprintf(c->buf, sizeof(c->buf), "{\"tier\":\"%s\",", tsdb_tier_name(tier, &res));
+    c->len += snprintf(&c->buf[c->len], sizeof(c->buf) - c->len,
+                       "\"resolution_s\":%lu,\"from\":%lld,\"to\":%lld,\"points\":[", (unsigned long)res,
+                       (long long)from, (long long)to);
+    httpd_resp_set_type(req, "application/json");
+    esp_err_t err = tsdb_query(tier, from, to, history_point, c);
+    bool truncated = err == ESP_ERR_INVALID_SIZE;
+    if (err != ESP_OK && !truncated)
+    {
+        if (c->points == 0)
+            return httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, esp_err_to_name(err));
+        return err; // Failed while sending: the connection is closed
+    }
+    if (c->len > sizeof(c->buf) - 64)
+    {
+        err = httpd_resp_send_chunk(req, c->buf, c->len);
+        if (err != ESP_OK)
+            return err;
+        c->len = 0;
+    }
+    snprintf(&c->buf[c->len], sizeof(c->buf) - c->len, "],\"count\":%lu,\"truncated\":%s}\n",
+             (unsigned long)c->points, truncated ? "true" : "false");
+    err = httpd_resp_send_chunk(req, c->buf, HTTPD_RESP_USE_STRLEN);
+    if (err != ESP_OK)
+        return err;
+    return httpd_resp_send_chunk(req, NULL, 0);
+}
+#endif
+
+// HTTP GET handler for /tasks (task table plus live priority and stack headroom)
+static esp_err_t tasks_get_handler(httpd_req_t *req)
+{
+    TRACE_SCOPE("http_tasks_get");
+    PROF_SCOPE("http_tasks_get");
+    PM_LOCK_SCOPE(s_http_pm_lock);
+    size_t count;
+    const task_def_t *table = tasks_get_table(&count);
+    char buf[224];
+    httpd_resp_set_type(req, "application/json");
+    SEND_HTML_CHUNK("{\"tasks\":[");
+    for (size_t i = 0; i < count; i++)
+    {
+        const task_def_t *def = &table[i];
+        TaskHandle_t h = def->handle;
+        snprintf(buf, sizeof(buf),
+                 "%s{\"name\":\"%s\",\"priority\":%u,\"cur_priority\":%d,\"core\":%d,\"stack\":%lu,"
+                 "\"stack_free_min\":%d,\"period_ms\":%lu",
+                 i ? "," : "", def->name, (unsigned)def->priority, h ? (int)uxTaskPriorityGet(h) : -1,
+                 def->core, (unsigned long)def->stack, h ? (int)uxTaskGetStackHighWaterMark(h) : -1,
+                 (unsigned long)def->period_ms);
+        SEND_HTML_CHUNK(buf);
+        if (def->timing)
+        {
+            // Release timing: lateness and period deviation, log2 microsecond buckets
+            const periodic_stats_t *st = &def->timing->stats;
+            snprintf(buf, sizeof(buf),
+                     ",\"timing\":{\"period_ms\":%lu,\"releases\":%lu,\"missed\":%lu,"
+                     "\"late_max_us\":%lu,\"jitter_max_us\":%lu",
+                     (unsigned long)periodic_get_period_ms(def->timing), (unsigned long)st->releases,
+                     (unsigned long)st->missed, (unsigned long)st->late_max_us,
+                     (unsigned long)st->jitter_max_us);
+            SEND_HTML_CHUNK(buf);
+            const uint32_t *hists[] = {st->late_hist, st->jitter_hist};
+            const char *names[] = {"late_hist", "jitter_hist"};
+            for (int k = 0; k < 2; k++)
+            {
+                int n = snprintf(buf, sizeof(buf), ",\"%s\":[", names[k]);
+                for (int b = 0; b < PERIODIC_HIST_BUCKETS; b++)
+                    n += snprintf(buf + n, sizeof(buf) - n, "%s%lu", b ? "," : "", (unsigned long)hists[k][b]);
+                snprintf(buf + n, sizeof(buf) - n, "]");
+                SEND_HTML_CHUNK(buf);
+            }
+            SEND_HTML_CHUNK("}");
+        }
+        SEND_HTML_CHUNK("}");
+    }
+    SEND_HTML_CHUNK("],\"jobs\":[");
+    for (const sched_job_t *job = sched_get_jobs(); job; job = job->next)
+    {
+        const periodic_stats_t *st = &job->timing.stats;
+        snprintf(buf, sizeof(buf),
+                 "%s{\"name\":\"%s\",\"period_ms\":%lu,\"runs\":%lu,\"run_avg_us\":%lu,\"run_max_us\":%lu,"
+                 "\"missed\":%lu,\"late_max_us\":%lu,\"jitter_max_us\":%lu}",
+                 job != sched_get_jobs() ? "," : "", job->name,
+                 (unsigned long)periodic_get_period_ms(&job->timing), (unsigned long)job->runs,
+                 (unsigned long)(job->runs ? job->run_total_us / job->runs : 0), (unsigned long)job->run_max_us,
+                 (unsigned long)st->missed, (unsigned long)st->late_max_us, (unsigned long)st->jitter_max_us);
+        SEND_HTML_CHUNK(buf);
+    }
+    snprintf(buf, sizeof(buf), "],\"httpd\":{\"priority\":%d,\"core\":%d},\"cores\":%d}\n",
+             CONFIG_FLORALINK_HTTPD_PRIO, CONFIG_FLORALINK_HTTPD_CORE, portNUM_PROCESSORS);
+    SEND_HTML_CHUNK(buf);
+    return httpd_resp_send_chunk(req, NULL, 0);
+}
+
+#define BENCH_BLOCK 1024
+#define BENCH_MAX_BYTES (256 * 1024)
+
+// Server-side timings of /bench/payload, per Wi-Fi power profile
+typedef struct
 {
+    uint32_t requests;
+    uint64_t bytes;
+    uint64_t first_total_us; // Handler entry until the first block was handed to the stack
+    uint32_t first_max_us;
+    uint64_t send_total_us; // Handler entry until the last block was handed to the stack
+} bench_stats_t;
+
+static bench_stats_t s_bench[WIFI_PROFILE_COUNT];
+static const char s_bench_block[BENCH_BLOCK];
+
+// Switch the Wi-Fi profile if the query has profile=<name>; ESP_ERR_NOT_FOUND for an unknown name
+static esp_err_t bench_apply_profile(httpd_req_t *req, const char *query)
+{
+    char name[16];
+    wifi_profile_t profile;
+    if (httpd_query_key_value(query, "profile", name, sizeof(name)) != ESP_OK)
+        return ESP_OK;
+    if (wifi_profile_from_name(name, &profile) != ESP_OK)
+    {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Unknown profile");
+        return ESP_ERR_NOT_FOUND;
+    }
+    // Through the store, so the profile that won the benchmark is kept across reboots
+    return config_set(CFG_WIFI_PROFILE, profile);
+}
+
+/*
+ * HTTP GET handler for /bench/payload?bytes=N[&profile=name]: streams N bytes (default 32 KiB)
+ * under the current profile. Client side, e.g.
+ *   curl -o /dev/null -w "%{time_starttransfer} %{speed_download}\n" "http://<ip>/bench/payload?profile=low_power"
+ * also captures the wake-up delay of modem sleep, which the device cannot observe.
+ */
+static esp_err_t bench_payload_handler(httpd_req_t *req)
+{
+    PM_LOCK_SCOPE(s_http_pm_lock);
+    int64_t start = esp_timer_get_time();
+    char query[64] = "";
+    char value[12];
+    uint32_t bytes = 32 * 1024;
+    httpd_req_get_url_query_str(req, query, sizeof(query));
+    if (bench_apply_profile(req, query) != ESP_OK)
+        return ESP_OK;
+    if (httpd_query_key_value(query, "bytes", value, sizeof(value)) == ESP_OK)
+    {
+        bytes = (uint32_t)strtoul(value, NULL, 10);
+        if (bytes > BENCH_MAX_BYTES)
+            bytes = BENCH_MAX_BYTES;
+    }
+
+    httpd_resp_set_type(req, "application/octet-stream");
+    int64_t first = 0;
+    for (uint32_t sent = 0; sent < bytes;)
+    {
+        uint32_t n = bytes - sent < BENCH_BLOCK ? bytes - sent : BENCH_BLOCK;
+        esp_err_t err = httpd_resp_send_chunk(req, s_bench_block, n);
+        if (err != ESP_OK)
+            return err;
+        if (!first)
+            first = esp_timer_get_time();
+        sent += n;
+    }
+    esp_err_t err = httpd_resp_send_chunk(req, NULL, 0);
+    int64_t end = esp_timer_get_time();
+
+    bench_stats_t *st = &s_bench[wifi_get_profile()];
+    uint32_t first_us = first ? (uint32_t)(first - start) : 0;
+    st->requests++;
+    st->bytes += bytes;
+    st->first_total_us += first_us;
+    if (first_us > st->first_max_us)
+        st->first_max_us = first_us;
+    st->send_total_us += (uint64_t)(end - start);
+    return err;
+}
+
+// HTTP GET handler for /bench (per-profile results; ?profile=name switches, ?reset=1 clears)
+static esp_err_t bench_get_handler(httpd_req_t *req)
+{
+    PM_LOCK_SCOPE(s_http_pm_lock);
+    char query[64] = "";
+    httpd_req_get_url_query_str(req, query, sizeof(query));
+    if (bench_apply_profile(req, query) != ESP_OK)
+        return ESP_OK;
+    if (strstr(query, "reset=1"))
+        memset(s_bench, 0, sizeof(s_bench));
+
+    char buf[224];
+    wifi_connect_stats_t wifi;
+    wifi_get_connect_stats(&wifi);
+    httpd_resp_set_type(req, "application/json");
+    snprintf(buf, sizeof(buf), "{\"profile\":\"%s\",\"rssi\":%d,\"profiles\":{",
+             wifi_profile_name(wifi_get_profile()), wifi.rssi_avg);
+    SEND_HTML_CHUNK(buf);
+    for (int i = 0; i < WIFI_PROFILE_COUNT; i++)
+    {
+        const bench_stats_t *st = &s_bench[i];
+        snprintf(buf, sizeof(buf),
+                 "%s\"%s\":{\"requests\":%lu,\"bytes\":%llu,\"first_avg_us\":%lu,\"first_max_us\":%lu,"
+                 "\"send_avg_us\":%lu,\"throughput_kbps\":%.1f}",
+                 i ? "," : "", wifi_profile_name((wifi_profile_t)i), (unsigned long)st->requests,
+                 (unsigned long long)st->bytes,
+                 (unsigned long)(st->requests ? st->first_total_us / st->requests : 0),
+                 (unsigned long)st->first_max_us,
+                 (unsigned long)(st->requests ? st->send_total_us / st->requests : 0),
+                 st->send_total_us ? (double)st->bytes * 8000.0 / (double)st->send_total_us : 0.0);
+        SEND_HTML_CHUNK(buf);
+    }
+    SEND_HTML_CHUNK("}}\n");
+    return httpd_resp_send_chunk(req, NULL, 0);
+}
+
+/* Start the server and register the URI handlers; called with s_server_lock held */
+static esp_err_t webserver_start_locked(void)
+{
+    if (server)
+        return ESP_OK;
     httpd_config_t config = HTTPD_DEFAULT_CONFIG();
     config.server_port = 80;
+    config.max_uri_handlers = 16;
+    config.task_priority = CONFIG_FLORALINK_HTTPD_PRIO;
+    config.core_id = (CONFIG_FLORALINK_HTTPD_CORE >= 0 && CONFIG_FLORALINK_HTTPD_CORE < portNUM_PROCESSORS)
+                         ? CONFIG_FLORALINK_HTTPD_CORE
+                         : tskNO_AFFINITY;
 
     // Register root HTML page
     httpd_uri_t index_uri = {
@@ -253,6 +726,7 @@ esp_err_t webserver_init(void)
     if (ret != ESP_OK)
     {
         ESP_LOGE(TAG, "Failed to start HTTP server: %s", esp_err_to_name(ret));
+        server = NULL;
         return ret;
     }
     /* Register URI handlers */
@@ -278,6 +752,107 @@ esp_err_t webserver_init(void)
         .handler = configure_post_handler,
         .user_ctx = NULL};
     httpd_register_uri_handler(server, &configure_post_uri);
+    httpd_uri_t tasks_uri = {
+        .uri = "/tasks",
+        .method = HTTP_GET,
+        .handler = tasks_get_handler,
+        .user_ctx = NULL};
+    httpd_register_uri_handler(server, &tasks_uri);
+    httpd_uri_t bench_uri = {
+        .uri = "/bench",
+        .method = HTTP_GET,
+        .handler = bench_get_handler,
+        .user_ctx = NULL};
+    httpd_register_uri_handler(server, &bench_uri);
+    httpd_uri_t bench_payload_uri = {
+        .uri = "/bench/payload",
+        .method = HTTP_GET,
+        .handler = bench_payload_handler,
+        .user_ctx = NULL};
+    httpd_register_uri_handler(server, &bench_payload_uri);
+#if CONFIG_FLORALINK_TRACE
+    httpd_uri_t trace_uri = {
+        .uri = "/trace",
+        .method = HTTP_GET,
+        .handler = trace_get_handler,
+        .user_ctx = NULL};
+    httpd_register_uri_handler(server, &trace_uri);
+#endif
+#if CONFIG_FLORALINK_PROFILE
+    httpd_uri_t profile_uri = {
+        .uri = "/profile",
+        .method = HTTP_GET,
+        .handler = profile_get_handler,
+        .user_ctx = NULL};
+    httpd_register_uri_handler(server, &profile_uri);
+#endif
+#if CONFIG_FLORALINK_DUTY_CYCLE
+    httpd_uri_t batch_uri = {
+        .uri = "/batch",
+        .method = HTTP_GET,
+        .handler = batch_get_handler,
+        .user_ctx = NULL};
+    httpd_register_uri_handler(server, &batch_uri);
+#endif
+#if CONFIG_FLORALINK_TSDB
+    httpd_uri_t history_uri = {
+        .uri = "/history",
+        .method = HTTP_GET,
+        .handler = history_get_handler,
+        .user_ctx = NULL};
+    httpd_register_uri_handler(server, &history_uri);
+#endif
+#if CONFIG_FLORALINK_DLOG
+    httpd_uri_t logs_uri = {
+        .uri = "/logs",
+        .method = HTTP_GET,
+        .handler = logs_get_handler,
+        .user_ctx = NULL};
+    httpd_register_uri_handler(server, &logs_uri);
+#endif
     ESP_LOGI(TAG, "Web server started on port %d", config.server_port);
     return ESP_OK;
 }
+
+static esp_err_t webserver_start(void)
+{
+    xSemaphoreTake(s_server_lock, portMAX_DELAY);
+    esp_err_t ret = webserver_start_locked();
+    xSemaphoreGive(s_server_lock);
+    return ret;
+}
+
+static void webserver_stop(void)
+{
+    xSemaphoreTake(s_server_lock, portMAX_DELAY);
+    if (server)
+    {
+        httpd_stop(server);
+        server = NULL;
+        ESP_LOGI(TAG, "Web server stopped");
+    }
+    xSemaphoreGive(s_server_lock);
+}
+
+// Runs in the default event loop task; the server only lives while the link is up
+static void link_event_handler(void *arg, esp_event_base_t base, int32_t id, void *data)
+{
+    if (id == LINK_EVENT_UP)
+        webserver_start();
+    else if (id == LINK_EVENT_DOWN)
+        webserver_stop();
+}
+
+/* Web server initialization */
+esp_err_t webserver_init(void)
+{
+    s_http_pm_lock = modemanager_pm_lock_create("http");
+    s_server_lock = xSemaphoreCreateMutex();
+    if (!s_server_lock)
+        return ESP_ERR_NO_MEM;
+    esp_err_t ret = esp_event_handler_register(LINK_EVENT, ESP_EVENT_ANY_ID, link_event_handler, NULL);
+    if (ret != ESP_OK)
+        return ret;
+    // The link may have come up before the handler was registered
+    return wifi_is_connected() ? webserver_start() : ESP_OK;
+}
@@ -4,9 +4,31 @@
  *
  * This module handles WiFi station mode setup, connection, and exposes the current SSID.
  *
+ * Connection manager: wifi_setup() only starts the driver; connecting and reconnecting run
+ * in the background for the whole uptime. After a failed attempt or a lost link the next
+ * attempt is delayed by a jittered exponential backoff (a random delay between half and all
+ * of base * 2^n, capped), so a router reboot is ridden out without hammering the radio.
+ * Link changes are posted as LINK_EVENT_UP / LINK_EVENT_DOWN on the default event loop, and
+ * the RSSI of the current AP is tracked as a moving average by a scheduler job.
+ *
+ * Power profiles pair a power-save mode with a TX power limit; the active one is the
+ * CFG_WIFI_PROFILE setting of the configuration store. Unless a profile is chosen, or
+ * CONFIG_FLORALINK_AUTO_LIGHT_SLEEP makes "balanced" the default, the driver's own power
+ * save and TX power settings are left alone. The listen interval is
+ * always announced at association, so switching to the low-power profile at runtime takes
+ * effect without reconnecting.
+ *
+ * Fast reconnect (CONFIG_FLORALINK_WIFI_FAST_CONNECT): the BSSID, channel and IP lease of
+ * the last successful connection are kept in RTC memory, which survives deep sleep. The next
+ * connection targets that BSSID on that channel directly, skipping the scan, and with
+ * CONFIG_FLORALINK_WIFI_REUSE_LEASE also skips DHCP by applying the cached lease as a
+ * static IP. If that attempt fails, the cache is dropped and a normal scan + DHCP
+ * connection follows. The time from wifi_setup() to an IP address is measured either way.
+ *
  * Usage:
  * 1. Call wifi_setup() during system initialization.
- * 2. Use wifi_get_ssid() to retrieve the connected SSID for display or diagnostics.
+ * 2. Register for LINK_EVENT to start and stop network users.
+ * 3. Use wifi_get_ssid() to retrieve the connected SSID for display or diagnostics.
  */
 
 #include "wifi_setup.h"
@@ -14,33 +36,167 @@
 #include <esp_wifi.h>
 #include <esp_event.h>
 #include <esp_log.h>
+#include <esp_timer.h>
+#include <esp_attr.h>
+#include <esp_random.h>
 #include <nvs_flash.h>
 #include <freertos/event_groups.h>
 #include "lwip/ip4_addr.h"
 #include "sdkconfig.h"
+#include "sched.h"
+#include "config_store.h"
 
 #define WIFI_SSID CONFIG_WIFI_SSID
 #define WIFI_PASS CONFIG_WIFI_PASS
-#define WIFI_MAX_RETRY 5
-#define WIFI_CONNECTED_BIT BIT0 ///< Event bit for successful connection
-#define WIFI_FAIL_BIT BIT1      ///< Event bit for connection failure
+#define WIFI_CONNECTED_BIT BIT0 ///< Event bit set while the station has an IP address
+#define WIFI_RSSI_PERIOD_MS 5000
+#define WIFI_RSSI_EWMA_SHIFT 3 // Moving average weight 1/8
+
+ESP_EVENT_DEFINE_BASE(LINK_EVENT);
+
+typedef struct
+{
+    const char *name;
+    wifi_ps_type_t ps;
+    int8_t max_tx_power; // Units of 0.25 dBm
+} wifi_profile_desc_t;
+
+static wifi_profile_desc_t s_profiles[WIFI_PROFILE_COUNT] = {
+    [WIFI_PROFILE_PERFORMANCE] = {"performance", WIFI_PS_NONE, 80}, // 20 dBm
+    [WIFI_PROFILE_BALANCED] = {"balanced", WIFI_PS_MIN_MODEM, 68},  // 17 dBm
+    [WIFI_PROFILE_LOW_POWER] = {"low_power", WIFI_PS_MAX_MODEM, 52}, // 13 dBm
+    // Read back from the driver by wifi_setup() before any profile is applied
+    [WIFI_PROFILE_DEFAULT] = {"default"},
+};
 
 // Holds the SSID of the currently configured WiFi network
 static char s_current_ssid[WIFI_SSID_MAX_LEN] = {0};
 // Logging tag for ESP-IDF logging macros
 static const char *TAG = "WiFiSetup";
-// Retry counter for connection attempts
-static int s_retry_num = 0;
+// Consecutive failed attempts, drives the backoff
+static uint32_t s_attempt = 0;
+static esp_timer_handle_t s_retry_timer = NULL;
+static portMUX_TYPE s_stats_lock = portMUX_INITIALIZER_UNLOCKED;
+static int32_t s_rssi_avg_x16 = 0; // Fixed point, 4 fractional bits
 // FreeRTOS event group to signal connection events
 static EventGroupHandle_t s_wifi_event_group;
+static esp_netif_t *s_sta_netif = NULL;
+static int64_t s_setup_start_us = 0;
+static bool s_fast_attempt = false;
+static wifi_connect_stats_t s_connect_stats = {0};
+static bool s_started = false;
+static wifi_profile_t s_profile = WIFI_PROFILE_DEFAULT;
+
+// Last successful connection, kept across deep sleep
+typedef struct
+{
+    bool valid;
+    uint8_t bssid[6];
+    uint8_t channel;
+    esp_netif_ip_info_t ip_info;
+    esp_netif_dns_info_t dns;
+} wifi_rtc_cache_t;
+
+static RTC_DATA_ATTR wifi_rtc_cache_t s_cache;
+
+// Remember the AP and lease we just connected with
+static void wifi_cache_store(const esp_netif_ip_info_t *ip_info)
+{
+    wifi_ap_record_t ap;
+    if (esp_wifi_sta_get_ap_info(&ap) != ESP_OK)
+        return;
+    memcpy(s_cache.bssid, ap.bssid, sizeof(s_cache.bssid));
+    s_cache.channel = ap.primary;
+    s_cache.ip_info = *ip_info;
+    esp_netif_get_dns_info(s_sta_netif, ESP_NETIF_DNS_MAIN, &s_cache.dns);
+    s_cache.valid = true;
+}
+
+// Fast connect failed: forget the cache and go back to scan + DHCP
+static void wifi_fast_fallback(void)
+{
+    wifi_config_t cfg;
+    s_cache.valid = false;
+    s_fast_attempt = false;
+    portENTER_CRITICAL(&s_stats_lock);
+    s_connect_stats.fast_failures++;
+    portEXIT_CRITICAL(&s_stats_lock);
+    esp_wifi_get_config(WIFI_IF_STA, &cfg);
+    cfg.sta.bssid_set = false;
+    cfg.sta.channel = 0;
+    cfg.sta.scan_method = WIFI_ALL_CHANNEL_SCAN;
+    esp_wifi_set_config(WIFI_IF_STA, &cfg);
+    esp_netif_dhcpc_start(s_sta_netif);
+    ESP_LOGW(TAG, "Fast connect failed, falling back to a full scan");
+}
+
+static void retry_timer_cb(void *arg)
+{
+    esp_wifi_connect();
+}
+
+// Schedule the next connection attempt: random delay in [d/2, d], d = base * 2^attempt capped
+static void wifi_schedule_retry(void)
+{
+    uint32_t shift = s_attempt < 16 ? s_attempt : 16;
+    uint64_t delay_ms = (uint64_t)CONFIG_FLORALINK_WIFI_BACKOFF_BASE_MS << shift;
+    if (delay_ms > CONFIG_FLORALINK_WIFI_BACKOFF_MAX_MS)
+        delay_ms = CONFIG_FLORALINK_WIFI_BACKOFF_MAX_MS;
+    delay_ms = delay_ms / 2 + esp_random() % (delay_ms / 2 + 1);
+    s_attempt++;
+    portENTER_CRITICAL(&s_stats_lock);
+    s_connect_stats.retries++;
+    s_connect_stats.backoff_ms = (uint32_t)delay_ms;
+    portEXIT_CRITICAL(&s_stats_lock);
+    ESP_LOGI(TAG, "Reconnect attempt %lu in %lu ms", (unsigned long)s_attempt, (unsigned long)delay_ms);
+    esp_timer_stop(s_retry_timer);
+    esp_timer_start_once(s_retry_timer, delay_ms * 1000ULL);
+}
+
+static void wifi_link_down(void)
+{
+    if (!(xEventGroupGetBits(s_wifi_event_group) & WIFI_CONNECTED_BIT))
+        return;
+    xEventGroupClearBits(s_wifi_event_group, WIFI_CONNECTED_BIT);
+    portENTER_CRITICAL(&s_stats_lock);
+    s_connect_stats.disconnects++;
+    s_connect_stats.up = false;
+    portEXIT_CRITICAL(&s_stats_lock);
+    esp_event_post(LINK_EVENT, LINK_EVENT_DOWN, NULL, 0, 0);
+}
+
+// Scheduler job: moving average of the AP's signal strength while associated
+static void wifi_rssi_job(void *arg)
+{
+    int rssi;
+    if (!(xEventGroupGetBits(s_wifi_event_group) & WIFI_CONNECTED_BIT) || esp_wifi_sta_get_rssi(&rssi) != ESP_OK)
+        return;
+    portENTER_CRITICAL(&s_stats_lock);
+    if (s_connect_stats.rssi_samples++ == 0)
+        s_rssi_avg_x16 = rssi * 16;
+    else
+        s_rssi_avg_x16 += (rssi * 16 - s_rssi_avg_x16) >> WIFI_RSSI_EWMA_SHIFT;
+    s_connect_stats.rssi_last = (int8_t)rssi;
+    s_connect_stats.rssi_avg = (int8_t)(s_rssi_avg_x16 / 16);
+    portEXIT_CRITICAL(&s_stats_lock);
+}
+
+static sched_job_t s_rssi_job = SCHED_JOB_INIT("wifi_rssi", wifi_rssi_job, NULL);
+
+static void wifi_profile_changed(cfg_key_t key, uint32_t value, void *arg)
+{
+    wifi_set_profile((wifi_profile_t)value);
+}
+
+static cfg_sub_t s_profile_sub = CFG_SUB_INIT(wifi_profile_changed, NULL, CFG_BIT(CFG_WIFI_PROFILE));
 
 /**
  * @brief Event handler for WiFi and IP events.
  *
  * Handles WiFi start, disconnect, and IP acquisition events.
  * - On start: attempts to connect.
- * - On disconnect: retries up to WIFI_MAX_RETRY, then signals failure.
- * - On IP: signals successful connection.
+ * - On disconnect or lost IP: signals link down, then retries after a backoff delay.
+ * - On IP: resets the backoff and signals link up.
  */
 static void event_handler(void *arg, esp_event_base_t event_base,
                           int32_t event_id, void *event_data)
@@ -52,49 +208,85 @@ static void event_handler(void *arg, esp_event_base_t event_base,
     }
     else if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_DISCONNECTED)
     {
-        // Disconnected: retry or signal failure
-        if (s_retry_num < WIFI_MAX_RETRY)
+        // Disconnected: a failed fast connect falls back to a scan without waiting
+        wifi_link_down();
+        if (s_fast_attempt)
         {
+            wifi_fast_fallback();
             esp_wifi_connect();
-            s_retry_num++;
-            ESP_LOGI(TAG, "Retrying to connect to the AP");
         }
         else
         {
-            xEventGroupSetBits(s_wifi_event_group, WIFI_FAIL_BIT);
+            wifi_schedule_retry();
         }
-        ESP_LOGI(TAG, "Connect to the AP fail");
+    }
+    else if (event_base == IP_EVENT && event_id == IP_EVENT_STA_LOST_IP)
+    {
+        // Still associated but without an address; the driver keeps trying DHCP
+        wifi_link_down();
     }
     else if (event_base == IP_EVENT && event_id == IP_EVENT_STA_GOT_IP)
     {
         // Got IP: signal success
         ip_event_got_ip_t *event = (ip_event_got_ip_t *)event_data;
         ESP_LOGI(TAG, "Got IP: %s", ip4addr_ntoa((const ip4_addr_t *)&event->ip_info.ip));
-        s_retry_num = 0;
+        s_attempt = 0;
+        int64_t setup_start_us = s_setup_start_us;
+        s_setup_start_us = 0;
+        bool fast = s_fast_attempt;
+        s_fast_attempt = false;
+        portENTER_CRITICAL(&s_stats_lock);
+        if (setup_start_us)
+        {
+            // Only the connection started by wifi_setup() is timed
+            s_connect_stats.last_connect_us = (uint32_t)(esp_timer_get_time() - setup_start_us);
+        }
+        s_connect_stats.last_fast = fast;
+        if (fast)
+            s_connect_stats.fast_ok++;
+        else
+            s_connect_stats.full++;
+        s_connect_stats.connects++;
+        s_connect_stats.up = true;
+        s_connect_stats.backoff_ms = 0;
+        portEXIT_CRITICAL(&s_stats_lock);
+        ESP_LOGI(TAG, "Connected in %lu ms (%s)", (unsigned long)(s_connect_stats.last_connect_us / 1000),
+                 fast ? "fast" : "scan");
+        wifi_cache_store(&event->ip_info);
         xEventGroupSetBits(s_wifi_event_group, WIFI_CONNECTED_BIT);
+        esp_event_post(LINK_EVENT, LINK_EVENT_UP, NULL, 0, 0);
     }
 }
 
 /**
  * @brief Initialize WiFi in station mode and connect to the configured SSID.
  *
- * This function sets up the WiFi driver, registers event handlers, and attempts to connect
- * to the WiFi network specified by WIFI_SSID and WIFI_PASS. It blocks until connection or failure.
+ * This function sets up the WiFi driver, registers event handlers, and starts connecting
+ * to the WiFi network specified by WIFI_SSID and WIFI_PASS. It returns once the driver is
+ * started; the connection is made (and remade) in the background and announced through
+ * LINK_EVENT.
  *
- * @return ESP_OK on successful connection, ESP_FAIL otherwise.
+ * @return ESP_OK once the driver is started, an error code otherwise.
  */
 esp_err_t wifi_setup(void)
 {
     // 1. Create event group for connection events
+    s_setup_start_us = esp_timer_get_time();
     s_wifi_event_group = xEventGroupCreate();
 
-    // 2. Initialize NVS, TCP/IP, and event loop
-    ESP_ERROR_CHECK(nvs_flash_init());
+    // 2. Initialize TCP/IP and event loop. The driver keeps its calibration in NVS: config_init()
+    //    has initialized it, which makes this a check, and without it Wi-Fi cannot start.
+    esp_err_t err = nvs_flash_init();
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(TAG, "NVS unavailable (%s), not starting Wi-Fi", esp_err_to_name(err));
+        return err;
+    }
     ESP_ERROR_CHECK(esp_netif_init());
     ESP_ERROR_CHECK(esp_event_loop_create_default());
 
     // 3. Create default WiFi station
-    esp_netif_create_default_wifi_sta();
+    s_sta_netif = esp_netif_create_default_wifi_sta();
 
     // 4. Initialize WiFi driver
     wifi_init_config_t cfg = WIFI_INIT_CONFIG_DEFAULT();
@@ -103,6 +295,7 @@ esp_err_t wifi_setup(void)
     // 5. Register event handlers for WiFi and IP events
     esp_event_handler_instance_t instance_any_id;
     esp_event_handler_instance_t instance_got_ip;
+    esp_event_handler_instance_t instance_lost_ip;
     ESP_ERROR_CHECK(esp_event_handler_instance_register(WIFI_EVENT,
                                                         ESP_EVENT_ANY_ID,
                                                         &event_handler,
@@ -113,6 +306,15 @@ esp_err_t wifi_setup(void)
                                                         &event_handler,
                                                         NULL,
                                                         &instance_got_ip));
+    ESP_ERROR_CHECK(esp_event_handler_instance_register(IP_EVENT,
+                                                        IP_EVENT_STA_LOST_IP,
+                                                        &event_handler,
+                                                        NULL,
+                                                        &instance_lost_ip));
+    const esp_timer_create_args_t retry_args = {
+        .callback = retry_timer_cb,
+        .name = "wifi_retry"};
+    ESP_ERROR_CHECK(esp_timer_create(&retry_args, &s_retry_timer));
 
     // 6. Configure WiFi connection parameters
     wifi_config_t wifi_config = {
@@ -120,8 +322,26 @@ esp_err_t wifi_setup(void)
             .ssid = WIFI_SSID,
             .password = WIFI_PASS,
             .threshold.authmode = WIFI_AUTH_WPA2_PSK,
+            .listen_interval = CONFIG_FLORALINK_WIFI_LISTEN_INTERVAL,
         },
     };
+#if CONFIG_FLORALINK_WIFI_FAST_CONNECT
+    // Go straight to the last AP on its channel; the lease is reused only if configured
+    if (s_cache.valid)
+    {
+        s_fast_attempt = true;
+        wifi_config.sta.bssid_set = true;
+        memcpy(wifi_config.sta.bssid, s_cache.bssid, sizeof(wifi_config.sta.bssid));
+        wifi_config.sta.channel = s_cache.channel;
+        wifi_config.sta.scan_method = WIFI_FAST_SCAN;
+#if CONFIG_FLORALINK_WIFI_REUSE_LEASE
+        esp_netif_dhcpc_stop(s_sta_netif);
+        esp_netif_set_ip_info(s_sta_netif, &s_cache.ip_info);
+        esp_netif_set_dns_info(s_sta_netif, ESP_NETIF_DNS_MAIN, &s_cache.dns);
+#endif
+        ESP_LOGI(TAG, "Fast connect on channel %d", s_cache.channel);
+    }
+#endif
     // Store SSID for later retrieval
     strncpy(s_current_ssid, (const char *)wifi_config.sta.ssid, WIFI_SSID_MAX_LEN - 1);
     s_current_ssid[WIFI_SSID_MAX_LEN - 1] = '\0';
@@ -130,32 +350,21 @@ esp_err_t wifi_setup(void)
     ESP_ERROR_CHECK(esp_wifi_set_mode(WIFI_MODE_STA));
     ESP_ERROR_CHECK(esp_wifi_set_config(WIFI_IF_STA, &wifi_config));
     ESP_ERROR_CHECK(esp_wifi_start());
+    // TX power can only be read or set once the driver is started. Keep what the driver
+    // starts with, so switching back to the default profile at runtime restores it.
+    ESP_ERROR_CHECK(esp_wifi_get_ps(&s_profiles[WIFI_PROFILE_DEFAULT].ps));
+    ESP_ERROR_CHECK(esp_wifi_get_max_tx_power(&s_profiles[WIFI_PROFILE_DEFAULT].max_tx_power));
+    s_started = true;
+    // Later changes come from the store; the default profile leaves the driver as it is
+    wifi_profile_t profile = (wifi_profile_t)config_get(CFG_WIFI_PROFILE);
+    if (profile != WIFI_PROFILE_DEFAULT)
+        ESP_ERROR_CHECK(wifi_set_profile(profile));
+    config_subscribe(&s_profile_sub);
 
-    ESP_LOGI(TAG, "wifi_init_sta finished.");
-
-    // 8. Wait for connection or failure event
-    EventBits_t bits = xEventGroupWaitBits(s_wifi_event_group,
-                                           WIFI_CONNECTED_BIT | WIFI_FAIL_BIT,
-                                           pdFALSE,
-                                           pdFALSE,
-                                           portMAX_DELAY);
+    sched_add(&s_rssi_job, WIFI_RSSI_PERIOD_MS);
 
-    // 9. Return result
-    if (bits & WIFI_CONNECTED_BIT)
-    {
-        ESP_LOGI(TAG, "connected to ap SSID:%s password:%s", WIFI_SSID, WIFI_PASS);
-        return ESP_OK;
-    }
-    else if (bits & WIFI_FAIL_BIT)
-    {
-        ESP_LOGI(TAG, "Failed to connect to SSID:%s, password:%s", WIFI_SSID, WIFI_PASS);
-        return ESP_FAIL;
-    }
-    else
-    {
-        ESP_LOGE(TAG, "UNEXPECTED EVENT");
-        return ESP_FAIL;
-    }
+    ESP_LOGI(TAG, "wifi_init_sta finished, connecting to SSID:%s in the background", WIFI_SSID);
+    return ESP_OK;
 }
 
 /**
@@ -167,3 +376,57 @@ const char *wifi_get_ssid(void)
 {
     return s_current_ssid;
 }
+
+void wifi_get_connect_stats(wifi_connect_stats_t *stats)
+{
+    portENTER_CRITICAL(&s_stats_lock);
+    *stats = s_connect_stats;
+    portEXIT_CRITICAL(&s_stats_lock);
+}
+
+bool wifi_is_connected(void)
+{
+    return s_wifi_event_group && (xEventGroupGetBits(s_wifi_event_group) & WIFI_CONNECTED_BIT);
+}
+
+esp_err_t wifi_set_profile(wifi_profile_t profile)
+{
+    if ((unsigned)profile >= WIFI_PROFILE_COUNT)
+        return ESP_ERR_INVALID_ARG;
+    s_profile = profile;
+    if (!s_started)
+        return ESP_OK;
+    esp_err_t err = esp_wifi_set_ps(s_profiles[profile].ps);
+    if (err == ESP_OK)
+        err = esp_wifi_set_max_tx_power(s_profiles[profile].max_tx_power);
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Failed to apply profile %s (%s)", s_profiles[profile].name, esp_err_to_name(err));
+        return err;
+    }
+    ESP_LOGI(TAG, "Power profile %s", s_profiles[profile].name);
+    return ESP_OK;
+}
+
+wifi_profile_t wifi_get_profile(void)
+{
+    return s_profile;
+}
+
+const char *wifi_profile_name(wifi_profile_t profile)
+{
+    return (unsigned)profile < WIFI_PROFILE_COUNT ? s_profiles[profile].name : NULL;
+}
+
+esp_err_t wifi_profile_from_name(const char *name, wifi_profile_t *profile)
+{
+    for (int i = 0; i < WIFI_PROFILE_COUNT; i++)
+    {
+        if (strcmp(name, s_profiles[i].name) == 0)
+        {
+            *profile = (wifi_profile_t)i;
+            return ESP_OK;
+        }
+    }
+    return ESP_ERR_NOT_FOUND;
+}
@@ -1,13 +1,71 @@
 #ifndef WIFI_SETUP_H
 #define WIFI_SETUP_H
 
+#include <stdbool.h>
+#include <stdint.h>
 #include <esp_err.h>
+#include <esp_event.h>
 
 #define WIFI_SSID_MAX_LEN 64
-// Initialize Wi-Fi in station mode and connect to the configured SSID
+// Link state changes, posted on the default event loop (no event data)
+ESP_EVENT_DECLARE_BASE(LINK_EVENT);
+
+enum
+{
+    LINK_EVENT_UP,   // Station associated and has an IP address
+    LINK_EVENT_DOWN, // Station lost its AP or its address; reconnection is under way
+};
+
+// Initialize Wi-Fi in station mode and start connecting to the configured SSID (non-blocking)
 esp_err_t wifi_setup(void);
 
+// True while the station has an IP address
+bool wifi_is_connected(void);
+
 // Get the current WiFi SSID (station mode)
 const char *wifi_get_ssid(void);
 
+typedef struct
+{
+    uint32_t last_connect_us; // wifi_setup() start to IP address, last connection
+    bool last_fast;           // Last connection used the cached BSSID/channel
+    uint32_t fast_ok;         // Fast connects that succeeded
+    uint32_t fast_failures;   // Fast connects that fell back to a full scan
+    uint32_t full;            // Connections made after a scan
+    bool up;                  // Link currently up
+    uint32_t connects;        // Link up transitions
+    uint32_t disconnects;     // Link down transitions
+    uint32_t retries;         // Backoff-delayed reconnection attempts
+    uint32_t backoff_ms;      // Delay before the pending attempt, 0 while up
+    int8_t rssi_last;         // dBm
+    int8_t rssi_avg;          // dBm, exponential moving average
+    uint32_t rssi_samples;
+} wifi_connect_stats_t;
+
+// Get the connection time and fast reconnect counters
+void wifi_get_connect_stats(wifi_connect_stats_t *stats);
+
+// Radio power profiles: power-save mode and maximum TX power
+typedef enum
+{
+    WIFI_PROFILE_PERFORMANCE, // No power save, full TX power: lowest latency
+    WIFI_PROFILE_BALANCED,    // Modem sleep, wake for every DTIM beacon
+    WIFI_PROFILE_LOW_POWER,   // Modem sleep, wake every CONFIG_FLORALINK_WIFI_LISTEN_INTERVAL beacons
+    WIFI_PROFILE_DEFAULT,     // Driver defaults: untouched at start, restored when switched back to (last: values are kept in NVS)
+    WIFI_PROFILE_COUNT
+} wifi_profile_t;
+
+// Apply a power profile now. Not persisted: wifi_setup() applies the CFG_WIFI_PROFILE setting
+// and follows its changes, so set that to keep a profile across reboots
+esp_err_t wifi_set_profile(wifi_profile_t profile);
+
+// Current power profile
+wifi_profile_t wifi_get_profile(void);
+
+// Name of a profile ("performance", "balanced", "low_power", "default"), NULL if out of range
+const char *wifi_profile_name(wifi_profile_t profile);
+
+// Look up a profile by name; ESP_ERR_NOT_FOUND if unknown
+esp_err_t wifi_profile_from_name(const char *name, wifi_profile_t *profile);
+
 #endif // WIFI_SETUP_H
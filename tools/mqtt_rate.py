@@ -0,0 +1,122 @@
+#!/usr/bin/env python3
+# SPDX-License-Identifier: CC0-1.0
+"""Measure the FloraLink MQTT telemetry rate on a broker.
+
+Subscribes to the telemetry topic and its /replay subtopic and prints, per interval, the
+messages per second, the readings per second and the payload bytes per reading. The last
+value is also given with the MQTT PUBLISH header (fixed header, topic, packet id for QoS > 0)
+to show the per-message overhead that batching amortises. Both payload forms of
+main/mqtt_pub.h are decoded.
+
+    pip install paho-mqtt
+    python tools/mqtt_rate.py --host localhost --interval 10
+
+Run it once per CONFIG_FLORALINK_MQTT_BATCH_SIZE setting and compare the results.
+"""
+
+import argparse
+import json
+import struct
+import threading
+import time
+
+import paho.mqtt.client as mqtt
+
+BINARY_MAGIC = 0xF1
+BINARY_HEADER = struct.Struct('<BBHIq')
+
+
+def count_readings(topic: str, payload: bytes) -> int:
+    """Readings in one message, 0 if the payload is not recognised."""
+    if payload[:1] == bytes([BINARY_MAGIC]) and len(payload) >= BINARY_HEADER.size:
+        return BINARY_HEADER.unpack_from(payload)[2]
+    try:
+        doc = json.loads(payload)
+    except ValueError:
+        return 0
+    if topic.endswith('/replay'):
+        return len(doc.get('replay', []))
+    return len(doc.get('s', []))
+
+
+def publish_overhead(topic: str, payload_len: int, qos: int) -> int:
+    """Bytes of a PUBLISH packet besides the payload."""
+    remaining = 2 + len(topic.encode()) + (2 if qos else 0) + payload_len
+    length_bytes = 1
+    while remaining >= 128 ** length_bytes:
+        length_bytes += 1
+    return 1 + length_bytes + remaining - payload_len
+
+
+class Counter:
+    def __init__(self) -> None:
+        self.lock = threading.Lock()
+        self.reset()
+
+    def reset(self) -> None:
+        self.messages = 0
+        self.readings = 0
+        self.payload_bytes = 0
+        self.wire_bytes = 0
+        self.unknown = 0
+
+    def add(self, topic: str, payload: bytes, qos: int) -> None:
+        n = count_readings(topic, payload)
+        with self.lock:
+            self.messages += 1
+            self.readings += n
+            self.payload_bytes += len(payload)
+            self.wire_bytes += len(payload) + publish_overhead(topic, len(payload), qos)
+            if not n:
+                self.unknown += 1
+
+    def take(self) -> tuple:
+        with self.lock:
+            snapshot = (self.messages, self.readings, self.payload_bytes, self.wire_bytes, self.unknown)
+            self.reset()
+        return snapshot
+
+
+def main() -> None:
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument('--host', default='localhost')
+    parser.add_argument('--port', type=int, default=1883)
+    parser.add_argument('--topic', default='floralink/distance', help='CONFIG_FLORALINK_MQTT_TOPIC')
+    parser.add_argument('--interval', type=float, default=10.0, help='report period in seconds')
+    parser.add_argument('--count', type=int, default=0, help='reports before exiting, 0 = run until Ctrl-C')
+    args = parser.parse_args()
+
+    counter = Counter()
+    if hasattr(mqtt, 'CallbackAPIVersion'):  # paho-mqtt 2.x
+        client = mqtt.Client(mqtt.CallbackAPIVersion.VERSION2)
+    else:
+        client = mqtt.Client()
+    client.on_connect = lambda c, *_: c.subscribe([(args.topic, 1), (args.topic + '/replay', 1)])
+    client.on_message = lambda c, userdata, msg: counter.add(msg.topic, msg.payload, msg.qos)
+    client.connect(args.host, args.port)
+    client.loop_start()
+
+    print('      msg/s  readings/s  readings/msg  payload B/reading  wire B/reading')
+    reports = 0
+    try:
+        start = time.monotonic()
+        while not args.count or reports < args.count:
+            time.sleep(args.interval)
+            now = time.monotonic()
+            messages, readings, payload_bytes, wire_bytes, unknown = counter.take()
+            elapsed, start = now - start, now
+            per = (lambda v: v / readings) if readings else (lambda v: 0.0)
+            print('%11.2f %11.2f %13.1f %18.2f %15.2f%s' % (
+                messages / elapsed, readings / elapsed, readings / messages if messages else 0.0,
+                per(payload_bytes), per(wire_bytes),
+                '  (%d unrecognised)' % unknown if unknown else ''), flush=True)
+            reports += 1
+    except KeyboardInterrupt:
+        pass
+    finally:
+        client.loop_stop()
+        client.disconnect()
+
+
+if __name__ == '__main__':
+    main()